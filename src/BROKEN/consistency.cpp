@@ -3,10 +3,12 @@
 #include "view.h"
 #include "volume.h"
 #include "consistency.h"
-#include "config.h"
+#include "params.h"
 #include "photohull.h"
 
 #include <cmath>
+#include <cstdlib>
+#include <iostream>
 
 //TODO: Switch all instances of variables to Eigen style
 #include <Eigen/Core>
@@ -20,9 +22,43 @@ typedef Vector4f  vec4;
 typedef Vector4i ivec4;
 
 using namespace std;
-using namespace cfg;
 
+//Settings of the dataset being carved
+static ScanParams   scan_params;
+static bool         scan_params_set = false;
 
+void setConsistencyParams(const ScanParams& params)
+{
+    scan_params     = params;
+    scan_params_set = true;
+}
+
+//Thresholds, set by setConsistencyParams or else resolved on first use from
+//the one dataset section under the global config.  Keys are never read from
+//the root, which only holds the sections of the file.
+static const PhotoHullParams& consistencyParams()
+{
+    if(scan_params_set)
+        return scan_params.photohull;
+
+    const cfg::config* dataset = NULL;
+    int count = 0;
+    for(cfg::config::child_map::const_iterator i=cfg::config::global.childBegin();
+        i!=cfg::config::global.childEnd(); ++i)
+        if(i->first != "global")
+        {
+            dataset = &i->second;
+            count++;
+        }
+    if(count != 1 || !resolveParams(*dataset, scan_params))
+    {
+        cout << "Consistency checks need the settings of exactly one dataset, found "
+             << count << endl;
+        exit(1);
+    }
+    scan_params_set = true;
+    return scan_params.photohull;
+}
 
 
 //Check if a set of neighborhoods is photoconsistent
@@ -60,15 +96,11 @@ bool checkNeighborhood(vector<VoxelProjection> &patches, vec3& color)
     
     vec3 sigma = mu1;
     //These values are arbitrary
-    vec3 thresh = cfg::config::global.get<vec3>("photohull_threshold");
+    const vec3& thresh = consistencyParams().threshold;
 
     bool cull1 = sigma(0) > thresh(0), 
         cull2 = sigma(1) > thresh(1),
         cull3 = sigma(2) > thresh(2);
-    //count1 += cull1 && !cull2 && !cull3;
-    //count2 += !cull1 && cull2 && !cull3;
-    //count3 += !cull1 && !cull2 && cull3;
-    //count4 += cull1 || cull2 || cull3;
     return  !cull1 && !cull2 && !cull3;
 }
 
@@ -76,8 +108,9 @@ bool checkApproximateConsistency(vector<VoxelProjection>& projections)
 {
     if (projections.size() < 2) return true;
     
+    int pad = consistencyParams().approx_pad;
     for (int i = 0; i < projections.size(); i++) {
-        projections[i].set_pad(config::global.get<int>("approx_pad"));
+        projections[i].set_pad(pad);
     }
     
     vector<vector<float> > colors[3];
@@ -148,7 +181,7 @@ bool checkApproximateConsistency(vector<VoxelProjection>& projections)
 
     }
     
-    vec3 threshold = config::global.get<vec3>("approx_consistency_threshold");
+    const vec3& threshold = consistencyParams().approx_threshold;
 
     //for (int i = 0; i < 3; i++)
     //    cout << min_variance[i] << " ";
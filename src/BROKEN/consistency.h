@@ -86,6 +86,11 @@ struct VoxelProjection
 };
 
 
+//Settings of the dataset, as loadScanParams gives them.  Without a call the
+//thresholds come from the one dataset section of cfg::config::global.
+struct ScanParams;
+extern void setConsistencyParams(const ScanParams& params);
+
 //Check if a set of neighborhoods is photoconsistent
 extern bool checkNeighborhood(std::vector<VoxelProjection>& patches) ;
 
@@ -8,6 +8,7 @@
 #include "photohull.h"
 #include "config.h"
 #include "consistency.h"
+#include "metrics.h"
 
 //TODO: Switch all instances of variables to Eigen style
 #include <Eigen/Core>
@@ -24,8 +25,6 @@ typedef Vector4i ivec4;
 using namespace std;
 using namespace blitz;
 
-long long count1 = 0, count2 = 0, count3 = 0, count4 = 0, count5 = 0, count6 = 0;
-
 //Plane directions
 const vec3 
 DN[6] = {
@@ -67,13 +66,12 @@ void visualHull(
     Volume* volume, 
     std::vector<View*>& views) {
 
+    MetricTimer timer("visualhull");
     double threshold = 5;
 
     int xr = volume->xRes, yr = volume->yRes, zr = volume->zRes;
     
     for (int x = 0; x < xr; x++) { 
-        if (x % 5 == 0) { cout << "."; cout.flush(); }
-        if (x % 10 == 0) { cout << x; cout.flush(); }
         for (int y = 0; y < yr; y++) {
             for (int z = 0; z < zr; z++) {
                 vec3 pt(x + 0.5, y + 0.5, z + 0.5);
@@ -100,13 +98,16 @@ void visualHull(
 
 
 //Sweeps a plane through volume
+//  If band is not NULL, only voxels with a nonzero band entry are tested
 bool planeSweep(
     std::vector<View*> views,
     Volume* volume,
     int d,
     ivec3 bound,
-    int& removed)
+    int& removed,
+    const vector<unsigned char>* band = NULL)
 {
+    MetricTimer timer("photohull/sweep");
     for(size_t t=0; t<views.size(); t++) {
         views[t]->resetConsist();
     }
@@ -129,11 +130,16 @@ bool planeSweep(
         p(i) = dn(i) < 0 ? bound[i] - 1 : 0;
     
     for(int i=0; i<si; i++, p += dn, q = p) { 
-        if ((i % 10) == 0) cout << "." << flush;       
         for(int j=0; j<sj; j++, q += du, r = q) {
             for(int k=0; k<sk; k++, r += dv) {
-                if(volume->on_surface(r) && !checkConsistency(views, volume, r, d)) {
+                if(band && !(*band)[(int)r(0) + bound[0] * ((int)r(1) + bound[1] * (int)r(2))])
+                    continue;
+                if(!volume->on_surface(r))
+                    continue;
+                countMetric(METRIC_VOXELS_TESTED, 1);
+                if(!checkConsistency(views, volume, r, d)) {
                     (*volume)(r(0), r(1), r(2)) = 0;
+                    countMetric(METRIC_VOXELS_CARVED, 1);
                     removed++;
                     done = false;
                 }        
@@ -189,9 +195,7 @@ Volume* findHull(
         }
 
         cout << "end pass. removed " << num_removed << " voxels" << endl;
-        
-        cout << count1 << " " << count2 << " " << count3 << " " << count4 << " "
-             << count5 << " " << count6 << endl;
+
         if (num_removed == 0) break;
         
     }
@@ -200,5 +204,153 @@ Volume* findHull(
 }
 
 
+//Rescales the voxel -> image projections so that views can be used with a
+//grid that is scale[axis] times coarser than the one they were set up for.
+//Coarse voxel i sits at fine coordinate i * scale, so the columns grow.
+static void scaleCameras(
+    std::vector<View*>& views,
+    const vector<Matrix4f, aligned_allocator<Matrix4f> >& base,
+    const float scale[3])
+{
+    for(size_t i=0; i<views.size(); i++)
+    {
+        views[i]->cam = base[i];
+        for(int r=0; r<4; r++)
+        for(int c=0; c<3; c++)
+            views[i]->cam(r,c) *= scale[c];
+    }
+}
+
+//Finds the photo hull coarse-to-fine.
+//  The grid is carved at xr/2^(levels-1) first.  Each finer level starts from
+//  the surviving voxels of the previous one, dilated by margin voxels, and only
+//  voxels within margin of the upsampled surface (the boundary band) are tested.
+Volume* findHullHierarchical(
+    std::vector<View*> views, 
+    int xr, int yr, int zr,
+    vec3 low, vec3 high,
+    int levels,
+    int margin)
+{
+    //Save the finest level projections, so they can be rescaled per level
+    vector<Matrix4f, aligned_allocator<Matrix4f> > base;
+    for(size_t i=0; i<views.size(); i++)
+        base.push_back(views[i]->cam);
+    
+    Volume * volume = NULL;
+    
+    for(int level=levels-1; level>=0; level--)
+    {
+        MetricTimer timer("photohull/level");
+        int s  = 1 << level,
+            lx = max(1, xr / s), 
+            ly = max(1, yr / s), 
+            lz = max(1, zr / s);
+        
+        cout << "Level " << level << ": " << lx << "x" << ly << "x" << lz << endl;
+        float scale[3] = { (float)xr / lx, (float)yr / ly, (float)zr / lz };
+        scaleCameras(views, base, scale);
+        
+        Volume * next = new Volume((size_t)lx, (size_t)ly, (size_t)lz, low, high);
+        vector<unsigned char> band(lx * ly * lz, 1);
+        
+        if(volume == NULL)
+        {
+            //Coarsest level starts out solid
+            for(int i=0; i<lx; i++)
+            for(int j=0; j<ly; j++)
+            for(int k=0; k<lz; k++)
+                (*next)(i,j,k) = 255;
+        }
+        else
+        {
+            int px = volume->xRes, py = volume->yRes, pz = volume->zRes;
+            
+            //Upsample coarse occupancy and find distance to the coarse surface
+            //(in fine voxels, chessboard metric, clamped at margin+1)
+            vector<unsigned char> inside(lx * ly * lz);
+            vector<int> dist(lx * ly * lz, margin + 1);
+            
+            for(int i=0; i<lx; i++)
+            for(int j=0; j<ly; j++)
+            for(int k=0; k<lz; k++)
+            {
+                int ci = min(i * px / lx, px - 1), 
+                    cj = min(j * py / ly, py - 1), 
+                    ck = min(k * pz / lz, pz - 1);
+                
+                int idx = i + lx * (j + ly * k);
+                inside[idx] = (*volume)(ci,cj,ck) ? 1 : 0;
+                if(inside[idx] && volume->on_surface(ivec3(ci,cj,ck)))
+                    dist[idx] = 0;
+            }
+            
+            //Two pass chamfer sweep for the distance to the upsampled surface,
+            //each pass takes the 13 neighbours it has already visited
+            for(int pass=0; pass<2; pass++)
+            {
+                int d0 = pass ? -1 : 1;
+                int i0 = pass ? lx-1 : 0, 
+                    j0 = pass ? ly-1 : 0, 
+                    k0 = pass ? lz-1 : 0;
+                
+                for(int k=k0; k>=0 && k<lz; k+=d0)
+                for(int j=j0; j>=0 && j<ly; j+=d0)
+                for(int i=i0; i>=0 && i<lx; i+=d0)
+                {
+                    int idx = i + lx * (j + ly * k);
+                    for(int dk=-1; dk<=0; dk++)
+                    for(int dj=-1; dj<=1; dj++)
+                    for(int di=-1; di<=1; di++)
+                    {
+                        if(dk == 0 && (dj > 0 || (dj == 0 && di >= 0)))
+                            continue;
+                        int ni = i + d0 * di, nj = j + d0 * dj, nk = k + d0 * dk;
+                        if(ni < 0 || nj < 0 || nk < 0 || ni >= lx || nj >= ly || nk >= lz)
+                            continue;
+                        dist[idx] = min(dist[idx], dist[ni + lx * (nj + ly * nk)] + 1);
+                    }
+                }
+            }
+            
+            //Dilate by margin and restrict testing to the boundary band
+            for(int i=0; i<lx; i++)
+            for(int j=0; j<ly; j++)
+            for(int k=0; k<lz; k++)
+            {
+                int idx = i + lx * (j + ly * k);
+                band[idx] = dist[idx] <= margin;
+                (*next)(i,j,k) = (inside[idx] || band[idx]) ? 255 : 0;
+            }
+            
+            delete volume;
+        }
+        volume = next;
+        
+        int pass = 1, num_removed;
+        do
+        {
+            num_removed = 0;
+            cout << "Pass #" << pass++ << endl;
+            
+            for(int i=0; i<6; i++) {
+                cout << i << " " << flush;
+                planeSweep(views, volume, i, ivec3(lx, ly, lz), num_removed,
+                    level == levels-1 ? NULL : &band);
+            }
+            cout << endl;
+            
+            cout << "end pass. removed " << num_removed << " voxels" << endl;
+        } while(num_removed > 0);
+    }
+    
+    //Restore original projections
+    const float one[3] = { 1, 1, 1 };
+    scaleCameras(views, base, one);
+    
+    return volume;
+}
+
+
 
 
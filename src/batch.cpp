@@ -0,0 +1,385 @@
+//STL
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/stat.h>
+
+//Project files
+#include "batch.h"
+#include "debug.h"
+#include "mesh.h"
+#include "metrics.h"
+#include "params.h"
+#include "sfm.h"
+#include "stereo.h"
+#include "system.h"
+#include "view.h"
+#include "volume.h"
+
+using namespace std;
+
+//Stages every dataset goes through, in order
+enum BatchStage
+{
+    STAGE_LOAD,
+    STAGE_VIEWS,
+    STAGE_CARVE,
+    STAGE_EXPORT,
+    STAGE_DONE
+};
+
+static const char* STAGE_NAMES[] = { "load", "views", "carve", "export" };
+static const char* STAGE_TIMERS[] = { "batch/load", "batch/views", "batch/carve", "batch/export" };
+
+//Rough memory use of the carving engines beyond the views they are given:
+//the volume and its copies per voxel, item buffers and masks per pixel
+static const size_t CARVE_VOXEL_BYTES = 8;
+static const size_t CARVE_PIXEL_BYTES = 4;
+
+//Output buffers per surface voxel
+static const size_t EXPORT_VOXEL_BYTES = 16;
+static const size_t MESH_VOXEL_BYTES   = 64;
+
+//A dataset and what its finished stages left behind
+struct BatchState
+{
+    BatchState() :
+        stage(STAGE_LOAD),
+        running(false),
+        resident(0),
+        held(0) {}
+
+    BatchResult     result;
+    BatchStage      stage;      //Next stage to run
+    bool            running;    //A stage is running
+
+    size_t          resident;   //Bytes held between stages
+    size_t          held;       //Bytes held once the running stage ends
+
+    ScanParams      params;
+    vector<View>    views;
+    Volume          volume;
+};
+
+//Scheduler state, guarded by lock
+struct Batch
+{
+    const BatchParams*  params;
+    vector<BatchState>  jobs;
+
+    pthread_mutex_t     lock;
+    pthread_cond_t      changed;
+
+    int                 free_cores;
+    size_t              budget;
+    size_t              used;       //Resident data plus estimates of running stages
+    int                 running;    //Stages running
+    size_t              started;    //Datasets whose first stage was started
+    size_t              finished;   //Datasets done or failed
+};
+
+//A stage picked to run
+struct BatchTask
+{
+    size_t  job;
+    int     cores;
+    size_t  memory;
+};
+
+static bool fileExists(const string& path)
+{
+    struct stat s;
+    return stat(path.c_str(), &s) == 0;
+}
+
+//Strips the directory and extension of a path
+static string baseName(const string& path)
+{
+    size_t slash = path.rfind('/');
+    string name = slash == string::npos ? path : path.substr(slash + 1);
+    size_t dot = name.rfind('.');
+    return dot == string::npos || dot == 0 ? name : name.substr(0, dot);
+}
+
+string batchOutputName(const BatchJob& job, const string& section)
+{
+    string name = baseName(job.config);
+    return name == section ? name : name + "_" + section;
+}
+
+//Config file and section, for messages
+static string jobLabel(const BatchJob& job)
+{
+    return job.section.empty() ? job.config : job.config + ":" + job.section;
+}
+
+static size_t voxelCount(const ScanParams& params)
+{
+    return (size_t)params.resolution * params.resolution * params.resolution;
+}
+
+static size_t surfaceVoxels(const ScanParams& params)
+{
+    return 6 * (size_t)params.resolution * params.resolution;
+}
+
+static size_t viewPixels(const vector<View>& views)
+{
+    size_t pixels = 0;
+    for(size_t i=0; i<views.size(); i++)
+        pixels += (size_t)views[i].image().width() * views[i].image().height();
+    return pixels;
+}
+
+//Memory a stage needs on top of what its dataset already holds
+static size_t stageMemory(const BatchState& s, const BatchParams& params)
+{
+    switch(s.stage)
+    {
+    case STAGE_VIEWS:
+        return params.view_memory;
+    case STAGE_CARVE:
+        return voxelCount(s.params) * CARVE_VOXEL_BYTES + viewPixels(s.views) * CARVE_PIXEL_BYTES;
+    case STAGE_EXPORT:
+        return surfaceVoxels(s.params) * (params.mesh ? MESH_VOXEL_BYTES : EXPORT_VOXEL_BYTES);
+    default:
+        return 0;
+    }
+}
+
+//Picks the next stage to run, false if none can start now.  Called with
+//the lock held.
+static bool pickStage(Batch& batch, BatchTask& task)
+{
+    if(batch.free_cores < 1)
+        return false;
+
+    size_t last = min(batch.started, batch.jobs.size() - 1);
+
+    //Carving shares the cores not needed by the other waiting stages
+    int carves = 0, others = 0;
+    for(size_t j=0; j<=last; j++)
+    {
+        const BatchState& s = batch.jobs[j];
+        if(s.running || s.stage == STAGE_DONE)
+            continue;
+        if(s.stage == STAGE_CARVE)
+            carves++;
+        else
+            others++;
+    }
+
+    bool held_back = false;
+    for(size_t j=0; j<=last; j++)
+    {
+        BatchState& s = batch.jobs[j];
+        if(s.running || s.stage == STAGE_DONE)
+            continue;
+
+        //Finish the datasets under way before taking on new ones
+        if(j == batch.started && held_back)
+            break;
+
+        size_t memory = stageMemory(s, *batch.params);
+        if(batch.running > 0 && batch.used + memory > batch.budget)
+        {
+            held_back = true;
+            continue;
+        }
+
+        task.job    = j;
+        task.memory = memory;
+        task.cores  = 1;
+        if(s.stage == STAGE_CARVE)
+            task.cores = max(1, (batch.free_cores - others) / carves);
+        return true;
+    }
+    return false;
+}
+
+//Runs one stage of a dataset, sets what the dataset holds afterwards
+static bool runStage(BatchState& s, int cores, const BatchParams& params)
+{
+    MetricTimer timer(STAGE_TIMERS[s.stage]);
+    ThreadCountScope threads(cores);
+    const BatchJob& job = s.result.job;
+
+    switch(s.stage)
+    {
+    case STAGE_LOAD:
+        if(!loadScanParams(job.config, s.params, job.section))
+            return false;
+        s.result.name = batchOutputName(job, s.params.name);
+        s.held = 0;
+
+        //Fail before the views stage is admitted
+        if(!fileExists(s.params.views_file))
+        {
+            cout << "No views file " << s.params.views_file << " for " << jobLabel(job) << endl;
+            return false;
+        }
+        return true;
+
+    case STAGE_VIEWS:
+        s.views = loadDatasetViews(s.params.views_file);
+        if(s.views.empty())
+        {
+            cout << "No views in " << s.params.views_file << endl;
+            return false;
+        }
+        s.held = viewPixels(s.views) * 3;
+        return true;
+
+    case STAGE_CARVE:
+    {
+        PhotoHullParams photohull = s.params.photohull;
+        photohull.threads = cores;
+        s.volume = stereoPhotoHull(s.views, s.params.dims(), s.params.low, s.params.high, photohull);
+        s.views.clear();
+        s.held = voxelCount(s.params) * sizeof(Color);
+        return true;
+    }
+
+    case STAGE_EXPORT:
+    {
+        string base = params.output + "/" + s.result.name;
+        bool saved = saveVolumePLY(base + ".ply", s.volume);
+        if(saved && params.mesh)
+            saved = meshVolume(s.volume, cores).save(base + ".mesh.ply");
+        s.volume = Volume();
+        s.held = 0;
+        return saved;
+    }
+
+    default:
+        return false;
+    }
+}
+
+//Worker loop, runs stages until every dataset is done
+static void* batchWorker(void* data)
+{
+    Batch& batch = *(Batch*)data;
+
+    pthread_mutex_lock(&batch.lock);
+    while(batch.finished < batch.jobs.size())
+    {
+        BatchTask task;
+        if(!pickStage(batch, task))
+        {
+            pthread_cond_wait(&batch.changed, &batch.lock);
+            continue;
+        }
+
+        BatchState& s = batch.jobs[task.job];
+        if(task.job == batch.started)
+        {
+            batch.started++;
+            s.result.seconds = wallTime();
+        }
+        if(batch.used + task.memory > batch.budget)
+            cout << "Warning: " << STAGE_NAMES[s.stage] << " of " << jobLabel(s.result.job)
+                 << " may not fit in the memory budget" << endl;
+
+        s.running = true;
+        batch.running++;
+        batch.free_cores -= task.cores;
+        batch.used += task.memory;
+        cout << "Batch: " << STAGE_NAMES[s.stage] << " " << jobLabel(s.result.job)
+             << " on " << task.cores << (task.cores == 1 ? " core" : " cores") << endl;
+        pthread_mutex_unlock(&batch.lock);
+
+        bool ok = false;
+        try
+        {
+            ok = runStage(s, task.cores, *batch.params);
+        }
+        catch(std::exception& e)
+        {
+            cout << "Batch: " << STAGE_NAMES[s.stage] << " of " << jobLabel(s.result.job)
+                 << " failed: " << e.what() << endl;
+        }
+        if(!ok)
+        {
+            s.views.clear();
+            s.volume = Volume();
+            s.held = 0;
+        }
+
+        pthread_mutex_lock(&batch.lock);
+        s.running = false;
+        batch.running--;
+        batch.free_cores += task.cores;
+        batch.used -= task.memory + s.resident;
+        s.resident = s.held;
+        batch.used += s.resident;
+
+        s.stage = ok ? (BatchStage)(s.stage + 1) : STAGE_DONE;
+        if(s.stage == STAGE_DONE)
+        {
+            s.result.ok = ok;
+            s.result.seconds = wallTime() - s.result.seconds;
+            batch.finished++;
+            cout << "Batch: " << jobLabel(s.result.job) << " "
+                 << (ok ? "done" : "failed") << " in " << s.result.seconds << "s" << endl;
+        }
+        pthread_cond_broadcast(&batch.changed);
+    }
+    pthread_mutex_unlock(&batch.lock);
+    return NULL;
+}
+
+vector<BatchResult> runBatch(
+    const vector<BatchJob>& jobs,
+    const BatchParams& params)
+{
+    Batch batch;
+    batch.params     = &params;
+    batch.jobs.resize(jobs.size());
+    for(size_t j=0; j<jobs.size(); j++)
+        batch.jobs[j].result.job = jobs[j];
+
+    if(params.threads > 0)
+        batch.free_cores = params.threads;
+    else
+    {
+        ThreadCountScope restore(0);
+        setThreadCount(0);
+        batch.free_cores = threadCount();
+    }
+    batch.budget = params.memory > 0 ? params.memory : physicalMemory() / 4 * 3;
+    if(batch.budget == 0)
+        batch.budget = (size_t)-1;
+    batch.used     = 0;
+    batch.running  = 0;
+    batch.started  = 0;
+    batch.finished = 0;
+
+    if(!jobs.empty())
+    {
+        pthread_mutex_init(&batch.lock, NULL);
+        pthread_cond_init(&batch.changed, NULL);
+
+        //One worker per core at most, the calling thread is one of them
+        vector<pthread_t> workers(min((size_t)batch.free_cores, jobs.size()) - 1);
+        size_t created = 0;
+        for(; created<workers.size(); created++)
+            if(pthread_create(&workers[created], NULL, batchWorker, &batch) != 0)
+                break;
+        batchWorker(&batch);
+        for(size_t i=0; i<created; i++)
+            pthread_join(workers[i], NULL);
+
+        pthread_cond_destroy(&batch.changed);
+        pthread_mutex_destroy(&batch.lock);
+    }
+
+    vector<BatchResult> results(jobs.size());
+    for(size_t j=0; j<jobs.size(); j++)
+        results[j] = batch.jobs[j].result;
+    return results;
+}
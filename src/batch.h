@@ -0,0 +1,81 @@
+//Batch processing of many datasets on one machine
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+#include <vector>
+
+//One dataset of a batch
+struct BatchJob
+{
+    BatchJob() {}
+    BatchJob(const std::string& config_, const std::string& section_ = "") :
+        config(config_), section(section_) {}
+
+    //Config file and the dataset section in it, see loadScanParams
+    std::string config;
+    std::string section;
+};
+
+//Batch runner parameters
+struct BatchParams
+{
+    BatchParams() :
+        threads(0),
+        memory(0),
+        view_memory(256 << 20),
+        output("out"),
+        mesh(false) {}
+
+    //Cores shared by all datasets, 0 uses all of them
+    int threads;
+
+    //Bytes the datasets in flight may use together, 0 uses three quarters
+    //of the physical memory
+    size_t memory;
+
+    //Guess of the memory taken by the images of a dataset, used until they
+    //are loaded
+    size_t view_memory;
+
+    //Directory the results are written to
+    std::string output;
+
+    //Also write a surface mesh of each volume
+    bool mesh;
+};
+
+//Outcome of one dataset
+struct BatchResult
+{
+    BatchResult() : ok(false), seconds(0) {}
+
+    BatchJob    job;
+
+    //Dataset name, also the base name of its output files
+    std::string name;
+
+    //False if a stage failed, the remaining stages are skipped
+    bool        ok;
+
+    //Wall clock time from the first stage starting to the last one ending
+    double      seconds;
+};
+
+//Base name of the output files of a dataset: the config file name, with the
+//name of the section it resolved to appended if that differs
+extern std::string batchOutputName(const BatchJob& job, const std::string& section);
+
+//Runs each dataset through load, structure from motion, carving and export.
+//  Stages of different datasets run side by side on a shared pool of cores.
+//  A stage is only started once its memory estimate fits in the budget next
+//  to the data the started datasets hold, datasets already under way go
+//  first and no new one is started while one of them is held back.  A stage
+//  too big for the budget on its own still runs when nothing else does.
+//  Carving gets the cores left over by the other stages, the rest run on
+//  one core.  Results are in job order.
+extern std::vector<BatchResult> runBatch(
+    const std::vector<BatchJob>& jobs,
+    const BatchParams& params = BatchParams());
+
+#endif
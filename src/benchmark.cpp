@@ -0,0 +1,381 @@
+//STL
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+//Eigen
+#include <Eigen/Core>
+
+//Project files
+#include "benchmark.h"
+#include "carve.h"
+#include "consistency.h"
+#include "debug.h"
+#include "image.h"
+#include "sfm.h"
+#include "stereo.h"
+#include "synthetic.h"
+#include "system.h"
+#include "view.h"
+#include "volume.h"
+
+using namespace std;
+using namespace Eigen;
+
+//Volume resolutions of the kernel benchmarks
+static const int PROJECTION_RESOLUTION  = 64;
+static const int CONSISTENCY_RESOLUTION = 32;
+
+//Footprint padding of the approximate consistency benchmark
+static const int APPROX_PAD = 2;
+
+//Check values are FNV-1a hashes
+static const unsigned long long HASH_START = 14695981039346656037ULL;
+
+static void hashBytes(unsigned long long& h, const void* data, size_t n)
+{
+    const ubyte* p = (const ubyte*)data;
+    for(size_t i=0; i<n; i++)
+        h = (h ^ p[i]) * 1099511628211ULL;
+}
+
+template<class T> static void hashValue(unsigned long long& h, const T& v)
+{
+    hashBytes(h, &v, sizeof(v));
+}
+
+static unsigned long long hashImage(const Image& img)
+{
+    unsigned long long h = HASH_START;
+    for(int y=0; y<img.height(); y++)
+        hashBytes(h, (const ubyte*)img + y * img.widthStep(), 3 * img.width());
+    return h;
+}
+
+//Images and cameras, rounded so text round trips of the cameras agree
+static unsigned long long hashViews(const vector<View>& views)
+{
+    unsigned long long h = HASH_START;
+    for(size_t k=0; k<views.size(); k++)
+    {
+        hashValue(h, hashImage(views[k].image()));
+        Matrix4d M = views[k].camera().matrix();
+        for(int i=0; i<4; i++)
+        for(int j=0; j<4; j++)
+            hashValue(h, (long long)floor(M(i,j) * 1e6 + 0.5));
+    }
+    return h;
+}
+
+static unsigned long long hashVolume(const Volume& volume)
+{
+    unsigned long long h = HASH_START;
+    Vector3i dim = volume.size();
+    for(int z=0; z<dim.z(); z++)
+    for(int y=0; y<dim.y(); y++)
+    for(int x=0; x<dim.x(); x++)
+    {
+        Color c = volume(Vector3i(x, y, z));
+        hashValue(h, c.r);
+        hashValue(h, c.g);
+        hashValue(h, c.b);
+    }
+    return h;
+}
+
+//Collects the results as JSON
+class BenchmarkLog
+{
+public:
+    BenchmarkLog(ostream& out) : json(out), count(0) {}
+
+    //Times of the repeated runs of the current benchmark
+    vector<double> times;
+
+    //Writes the current benchmark, settings is a list of JSON members
+    void result(
+        const string& name,
+        const string& settings,
+        size_t items,
+        unsigned long long check)
+    {
+        sort(times.begin(), times.end());
+        double median = times.empty() ? 0 :
+            (times[(times.size() - 1) / 2] + times[times.size() / 2]) / 2;
+
+        json << (count++ ? ",\n" : "") << "    { \"name\": \"" << name << "\"";
+        if(!settings.empty())
+            json << ", " << settings;
+        json << ", \"items\": " << items
+             << ", \"min\": " << (times.empty() ? 0 : times[0])
+             << ", \"median\": " << median
+             << ", \"check\": \"" << hex << check << dec << "\" }";
+        json.flush();
+
+        cout << "Benchmark " << name << " " << settings << ": " << median << "s" << endl;
+        times.clear();
+    }
+
+private:
+    ostream& json;
+    int      count;
+};
+
+//Starts and stops the clock for one run
+struct BenchmarkRun
+{
+    BenchmarkRun(BenchmarkLog& log_) : log(log_), start(wallTime()) {}
+    ~BenchmarkRun() { log.times.push_back(wallTime() - start); }
+
+    BenchmarkLog&   log;
+    double          start;
+};
+
+static string setting(const char* key, int value)
+{
+    stringstream ss;
+    ss << "\"" << key << "\": " << value;
+    return ss.str();
+}
+
+//Footprints of the voxels of a volume in every view they project into
+static void collectFootprints(
+    const vector<CarveView>& views,
+    const Vector3i& dim,
+    vector<Footprint>& footprints,
+    vector<size_t>& first)
+{
+    first.assign(1, 0);
+    for(int z=0; z<dim.z(); z++)
+    for(int y=0; y<dim.y(); y++)
+    for(int x=0; x<dim.x(); x++)
+    {
+        for(size_t k=0; k<views.size(); k++)
+        {
+            Footprint fp;
+            if(!views[k].footprint(Vector3i(x, y, z), fp))
+                continue;
+            fp.view = k;
+            footprints.push_back(fp);
+        }
+        first.push_back(footprints.size());
+    }
+}
+
+//Runs the benchmarks in order, false if one fails and the rest are skipped
+static bool runStages(BenchmarkLog& log, const BenchmarkParams& params, int cores)
+{
+    const SyntheticParams& scene = params.scene;
+
+    //Scene generation
+    vector<View> views;
+    for(int r=0; r<params.repeats; r++)
+    {
+        BenchmarkRun run(log);
+        views = renderSyntheticScene(scene);
+    }
+    log.result("render", setting("threads", cores), views.size(), hashViews(views));
+
+    string directory = getTempDirectory() + "/autoscanner_benchmark";
+    if(!saveSyntheticBundler(directory, scene, views))
+        return false;
+
+    //Image loading
+    {
+        unsigned long long check = 0;
+        for(int r=0; r<params.repeats; r++)
+        {
+            BenchmarkRun run(log);
+            check = HASH_START;
+            for(int k=0; k<scene.views; k++)
+            {
+                char name[64];
+                snprintf(name, sizeof(name), "/frame%04d.png", k);
+                hashValue(check, hashImage(Image(directory + name)));
+            }
+        }
+        log.result("image_load", "", scene.views, check);
+    }
+
+    //Bundle parsing, with the images it loads
+    {
+        vector<View> parsed;
+        for(int r=0; r<params.repeats; r++)
+        {
+            BenchmarkRun run(log);
+            parsed = parseBundlerTemps(directory);
+        }
+        if(parsed.size() != views.size())
+        {
+            cout << "Benchmark scene did not parse back" << endl;
+            return false;
+        }
+        log.result("bundle_parse", "", parsed.size(), hashViews(parsed));
+    }
+
+    Vector3d low, high;
+    syntheticBounds(scene, low, high);
+
+    //Projection of voxel footprints
+    {
+        Vector3i dim = Vector3i::Constant(PROJECTION_RESOLUTION);
+        Volume volume(dim, low, high);
+        vector<CarveView> carve_views;
+        for(size_t k=0; k<views.size(); k++)
+            carve_views.push_back(CarveView(views[k], volume));
+
+        unsigned long long check = 0;
+        for(int r=0; r<params.repeats; r++)
+        {
+            BenchmarkRun run(log);
+            check = HASH_START;
+            for(int z=0; z<dim.z(); z++)
+            for(int y=0; y<dim.y(); y++)
+            for(int x=0; x<dim.x(); x++)
+            for(size_t k=0; k<carve_views.size(); k++)
+            {
+                Footprint fp;
+                if(carve_views[k].footprint(Vector3i(x, y, z), fp))
+                    hashValue(check, fp.x0 + 7 * fp.y0 + 31 * fp.x1 + 127 * fp.y1);
+            }
+        }
+        log.result("projection", setting("resolution", dim.x()),
+            (size_t)dim.x() * dim.y() * dim.z() * carve_views.size(), check);
+    }
+
+    //Consistency kernels on the footprints of every voxel, occlusion ignored
+    {
+        Vector3i dim = Vector3i::Constant(CONSISTENCY_RESOLUTION);
+        Volume volume(dim, low, high);
+        vector<CarveView> carve_views;
+        for(size_t k=0; k<views.size(); k++)
+            carve_views.push_back(CarveView(views[k], volume));
+
+        vector<Footprint> footprints;
+        vector<size_t> first;
+        collectFootprints(carve_views, dim, footprints, first);
+        size_t voxels = first.size() - 1;
+
+        PhotoHullParams photohull;
+        const int CAPACITY = 256;
+        ConsistencyBatch batch(CAPACITY, views.size());
+        size_t consistent = 0;
+        for(int r=0; r<params.repeats; r++)
+        {
+            BenchmarkRun run(log);
+            consistent = 0;
+            for(size_t v=0; v<voxels; v+=CAPACITY)
+            {
+                batch.clear();
+                size_t end = min(voxels, v + CAPACITY);
+                for(size_t i=v; i<end; i++)
+                {
+                    int slot = batch.add();
+                    for(size_t f=first[i]; f<first[i+1]; f++)
+                        batch.sample(slot, carve_views[footprints[f].view].pixel(footprints[f].cx, footprints[f].cy));
+                }
+                batch.evaluate(photohull.threshold);
+                for(int i=0; i<batch.size; i++)
+                    consistent += batch.consistent[i] != 0;
+            }
+        }
+        log.result("consistency_batch", setting("resolution", dim.x()), voxels, consistent);
+
+        ApproximateConsistency approx;
+        for(int r=0; r<params.repeats; r++)
+        {
+            BenchmarkRun run(log);
+            consistent = 0;
+            for(size_t i=0; i<voxels; i++)
+            {
+                approx.clear();
+                for(size_t f=first[i]; f<first[i+1]; f++)
+                    approx.add(carve_views[footprints[f].view], footprints[f], APPROX_PAD);
+                Color color;
+                consistent += approx.evaluate(photohull.approx_threshold, color);
+            }
+        }
+        log.result("consistency_approx",
+            setting("resolution", dim.x()) + ", " + setting("pad", APPROX_PAD), voxels, consistent);
+    }
+
+    //Carving
+    Volume carved;
+    for(size_t i=0; i<params.resolutions.size(); i++)
+    {
+        vector<int> counts;
+        for(size_t j=0; j<params.threads.size(); j++)
+        {
+            int n = params.threads[j] > 0 ? params.threads[j] : cores;
+            if(find(counts.begin(), counts.end(), n) == counts.end())
+                counts.push_back(n);
+        }
+
+        for(size_t j=0; j<counts.size(); j++)
+        {
+            Vector3i dim = Vector3i::Constant(params.resolutions[i]);
+            PhotoHullParams photohull;
+            photohull.threads       = counts[j];
+            photohull.deterministic = true;
+
+            for(int r=0; r<params.repeats; r++)
+            {
+                BenchmarkRun run(log);
+                carved = stereoPhotoHull(views, dim, low, high, photohull);
+            }
+            log.result("carve",
+                setting("resolution", dim.x()) + ", " + setting("threads", counts[j]),
+                (size_t)dim.x() * dim.y() * dim.z(), hashVolume(carved));
+        }
+    }
+
+    //Export of the last carved volume
+    if(carved.size().x() > 0)
+    {
+        string filename = directory + "/volume.ply";
+        for(int r=0; r<params.repeats; r++)
+        {
+            BenchmarkRun run(log);
+            if(!saveVolumePLY(filename, carved))
+                return false;
+        }
+
+        struct stat s;
+        size_t bytes = stat(filename.c_str(), &s) == 0 ? s.st_size : 0;
+        log.result("ply_export", setting("resolution", carved.size().x()), bytes, bytes);
+    }
+
+    return true;
+}
+
+bool runBenchmarks(ostream& json, const BenchmarkParams& params)
+{
+    const SyntheticParams& scene = params.scene;
+    BenchmarkLog log(json);
+
+    //All cores for the run, the caller's count is restored on return
+    ThreadCountScope restore(0);
+    setThreadCount(0);
+    int cores = threadCount();
+
+    json.precision(6);
+    json << "{\n"
+         << "  \"cores\": " << cores << ",\n"
+         << "  \"repeats\": " << params.repeats << ",\n"
+         << "  \"scene\": { \"shape\": \"" << (scene.shape == SYNTHETIC_CUBE ? "cube" : "sphere")
+         << "\", \"views\": " << scene.views
+         << ", \"width\": " << scene.width
+         << ", \"height\": " << scene.height
+         << ", \"seed\": " << scene.seed << " },\n"
+         << "  \"results\": [\n";
+
+    //The results are closed on failure too, so the file stays valid JSON
+    bool ok = runStages(log, params, cores);
+    json << "\n  ],\n  \"ok\": " << (ok ? "true" : "false") << "\n}" << endl;
+    return ok && !json.fail();
+}
@@ -0,0 +1,46 @@
+//Benchmarks of the main pipeline stages on a synthetic scene
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <ostream>
+#include <vector>
+
+#include "synthetic.h"
+
+//Benchmark parameters
+struct BenchmarkParams
+{
+    BenchmarkParams() :
+        repeats(3)
+    {
+        resolutions.push_back(32);
+        resolutions.push_back(64);
+        resolutions.push_back(128);
+        threads.push_back(1);
+        threads.push_back(0);
+    }
+
+    //Scene everything runs on
+    SyntheticParams scene;
+
+    //Runs of each benchmark, the minimum and median times are reported
+    int repeats;
+
+    //Carving volume resolutions
+    std::vector<int> resolutions;
+
+    //Carving thread counts, 0 uses all cores
+    std::vector<int> threads;
+};
+
+//Runs the benchmarks and writes their timings as JSON, one object per
+//benchmark in a "results" array.  Each result has a name, its settings,
+//the number of items processed, min and median seconds, and a check value
+//which only depends on the output, so runs can be compared.  Scratch files
+//go to the temp directory.  Returns false if a stage failed, the later
+//stages are skipped then and "ok" is false in the output.
+extern bool runBenchmarks(
+    std::ostream& json,
+    const BenchmarkParams& params = BenchmarkParams());
+
+#endif
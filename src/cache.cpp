@@ -0,0 +1,198 @@
+//STL
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+//Project files
+#include "cache.h"
+
+using namespace std;
+
+//Bytes read at a time when hashing files
+static const size_t HASH_BUFFER_SIZE = 1 << 20;
+
+//Multipliers of the two hash lanes (as in MurmurHash3)
+static const unsigned long long
+    LANE_K1 = 0x87c37b91114253d5ULL,
+    LANE_K2 = 0x4cf5ad432745937fULL;
+
+static inline unsigned long long rotl(unsigned long long x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline unsigned long long fmix(unsigned long long k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+StageKey::StageKey(const string& stage_) : stage(stage_), tail(0), length(0)
+{
+    h[0] = 0x6a09e667f3bcc908ULL;
+    h[1] = 0xbb67ae8584caa73bULL;
+    add(stage);
+}
+
+void StageKey::word(unsigned long long w)
+{
+    h[0] = rotl(h[0] ^ (rotl(w * LANE_K1, 31) * LANE_K2), 27) * 5 + 0x52dce729;
+    h[1] = rotl(h[1] ^ (rotl(w * LANE_K2, 33) * LANE_K1), 31) * 5 + 0x38495ab5;
+}
+
+StageKey& StageKey::add(const void* data, size_t bytes)
+{
+    //Bytes go into words in stream order, so a key does not depend on how
+    //its input was split between calls
+    const unsigned char* p = (const unsigned char*)data;
+    size_t i = 0;
+    for(bool aligned = (length & 7) == 0; i<bytes; i++)
+    {
+        //Whole words at once once the stream is word aligned (bytes are
+        //little endian in a word either way on x86)
+        if(aligned)
+        {
+            for(; i+8<=bytes; i+=8, length+=8)
+            {
+                unsigned long long w;
+                memcpy(&w, p + i, 8);
+                word(w);
+            }
+            if(i == bytes)
+                break;
+        }
+
+        int shift = 8 * (length & 7);
+        if(shift == 0)
+            tail = 0;
+        tail |= (unsigned long long)p[i] << shift;
+        if(shift == 56)
+            word(tail);
+        length++;
+        aligned = (length & 7) == 0;
+    }
+    return *this;
+}
+
+StageKey& StageKey::add(const string& s)
+{
+    unsigned long long n = s.size();
+    add(&n, sizeof(n));
+    return add(s.data(), s.size());
+}
+
+StageKey& StageKey::add(const vector<double>& v)
+{
+    unsigned long long n = v.size();
+    add(&n, sizeof(n));
+    return v.empty() ? *this : add(&v[0], v.size() * sizeof(double));
+}
+
+StageKey& StageKey::add(const StageKey& upstream)
+{
+    add(upstream.stage);
+    return add(upstream.hex());
+}
+
+bool StageKey::addFile(const string& filename)
+{
+    ifstream fin(filename.c_str(), ios::binary);
+    if(!fin)
+    {
+        cout << "Could not read " << filename << endl;
+        return false;
+    }
+
+    vector<char> buffer(HASH_BUFFER_SIZE);
+    unsigned long long bytes = 0;
+    while(fin)
+    {
+        fin.read(&buffer[0], buffer.size());
+        add(&buffer[0], fin.gcount());
+        bytes += fin.gcount();
+    }
+
+    //The size ends the contents, so consecutive files can not run together
+    add(&bytes, sizeof(bytes));
+    return fin.eof();
+}
+
+string StageKey::hex() const
+{
+    unsigned long long a = h[0], b = h[1];
+    if(length & 7)
+    {
+        a ^= rotl(tail * LANE_K1, 31) * LANE_K2;
+        b ^= rotl(tail * LANE_K2, 33) * LANE_K1;
+    }
+    a ^= length;
+    b ^= length;
+    a += b;
+    b += a;
+    a = fmix(a);
+    b = fmix(b);
+    a += b;
+    b += a;
+
+    char buf[33];
+    snprintf(buf, sizeof(buf), "%016llx%016llx", a, b);
+    return buf;
+}
+
+StageCache::StageCache(const string& directory_) : directory(directory_) {}
+
+string StageCache::path(const StageKey& key, const string& ext) const
+{
+    return directory + "/" + key.stage + "/" + key.hex() + ext;
+}
+
+bool StageCache::has(const StageKey& key, const string& ext) const
+{
+    struct stat s;
+    return stat(path(key, ext).c_str(), &s) == 0;
+}
+
+string StageCache::temp(const StageKey& key, const string& ext) const
+{
+    mkdir(directory.c_str(), 0755);
+    mkdir((directory + "/" + key.stage).c_str(), 0755);
+
+    stringstream ss;
+    ss << path(key, ext) << ".tmp" << getpid();
+    return ss.str();
+}
+
+bool StageCache::commit(const StageKey& key, const string& ext, const string& temp) const
+{
+    if(rename(temp.c_str(), path(key, ext).c_str()) != 0)
+    {
+        cout << "Could not store " << path(key, ext) << endl;
+        remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool copyFile(const string& from, const string& to)
+{
+    ifstream fin(from.c_str(), ios::binary);
+    ofstream fout(to.c_str(), ios::binary);
+    if(!fin || !fout || !(fout << fin.rdbuf()))
+    {
+        cout << "Could not copy " << from << " to " << to << endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,63 @@
+//Content addressed cache of pipeline stage outputs
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <string>
+#include <vector>
+
+//128 bit hash of everything a stage output depends on: its parameters,
+//the contents of its input files and the keys of the stages before it
+struct StageKey
+{
+    //Keys of different stages never match, even on the same inputs
+    explicit StageKey(const std::string& stage);
+
+    StageKey& add(const void* data, size_t bytes);
+    StageKey& add(const std::string& s);
+    StageKey& add(double v)                 { return add(&v, sizeof(v)); }
+    StageKey& add(const std::vector<double>& v);
+    StageKey& add(const StageKey& upstream);
+
+    //Adds the contents of a file, false if it can not be read
+    bool addFile(const std::string& filename);
+
+    //Key as 32 hex digits
+    std::string hex() const;
+
+    std::string stage;
+
+private:
+    void word(unsigned long long w);
+
+    unsigned long long  h[2];
+    unsigned long long  tail;       //Bytes of the last partial word
+    unsigned long long  length;
+};
+
+//Stage outputs are stored as directory/stage/key.ext.  Outputs are written
+//to a temporary file and renamed into place when complete, so a crashed or
+//concurrent run never leaves a partial entry.  Nothing is ever evicted,
+//remove the directory to clear the cache.
+struct StageCache
+{
+    StageCache(const std::string& directory_);
+
+    //Where the output of a stage is stored
+    std::string path(const StageKey& key, const std::string& ext) const;
+
+    //True if the output is stored
+    bool has(const StageKey& key, const std::string& ext) const;
+
+    //Temporary file to write an output to, then pass to commit()
+    std::string temp(const StageKey& key, const std::string& ext) const;
+
+    //Moves a finished temporary file into the cache
+    bool commit(const StageKey& key, const std::string& ext, const std::string& temp) const;
+
+    std::string directory;
+};
+
+//Copies a file, false (and says why) if it fails
+extern bool copyFile(const std::string& from, const std::string& to);
+
+#endif
@@ -0,0 +1,215 @@
+//Shared state for the volumetric carving engines
+#ifndef CARVE_H
+#define CARVE_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/LU>
+
+#include "image.h"
+#include "stereo.h"
+#include "system.h"
+#include "view.h"
+#include "volume.h"
+
+//Sweep plane directions (normal, and the two in-plane axes)
+const int N_DIM[6] = { 2, 2, 0, 0, 1, 1, },
+          U_DIM[6] = { 1, 1, 1, 1, 0, 0, },
+          V_DIM[6] = { 0, 0, 2, 2, 2, 2, },
+          N_SGN[6] = { 1,-1, 1,-1, 1,-1, };
+
+//Image space bounding box of a voxel in some view
+struct Footprint
+{
+    int view;
+    int cx, cy;
+    int x0, y0, x1, y1;
+};
+
+//Bitset over the pixels of a view, rows padded to whole words.
+//  Marking is safe from many threads at once: words a footprint only covers
+//  in part are updated with an atomic fetch-or, words it covers entirely are
+//  simply stored to, since all ones cannot lose bits to a concurrent or.
+struct PixelMask
+{
+    typedef unsigned long long Word;
+    enum { WORD_BITS = 64, WORD_SHIFT = 6 };
+
+    PixelMask() : width(0), height(0), stride(0) {}
+    PixelMask(int w, int h) :
+        width(w), height(h), stride((w + WORD_BITS - 1) >> WORD_SHIFT),
+        words((size_t)stride * h, 0) {}
+
+    bool operator()(int x, int y) const
+    {
+        return (words[(size_t)y * stride + (x >> WORD_SHIFT)] >> (x & (WORD_BITS - 1))) & 1;
+    }
+
+    //Sets every pixel of the footprint
+    void mark(const Footprint& fp)
+    {
+        int  w0 = fp.x0 >> WORD_SHIFT, w1 = fp.x1 >> WORD_SHIFT;
+        Word m0 = ~(Word)0 << (fp.x0 & (WORD_BITS - 1)),
+             m1 = ~(Word)0 >> (WORD_BITS - 1 - (fp.x1 & (WORD_BITS - 1)));
+        if(w0 == w1)
+            m0 = m1 = m0 & m1;
+
+        for(int y=fp.y0; y<=fp.y1; y++)
+        {
+            Word* row = &words[(size_t)y * stride];
+            set(row[w0], m0);
+            for(int k=w0+1; k<w1; k++)
+                row[k] = ~(Word)0;
+            set(row[w1], m1);
+        }
+    }
+
+    //Clears all pixels, one store per word
+    void clear() { std::fill(words.begin(), words.end(), 0); }
+
+    int                 width, height, stride;
+    std::vector<Word>   words;
+
+private:
+    static void set(Word& w, Word m)
+    {
+        if((w & m) != m)
+            __sync_fetch_and_or(&w, m);
+    }
+};
+
+//A view prepared for carving, projects voxel coordinates directly to pixels
+struct CarveView
+{
+    CarveView(const View& view, const Volume& volume) :
+        image(view.image()),
+        width(image.width()),
+        height(image.height()),
+        step(image.widthStep()),
+        pixels((const ubyte*)((const Image&)image)),
+        consist(width, height)
+    {
+        //Voxel -> world -> image
+        Eigen::Matrix4d X = volume.xform().matrix();
+        Eigen::Matrix4d M = view.camera().matrix() * X.inverse();
+
+        //Projective matrices are only defined up to scale, pick the sign which
+        //puts the volume at positive depth
+        Eigen::Vector3i dim = volume.size();
+        double w = 0.5 * (M(3,0) * dim.x() + M(3,1) * dim.y() + M(3,2) * dim.z()) + M(3,3);
+        double s = w < 0 ? -1.0 : 1.0;
+
+        for(int j=0; j<4; j++)
+        {
+            P[0][j] = s * M(0,j);
+            P[1][j] = s * M(1,j);
+            P[2][j] = s * M(3,j);
+        }
+
+        center = X.block(0,0,3,3) * view.center() + X.block(0,3,3,1);
+    }
+
+    //Projects a point in voxel coordinates, returns false if it is behind the
+    //camera.  w is the projective depth.
+    bool project(double x, double y, double z, double& u, double& v, double& w) const
+    {
+        w = P[2][0] * x + P[2][1] * y + P[2][2] * z + P[2][3];
+        if(w <= 0)
+            return false;
+        u = (P[0][0] * x + P[0][1] * y + P[0][2] * z + P[0][3]) / w;
+        v = (P[1][0] * x + P[1][1] * y + P[1][2] * z + P[1][3]) / w;
+        return true;
+    }
+    bool project(double x, double y, double z, double& u, double& v) const
+    {
+        double w;
+        return project(x, y, z, u, v, w);
+    }
+
+    //Computes the footprint of voxel p, returns false if its center is out of frame
+    bool footprint(const Eigen::Vector3i& p, Footprint& fp) const
+    {
+        double u, v;
+        if(!project(p.x() + 0.5, p.y() + 0.5, p.z() + 0.5, u, v) ||
+            u < 0 || v < 0 || u >= width || v >= height)
+            return false;
+        fp.cx = (int)u;
+        fp.cy = (int)v;
+
+        double umin = u, umax = u, vmin = v, vmax = v;
+        for(int i=0; i<8; i++)
+        {
+            if(!project(p.x() + (i & 1), p.y() + ((i >> 1) & 1), p.z() + (i >> 2), u, v))
+                return false;
+            umin = std::min(umin, u); umax = std::max(umax, u);
+            vmin = std::min(vmin, v); vmax = std::max(vmax, v);
+        }
+
+        fp.x0 = std::max(0, (int)floor(umin));
+        fp.y0 = std::max(0, (int)floor(vmin));
+        fp.x1 = std::min(width  - 1, (int)floor(umax));
+        fp.y1 = std::min(height - 1, (int)floor(vmax));
+        return true;
+    }
+
+    //True if the camera lies in the 45 degree pyramid behind voxel p for sweep
+    //direction d.  Rays from such cameras cross the sweep plane steeply, so
+    //everything occluding p lies on planes already swept.  The six pyramids
+    //cover all of space, so every camera takes part in some sweep.
+    bool sweeps(const Eigen::Vector3i& p, int d) const
+    {
+        double dn = N_SGN[d] * (p[N_DIM[d]] + 0.5 - center[N_DIM[d]]);
+        return 
+            dn > fabs(p[U_DIM[d]] + 0.5 - center[U_DIM[d]]) &&
+            dn > fabs(p[V_DIM[d]] + 0.5 - center[V_DIM[d]]);
+    }
+
+    //Pixel access
+    const Color& pixel(int x, int y) const
+    {
+        return *reinterpret_cast<const Color*>(pixels + y * step + 3 * x);
+    }
+
+    //Consistency mask access, mark() may be called concurrently
+    bool consistent(int x, int y) const { return consist(x, y); }
+    void mark(const Footprint& fp) { consist.mark(fp); }
+    void resetConsist() { consist.clear(); }
+
+    //Image data
+    Image               image;
+    int                 width, height, step;
+    const ubyte*        pixels;
+
+    //Voxel -> image projection (rows x, y, w)
+    double              P[3][4];
+
+    //Camera center in voxel coordinates
+    Eigen::Vector3d     center;
+
+    //Pixels already claimed by a consistent voxel during the current sweep
+    PixelMask           consist;
+};
+
+//State shared by the passes of one carving run
+struct CarveState
+{
+    Volume*                     volume;
+    DetachOnWrite*              writer;     //Writes to volume during a pass
+    std::vector<CarveView>      views;
+    const std::vector<ubyte>*   band;
+    const PhotoHullParams*      params;
+    CarveProgress               progress;
+};
+
+//Chessboard distance transform of a dense voxel grid (photohull.cpp)
+extern void chamferDistance(std::vector<ubyte>& dist, const Eigen::Vector3i& dim);
+
+//Generalized voxel coloring pass using per-view item buffers (itembuffer.cpp)
+//  Returns the number of voxels removed.
+extern size_t itemBufferPass(CarveState& state);
+
+#endif
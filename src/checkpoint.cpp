@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <boost/bind.hpp>
+
+#include "cache.h"
+#include "checkpoint.h"
+
+using namespace std;
+using namespace Eigen;
+
+//Checkpoint file format (native byte order, snapshots are not meant to move
+//between machines):
+//
+//  char[4]     magic "ACKP"
+//  uint32      version
+//  uint32      key length, then the key as doubles
+//  int32[4]    level, pass, finished, full
+//  uint64[2]   tested, removed
+//  uint32      number of queued voxels, then their ids
+//  runs        band
+//  volume      as written by Volume::save
+//
+//Runs are a uint64 total length followed by (uint32 length, byte value)
+//pairs, bands are mostly long runs of 0 or 1.
+
+static const char       CHECKPOINT_MAGIC[4] = { 'A', 'C', 'K', 'P' };
+static const unsigned   CHECKPOINT_VERSION  = 3;
+
+//stdio buffer size for checkpoint files
+static const size_t     CHECKPOINT_BUFFER_SIZE = 1 << 20;
+
+vector<double> checkpointKey(
+    const PhotoHullParams& params,
+    size_t views,
+    const Vector3i& dim,
+    const Vector3d& low,
+    const Vector3d& high)
+{
+    vector<double> key;
+    key.push_back(CHECKPOINT_VERSION);
+    key.push_back(views);
+    for(int i=0; i<3; i++)
+    {
+        key.push_back(dim[i]);
+        key.push_back(low[i]);
+        key.push_back(high[i]);
+        key.push_back(params.threshold[i]);
+        key.push_back(params.approx_threshold[i]);
+    }
+    key.push_back(params.levels);
+    key.push_back(params.margin);
+    key.push_back(params.mode);
+    key.push_back(params.worklist);
+    key.push_back(params.visual_hull);
+    key.push_back(params.hull.background);
+    key.push_back(params.hull.tolerance);
+    key.push_back(params.approx_pad);
+    key.push_back(params.deterministic);
+    return key;
+}
+
+vector<double> checkpointKey(
+    const PhotoHullParams& params,
+    const vector<View>& views,
+    const Vector3i& dim,
+    const Vector3d& low,
+    const Vector3d& high)
+{
+    StageKey digest("views");
+    for(size_t i=0; i<views.size(); i++)
+    {
+        Matrix4d M = views[i].camera().matrix();
+        digest.add(M.data(), sizeof(double) * 16);
+
+        const Image& image = views[i].image();
+        int size[2] = { image.width(), image.height() };
+        digest.add(size, sizeof(size));
+        for(int y=0; y<size[1]; y++)
+            digest.add((const ubyte*)image + (size_t)y * image.widthStep(), 3 * size[0]);
+    }
+
+    //The digest as 32 bit pieces, which doubles hold exactly
+    vector<double> key = checkpointKey(params, views.size(), dim, low, high);
+    string hex = digest.hex();
+    for(size_t i=0; i<hex.size(); i+=8)
+        key.push_back((double)strtoul(hex.substr(i, 8).c_str(), NULL, 16));
+    return key;
+}
+
+static bool writeRuns(FILE* f, const vector<ubyte>& data)
+{
+    unsigned long long n = data.size();
+    bool ok = fwrite(&n, sizeof(n), 1, f) == 1;
+    for(size_t i=0; i<data.size() && ok; )
+    {
+        size_t j = i + 1;
+        while(j < data.size() && data[j] == data[i] && j - i < 0xffffffffu)
+            j++;
+        unsigned run = (unsigned)(j - i);
+        ok = fwrite(&run, sizeof(run), 1, f) == 1 && fwrite(&data[i], 1, 1, f) == 1;
+        i = j;
+    }
+    return ok;
+}
+
+static bool readRuns(FILE* f, vector<ubyte>& data)
+{
+    unsigned long long n;
+    if(fread(&n, sizeof(n), 1, f) != 1)
+        return false;
+    data.resize(n);
+    for(size_t i=0; i<data.size(); )
+    {
+        unsigned run;
+        ubyte    value;
+        if(fread(&run, sizeof(run), 1, f) != 1 || fread(&value, 1, 1, f) != 1 ||
+            run == 0 || run > data.size() - i)
+            return false;
+        std::fill(data.begin() + i, data.begin() + i + run, value);
+        i += run;
+    }
+    return true;
+}
+
+Checkpointer::Checkpointer(const string& filename_) : filename(filename_) {}
+
+Checkpointer::~Checkpointer()
+{
+    wait();
+}
+
+void CarveSnapshot::swap(CarveSnapshot& other)
+{
+    key.swap(other.key);
+    std::swap(level, other.level);
+    std::swap(pass, other.pass);
+    std::swap(finished, other.finished);
+    std::swap(full, other.full);
+    queued.swap(other.queued);
+    std::swap(tested, other.tested);
+    std::swap(removed, other.removed);
+    Volume v = volume;
+    volume = other.volume;
+    other.volume = v;
+    band.swap(other.band);
+}
+
+bool Checkpointer::save(CarveSnapshot& snapshot, bool block)
+{
+    if(thread.busy() && !block)
+        return false;
+    wait();
+    pending.swap(snapshot);
+    snapshot = CarveSnapshot();
+    return thread.start(boost::bind(&Checkpointer::write, this));
+}
+
+//Writes the pending snapshot (on the background thread)
+void Checkpointer::write()
+{
+    string temp = filename + ".tmp";
+    FILE* f = fopen(temp.c_str(), "wb");
+    if(!f)
+    {
+        cout << "Could not write checkpoint " << temp << endl;
+        return;
+    }
+    setvbuf(f, NULL, _IOFBF, CHECKPOINT_BUFFER_SIZE);
+
+    const CarveSnapshot& s = pending;
+    unsigned version = CHECKPOINT_VERSION, nkey = s.key.size(), nqueued = s.queued.size();
+    int flags[4] = { s.level, s.pass, s.finished, s.full };
+    unsigned long long counts[2] = { s.tested, s.removed };
+
+    bool ok =
+        fwrite(CHECKPOINT_MAGIC, 4, 1, f) == 1 &&
+        fwrite(&version, sizeof(version), 1, f) == 1 &&
+        fwrite(&nkey, sizeof(nkey), 1, f) == 1 &&
+        (nkey == 0 || fwrite(&s.key[0], sizeof(double), nkey, f) == nkey) &&
+        fwrite(flags, sizeof(flags), 1, f) == 1 &&
+        fwrite(counts, sizeof(counts), 1, f) == 1 &&
+        fwrite(&nqueued, sizeof(nqueued), 1, f) == 1 &&
+        (nqueued == 0 || fwrite(&s.queued[0], sizeof(unsigned), nqueued, f) == nqueued) &&
+        writeRuns(f, s.band ? *s.band : vector<ubyte>()) &&
+        s.volume.save(f);
+    ok = fflush(f) == 0 && fsync(fileno(f)) == 0 && ok;
+    ok = fclose(f) == 0 && ok;
+
+    //The old snapshot is only replaced by a complete one
+    if(!ok || rename(temp.c_str(), filename.c_str()) != 0)
+    {
+        cout << "Error writing checkpoint " << filename << endl;
+        remove(temp.c_str());
+    }
+
+    //Drop the copy, so the carve does not keep old bricks alive
+    pending = CarveSnapshot();
+}
+
+bool Checkpointer::load(CarveSnapshot& s) const
+{
+    FILE* f = fopen(filename.c_str(), "rb");
+    if(!f)
+        return false;
+    setvbuf(f, NULL, _IOFBF, CHECKPOINT_BUFFER_SIZE);
+
+    char     magic[4];
+    unsigned version, nkey = 0, nqueued = 0;
+    int      flags[4];
+    unsigned long long counts[2];
+
+    bool ok =
+        fread(magic, 4, 1, f) == 1 && memcmp(magic, CHECKPOINT_MAGIC, 4) == 0 &&
+        fread(&version, sizeof(version), 1, f) == 1 && version == CHECKPOINT_VERSION &&
+        fread(&nkey, sizeof(nkey), 1, f) == 1 && nkey < 1024;
+    if(ok)
+    {
+        s.key.resize(nkey);
+        ok = (nkey == 0 || fread(&s.key[0], sizeof(double), nkey, f) == nkey) &&
+            fread(flags, sizeof(flags), 1, f) == 1 &&
+            fread(counts, sizeof(counts), 1, f) == 1 &&
+            fread(&nqueued, sizeof(nqueued), 1, f) == 1;
+    }
+    if(ok)
+    {
+        s.queued.resize(nqueued);
+        vector<ubyte>* band = new vector<ubyte>;
+        s.band.reset(band);
+        ok = (nqueued == 0 || fread(&s.queued[0], sizeof(unsigned), nqueued, f) == nqueued) &&
+            readRuns(f, *band) &&
+            s.volume.load(f);
+    }
+    fclose(f);
+
+    if(!ok)
+    {
+        cout << "Bad checkpoint " << filename << ", starting over" << endl;
+        return false;
+    }
+
+    s.level    = flags[0];
+    s.pass     = flags[1];
+    s.finished = flags[2] != 0;
+    s.full     = flags[3] != 0;
+    s.tested   = counts[0];
+    s.removed  = counts[1];
+    return true;
+}
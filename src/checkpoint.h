@@ -0,0 +1,103 @@
+//Checkpoints of long carving runs
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <Eigen/Core>
+
+#include "stereo.h"
+#include "system.h"
+#include "view.h"
+#include "volume.h"
+
+//State of a photo hull carve between two passes
+struct CarveSnapshot
+{
+    CarveSnapshot() : level(0), pass(0), finished(false), full(true), tested(0), removed(0) {}
+
+    //Exchanges contents with other, without copying
+    void swap(CarveSnapshot& other);
+
+    //Parameters the carve was started with, see checkpointKey()
+    std::vector<double> key;
+
+    //Resolution level and last completed pass, finished once the level has
+    //converged (or run out of passes)
+    int level, pass;
+    bool finished;
+
+    //Worklist state: whether the next pass tests every voxel, otherwise the
+    //voxels queued for it
+    bool full;
+    std::vector<unsigned> queued;
+
+    //Progress counters
+    size_t tested, removed;
+
+    //Volume and refinement band (none at the coarsest level).  The band
+    //only changes between levels, so it is shared with the carve.  The
+    //consistency masks of the views are not kept, every sweep starts by
+    //clearing them.
+    Volume volume;
+    boost::shared_ptr<const std::vector<ubyte> > band;
+};
+
+//Summary of the parameters which change the result of a carve of a number
+//of views.  Callers which hash the views themselves (see runPipeline) use
+//this one.
+extern std::vector<double> checkpointKey(
+    const PhotoHullParams& params,
+    size_t views,
+    const Eigen::Vector3i& dim,
+    const Eigen::Vector3d& low,
+    const Eigen::Vector3d& high);
+
+//Summary of everything which changes the result of a carve, the parameters
+//and a digest of the camera matrices and image contents.  A snapshot is
+//only resumed by a carve with the same key.
+extern std::vector<double> checkpointKey(
+    const PhotoHullParams& params,
+    const std::vector<View>& views,
+    const Eigen::Vector3i& dim,
+    const Eigen::Vector3d& low,
+    const Eigen::Vector3d& high);
+
+//Writes snapshots to a file from a background thread.
+//  Each snapshot goes to a temporary file which is synced and renamed over
+//  the previous one, so a crash at any point leaves a complete snapshot.
+//  The snapshot is handed over when saved, not copied.  Its volume shares
+//  bricks with the carve's copy-on-write (see DetachOnWrite), so the carve
+//  can go on at once and only copies the bricks it writes next.
+struct Checkpointer
+{
+    Checkpointer(const std::string& filename);
+
+    //Waits for the last snapshot to be written
+    ~Checkpointer();
+
+    //Starts writing a snapshot, taking its contents (snapshot is left
+    //empty).  Returns false if the previous one is still being written and
+    //block is not set: the new one is skipped, so the carve never waits on
+    //disk.  With block set it waits, use it for the final snapshot.
+    bool save(CarveSnapshot& snapshot, bool block = false);
+
+    //Reads the latest snapshot, false if there is none or it is bad
+    bool load(CarveSnapshot& snapshot) const;
+
+    //Waits until the pending snapshot is on disk
+    void wait() { thread.wait(); }
+
+    std::string filename;
+
+private:
+    void write();
+
+    CarveSnapshot       pending;
+    BackgroundThread    thread;
+};
+
+#endif
@@ -0,0 +1,162 @@
+//Configuration file reading and writing
+
+#include "config.h"
+
+#define WRITE for (int i__0 = 0; i__0 < level; i__0++) fout << "    "; fout
+
+#include <fstream>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+namespace cfg {
+
+config config::global;
+
+void config::save(const string& fname) {
+    ofstream fout(fname.c_str());
+    save(fout);
+}
+
+void config::save(ofstream& fout, int level) {
+    WRITE << "[" << name << "]" << endl;
+    level++;
+    for (data_map::iterator iter = data.begin(); iter != data.end(); iter++) {
+        stringstream out_buf(iter->second);
+        string dat;
+        stringstream out;
+        int i = 0;
+        while (getline(out_buf, dat)) {
+            if (i++ != 0) out << " ";
+            out << dat;
+        }
+        WRITE << iter->first << " = " << out.rdbuf() << endl;
+    }
+
+    WRITE << endl;
+
+    for (child_map::iterator iter = children.begin(); iter != children.end(); iter++)
+        iter->second.save(fout, level);
+
+    level--;
+    WRITE << "[/" << name << "]" << endl;
+}
+
+const config* config::child(const string& key) const {
+    child_map::const_iterator iter = children.find(key);
+    return iter == children.end() ? NULL : &iter->second;
+}
+
+//Strips leading and trailing white space
+static string trim(const string& s) {
+    size_t first = s.find_first_not_of(" \t\r\n");
+    if (first == string::npos) return "";
+    return s.substr(first, s.find_last_not_of(" \t\r\n") - first + 1);
+}
+
+bool config::load(const string& fname) {
+    string path = trim(fname);
+    ifstream fin(path.c_str());
+    if (!fin) {
+        cout << "Could not open config file " << path << endl;
+        return false;
+    }
+    return load(fin, path);
+}
+
+bool config::load(istream& fin, const string& fname) {
+    //Sections being read, innermost last
+    vector<config*> open(1, this);
+
+    string buf;
+    for (int line_no = 1; getline(fin, buf); line_no++) {
+        string line = trim(buf.substr(0, buf.find('#')));
+        if (line.empty()) continue;
+
+        if (line[0] == '[') {
+            if (line[line.size() - 1] != ']' || line.size() < 3) {
+                cout << fname << ":" << line_no << ": bad section header " << line << endl;
+                return false;
+            }
+
+            if (line[1] == '/') {
+                string section = trim(line.substr(2, line.size() - 3));
+                if (open.size() == 1 || open.back()->name != section) {
+                    cout << fname << ":" << line_no << ": unmatched [/" << section << "]" << endl;
+                    return false;
+                }
+                open.pop_back();
+                continue;
+            }
+
+            string section = trim(line.substr(1, line.size() - 2));
+            config& child = open.back()->children[section];
+            child.name = section;
+            open.push_back(&child);
+            continue;
+        }
+
+        size_t eq = line.find('=');
+        if (eq == string::npos || trim(line.substr(0, eq)).empty()) {
+            cout << fname << ":" << line_no << ": expected key = value, got " << line << endl;
+            return false;
+        }
+
+        string value = trim(line.substr(eq + 1));
+        if (!value.empty() && value[value.size() - 1] == ';')
+            value = trim(value.substr(0, value.size() - 1));
+        open.back()->data[trim(line.substr(0, eq))] = value;
+    }
+
+    if (open.size() > 1) {
+        cout << fname << ": section [" << open.back()->name << "] is not closed" << endl;
+        return false;
+    }
+    return true;
+}
+
+
+bool parse(const std::string& data, std::string& out)
+    { out = data; return true; }
+
+bool parse(const std::string& data, bool& out) {
+    string word;
+    stringstream buf(data);
+    buf >> word;
+    if (word == "true" || word == "yes" || word == "on" || word == "1") { out = true; return true; }
+    if (word == "false" || word == "no" || word == "off" || word == "0") { out = false; return true; }
+    return false;
+}
+
+bool parse(const std::string& data, vec3& val) {
+    stringstream buf(data);
+    for (int i = 0; i < 3; i++)
+        buf >> val(i);
+    return !buf.fail();
+}
+
+bool parse(const std::string& data, mat44& val) {
+    stringstream buf(data);
+    for (int i = 0; i < 4; i++)
+    for (int j = 0; j < 4; j++)
+        buf >> val(i,j);
+    return !buf.fail();
+}
+
+
+std::string write(const vec3& obj) {
+    stringstream buf;
+    for (int i = 0; i < 3; i++)
+        buf << obj(i) << " ";
+    return buf.str();
+}
+
+std::string write(const mat44& obj) {
+    stringstream buf;
+    for (int i = 0; i < 4; i++)
+    for (int j = 0; j < 4; j++)
+        buf << obj(i,j) << " ";
+    return buf.str();
+}
+
+}
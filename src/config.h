@@ -0,0 +1,125 @@
+//Configuration files
+//  A file holds any number of sections, which may nest:
+//
+//      [name]
+//          key = value
+//          [child]
+//              ...
+//          [/child]
+//      [/name]
+//
+//  Everything after a '#' is a comment and a trailing ';' after a value is
+//  ignored.  Sections repeated at the same level are merged, later values
+//  win.  Lookups parse strings, so resolve settings once at startup (see
+//  params.h) rather than in inner loops.
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <map>
+
+#include <Eigen/Core>
+
+namespace cfg {
+
+
+    typedef Eigen::Vector3f vec3;
+    typedef Eigen::Matrix4f mat44;
+
+    class config {
+    public:
+        static config global;
+
+        typedef std::map<std::string, std::string> data_map;
+        typedef std::map<std::string, config> child_map;
+
+
+    private:
+        std::string name;
+
+        data_map data;
+        child_map children;
+
+    public:
+        config(const std::string& n = "") : name(n) { }
+
+        const std::string& getName() const { return name; }
+
+        //True if the section has a value for key
+        bool has(const std::string& key) const { return data.find(key) != data.end(); }
+
+        //Parses the value of key, false if it is missing or malformed
+        template <typename T>
+        bool lookup(const std::string& key, T& out) const;
+
+        //Value of key, or the default if it is missing or malformed
+        template <typename T>
+        T get(const std::string& key, const T& def) const;
+
+        template <typename T>
+        T get(const std::string& key) const { return get<T>(key, T()); }
+
+        //Child section, NULL if there is none
+        const config* child(const std::string& key) const;
+
+        template <typename T>
+        void set(const std::string& key, const T& value);
+        void set(const std::string& key, const config& value) { children[key] = value; }
+
+        void save(const std::string& fname);
+        void save(std::ofstream& fout, int level = 0);
+
+        //Adds the sections of a file as children, returns false (and says
+        //why) if the file is missing or malformed
+        bool load(const std::string& fname);
+        bool load(std::istream& fin, const std::string& fname = "");
+
+        child_map::const_iterator childBegin() const { return children.begin(); }
+        child_map::const_iterator childEnd() const { return children.end(); }
+
+        data_map::const_iterator dataBegin() const { return data.begin(); }
+        data_map::const_iterator dataEnd() const { return data.end(); }
+
+    };
+
+    template <typename T>
+    bool parse(const std::string& data, T& out)
+        { std::stringstream ss(data); ss >> out; return !ss.fail(); }
+
+    template <typename T>
+    std::string write(const T& obj)
+        { std::stringstream ss; ss << obj; return ss.str(); }
+
+    bool parse(const std::string& data, std::string& out);
+    bool parse(const std::string& data, bool& out);
+    bool parse(const std::string& data, vec3& out);
+    bool parse(const std::string& data, mat44& out);
+
+
+    std::string write(const vec3& obj);
+    std::string write(const mat44& obj);
+
+
+    template <typename T>
+    bool config::lookup(const std::string& key, T& out) const
+    {
+        data_map::const_iterator iter = data.find(key);
+        return iter != data.end() && parse(iter->second, out);
+    }
+
+    template <typename T>
+    T config::get(const std::string& key, const T& def) const
+    {
+        T out;
+        return lookup(key, out) ? out : def;
+    }
+
+    template <typename T>
+    void config::set(const std::string& key, const T& value) { data[key] = write(value); }
+}
+
+#endif
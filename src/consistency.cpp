@@ -0,0 +1,239 @@
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+#include <Eigen/Core>
+
+#include "consistency.h"
+
+using namespace std;
+using namespace Eigen;
+
+//Resizes batch buffers, capacity is rounded up to the SIMD width
+void ConsistencyBatch::reserve(int cap, int samples)
+{
+    capacity    = (cap + 3) & ~3;
+    max_samples = samples;
+    size        = 0;
+
+    r.assign((size_t)capacity * max_samples, 0.0f);
+    g.assign((size_t)capacity * max_samples, 0.0f);
+    b.assign((size_t)capacity * max_samples, 0.0f);
+    count.assign(capacity, 0);
+    consistent.assign(capacity, 0);
+    color.assign(capacity, Color());
+    score.assign(capacity, 0.0f);
+}
+
+//Clears the batch, only the sample slots actually written are reset
+void ConsistencyBatch::clear()
+{
+    int n = 0;
+    for(int i=0; i<size; i++)
+        n = max(n, count[i]);
+
+    for(int k=0; k<n; k++)
+    {
+        size_t o = (size_t)k * capacity;
+        std::fill(&r[o], &r[o] + size, 0.0f);
+        std::fill(&g[o], &g[o] + size, 0.0f);
+        std::fill(&b[o], &b[o] + size, 0.0f);
+    }
+    size = 0;
+}
+
+//Writes the result for one voxel from its moments
+static inline void finish(
+    ConsistencyBatch&   batch,
+    int                 i,
+    const float*        sum,
+    const float*        var,
+    const Vector3f&     threshold)
+{
+    int n = batch.count[i];
+    if(n == 0)
+    {
+        batch.consistent[i] = 1;
+        batch.score[i]      = 0;
+        return;
+    }
+
+    batch.color[i] = Color(
+        (ubyte)(sum[0] / n + 0.5f),
+        (ubyte)(sum[1] / n + 0.5f),
+        (ubyte)(sum[2] / n + 0.5f));
+    batch.consistent[i] = n < 2 ||
+        (var[0] <= threshold[0] && var[1] <= threshold[1] && var[2] <= threshold[2]);
+
+    float score = 0;
+    for(int c=0; n>=2 && c<3; c++)
+        score = max(score, var[c] / max(threshold[c], 1e-6f));
+    batch.score[i] = score;
+}
+
+//Evaluates color variance for every voxel in the batch
+void ConsistencyBatch::evaluate(const Vector3f& threshold)
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    //4 voxels at a time, padding slots have count 0 and zero samples
+    for(; i<size; i+=4)
+    {
+        int n = 0;
+        for(int j=i; j<i+4; j++)
+            n = max(n, j < size ? count[j] : 0);
+
+        __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps(), s2 = _mm_setzero_ps(),
+               q0 = _mm_setzero_ps(), q1 = _mm_setzero_ps(), q2 = _mm_setzero_ps();
+
+        for(int k=0; k<n; k++)
+        {
+            size_t o = (size_t)k * capacity + i;
+            __m128 x0 = _mm_loadu_ps(&r[o]),
+                   x1 = _mm_loadu_ps(&g[o]),
+                   x2 = _mm_loadu_ps(&b[o]);
+            s0 = _mm_add_ps(s0, x0);  q0 = _mm_add_ps(q0, _mm_mul_ps(x0, x0));
+            s1 = _mm_add_ps(s1, x1);  q1 = _mm_add_ps(q1, _mm_mul_ps(x1, x1));
+            s2 = _mm_add_ps(s2, x2);  q2 = _mm_add_ps(q2, _mm_mul_ps(x2, x2));
+        }
+
+        //var = (q - s^2 / n) / (n - 1), guarded against n < 2
+        int c[4];
+        for(int j=0; j<4; j++)
+            c[j] = i + j < size ? count[i + j] : 0;
+        __m128 nv  = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)c));
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 rn  = _mm_div_ps(one, _mm_max_ps(nv, one));
+        __m128 rn1 = _mm_div_ps(one, _mm_max_ps(_mm_sub_ps(nv, one), one));
+
+        __m128 v0 = _mm_mul_ps(_mm_sub_ps(q0, _mm_mul_ps(_mm_mul_ps(s0, s0), rn)), rn1),
+               v1 = _mm_mul_ps(_mm_sub_ps(q1, _mm_mul_ps(_mm_mul_ps(s1, s1), rn)), rn1),
+               v2 = _mm_mul_ps(_mm_sub_ps(q2, _mm_mul_ps(_mm_mul_ps(s2, s2), rn)), rn1);
+
+        float ALIGN16 s[3][4], v[3][4];
+        _mm_store_ps(s[0], s0); _mm_store_ps(s[1], s1); _mm_store_ps(s[2], s2);
+        _mm_store_ps(v[0], v0); _mm_store_ps(v[1], v1); _mm_store_ps(v[2], v2);
+
+        for(int j=0; j<4 && i+j<size; j++)
+        {
+            float sum[3] = { s[0][j], s[1][j], s[2][j] },
+                  var[3] = { v[0][j], v[1][j], v[2][j] };
+            finish(*this, i + j, sum, var, threshold);
+        }
+    }
+#endif
+
+    //Scalar fallback
+    for(; i<size; i++)
+    {
+        float sum[3] = { 0, 0, 0 }, sq[3] = { 0, 0, 0 }, var[3];
+        for(int k=0; k<count[i]; k++)
+        {
+            size_t o = (size_t)k * capacity + i;
+            float x[3] = { r[o], g[o], b[o] };
+            for(int c=0; c<3; c++)
+            {
+                sum[c] += x[c];
+                sq[c]  += x[c] * x[c];
+            }
+        }
+
+        int n = count[i];
+        for(int c=0; c<3; c++)
+            var[c] = n < 2 ? 0.0f : (sq[c] - sum[c] * sum[c] / n) / (n - 1);
+        finish(*this, i, sum, var, threshold);
+    }
+}
+
+//Words per channel in a presence set
+static const int PRESENT_WORDS = 256 / 32;
+
+void ApproximateConsistency::add(const CarveView& view, const Footprint& fp, int pad)
+{
+    size_t base = (size_t)views++ * 3 * PRESENT_WORDS;
+    if(present.size() < base + 3 * PRESENT_WORDS)
+        present.resize(base + 3 * PRESENT_WORDS);
+
+    unsigned* set = &present[base];
+    std::fill(set, set + 3 * PRESENT_WORDS, 0u);
+
+    int x0 = max(fp.x0 - pad, 0), x1 = min(fp.x1 + pad, view.width  - 1),
+        y0 = max(fp.y0 - pad, 0), y1 = min(fp.y1 + pad, view.height - 1);
+    for(int y=y0; y<=y1; y++)
+    for(int x=x0; x<=x1; x++)
+    {
+        const Color& c = view.pixel(x, y);
+        set[0 * PRESENT_WORDS + (c.r >> 5)] |= 1u << (c.r & 31);
+        set[1 * PRESENT_WORDS + (c.g >> 5)] |= 1u << (c.g & 31);
+        set[2 * PRESENT_WORDS + (c.b >> 5)] |= 1u << (c.b & 31);
+    }
+}
+
+//Lists the values of a presence set in increasing order, returns their number
+static inline int presentValues(const unsigned* set, ubyte* values)
+{
+    int n = 0;
+    for(int w=0; w<PRESENT_WORDS; w++)
+        for(unsigned bits=set[w]; bits; bits&=bits-1)
+            values[n++] = (ubyte)(32 * w + __builtin_ctz(bits));
+    return n;
+}
+
+bool ApproximateConsistency::evaluate(const Vector3f& threshold, Color& color) const
+{
+    if(views < 2)
+        return true;
+
+    ubyte mean[3];
+    for(int c=0; c<3; c++)
+    {
+        //Candidate values of the first view, with the sum and square sum of
+        //their nearest matches
+        ubyte   anchors[256], values[256];
+        float   sum[256], sq[256];
+        int     na = presentValues(&present[c * PRESENT_WORDS], anchors);
+        for(int a=0; a<na; a++)
+        {
+            sum[a] = anchors[a];
+            sq[a]  = (float)anchors[a] * anchors[a];
+        }
+
+        //Both lists are sorted, so the nearest match only moves forward
+        for(int v=1; v<views; v++)
+        {
+            int n = presentValues(&present[((size_t)v * 3 + c) * PRESENT_WORDS], values);
+            for(int a=0, k=0; a<na; a++)
+            {
+                int t = anchors[a];
+                while(k + 1 < n && abs(values[k + 1] - t) < abs(values[k] - t))
+                    k++;
+                sum[a] += values[k];
+                sq[a]  += (float)values[k] * values[k];
+            }
+        }
+
+        float best = 1e30f;
+        int   arg  = 0;
+        for(int a=0; a<na; a++)
+        {
+            float var = (sq[a] - sum[a] * sum[a] / views) / (views - 1);
+            if(var < best)
+            {
+                best = var;
+                arg  = a;
+            }
+        }
+
+        if(!(best < threshold[c]))
+            return false;
+        mean[c] = (ubyte)(sum[arg] / views + 0.5f);
+    }
+
+    color = Color(mean[0], mean[1], mean[2]);
+    return true;
+}
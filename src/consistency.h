@@ -0,0 +1,92 @@
+//Photo-consistency tests used by the carving engines
+#ifndef CONSISTENCY_H
+#define CONSISTENCY_H
+
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "carve.h"
+#include "system.h"
+
+//Batched color variance test.
+//  Samples are stored structure-of-arrays, sample k of voxel i at
+//  k * capacity + i, so evaluate() works on 4 voxels per SSE register without
+//  any horizontal reductions.  Unused sample slots are kept at zero.
+struct ConsistencyBatch
+{
+    ConsistencyBatch() : capacity(0), max_samples(0), size(0) {}
+    ConsistencyBatch(int capacity, int max_samples) { reserve(capacity, max_samples); }
+
+    //Resizes buffers and clears the batch
+    void reserve(int capacity, int max_samples);
+
+    //Removes all voxels
+    void clear();
+
+    //Adds a voxel, returns its slot
+    int add()
+    {
+        assert(size < capacity);
+        count[size] = 0;
+        return size++;
+    }
+
+    //Adds a sample to a voxel
+    void sample(int slot, const Color& c)
+    {
+        assert(count[slot] < max_samples);
+        size_t k = (size_t)count[slot]++ * capacity + slot;
+        r[k] = c.r;
+        g[k] = c.g;
+        b[k] = c.b;
+    }
+
+    //Runs the test on all voxels.  A voxel is consistent if the variance of
+    //each channel is at most threshold (fewer than 2 samples always are),
+    //its color is set to the sample mean and its score to the largest ratio
+    //of variance to threshold.
+    void evaluate(const Eigen::Vector3f& threshold);
+
+    int                 capacity, max_samples, size;
+
+    //Sample buffers (SoA)
+    std::vector<float>  r, g, b;
+    std::vector<int>    count;
+
+    //Results
+    std::vector<ubyte>  consistent;
+    std::vector<Color>  color;
+    std::vector<float>  score;
+};
+
+//Approximate color consistency test, tolerant to texture and small
+//calibration errors.
+//  Every view contributes the values in its footprint, padded by some
+//  pixels.  Per channel, each value of the first view is matched with the
+//  nearest value of every other view, and the voxel is consistent if the
+//  best match has variance below threshold.  Values are 8 bit, so views are
+//  kept as 256 bit presence sets and matching is a linear merge of sorted
+//  values, with no sorting or allocation.  Scratch space only grows, keep one
+//  instance per thread.
+struct ApproximateConsistency
+{
+    ApproximateConsistency() : views(0) {}
+
+    //Removes all views
+    void clear() { views = 0; }
+
+    //Adds the pixels of footprint fp in view, padded by pad
+    void add(const CarveView& view, const Footprint& fp, int pad);
+
+    //Runs the test.  If there are at least 2 views, color is set to the mean
+    //of the best match.
+    bool evaluate(const Eigen::Vector3f& threshold, Color& color) const;
+
+    int                     views;
+
+    //Presence sets, 3 channels x 8 words per view
+    std::vector<unsigned>   present;
+};
+
+#endif
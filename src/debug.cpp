@@ -3,55 +3,23 @@
 #include <vector>
 #include <string>
 #include <cassert>
+#include <cmath>
 #include <cstdlib>
 
+#include <boost/shared_ptr.hpp>
+
 #include <Eigen/Core>
 #include <Eigen/Array>
 #include <Eigen/Geometry>
 #include <Eigen/LU>
 
 #include "debug.h"
+#include "metrics.h"
 #include "system.h"
 
 using namespace std;
 using namespace Eigen;
 
-//Saves a collection of point/color pairs to a PLY file for debugging
-void savePLY(
-    const string& filename, 
-    const vector<Vector3d>& points, 
-    const vector<Color>& color)
-{
-    assert(points.size() == color.size());
-    
-    ofstream fout(filename.c_str(), ios_base::out | ios_base::trunc);
-
-    //Write header
-    fout 
-        << "ply" << endl
-        << "format ascii 1.0" << endl
-        << "comment output from autoscanner" << endl
-        << "element vertex " << points.size() << endl
-        << "property float x" << endl
-        << "property float y" << endl
-        << "property float z" << endl
-        << "property uchar blue" << endl
-        << "property uchar green" << endl
-        << "property uchar red" << endl
-        << "end_header" << endl;
-
-    //Serialize point/color pairs
-    for (size_t i = 0; i < points.size(); i++)
-        fout << (float)points[i](0) << " " 
-             << (float)points[i](1) << " " 
-             << (float)points[i](2) << " " 
-             << (int)color[i].b  << " " 
-             << (int)color[i].g  << " " 
-             << (int)color[i].r  << endl;
-
-    fout.close();
-}
-
 //Saves a collection of cameras for debugging
 void saveCameraPLY(
     const string& filename, 
@@ -69,26 +37,229 @@ void saveCameraPLY(
     savePLY(filename, points, colors);
 }
 
-//Saves a volume
-void saveVolumePLY(
-    const std::string& filename,
-    const Volume& volume)
+//Loads camera centers saved by saveCameraPLY
+bool loadCameraPLY(
+    const string& filename,
+    vector<Vector3d>& centers)
 {
-    vector<Vector3d>    points;
-    vector<Color>       colors;
-    
-    for(Vector3d p(0,0,0); p.z()<volume.size().z(); p.z()++)
-    for(p.y()=0; p.y()<volume.size().y(); p.y()++)
-    for(p.x()=0; p.x()<volume.size().x(); p.x()++)
+    PlyReader in(filename);
+    if(!in.ok())
+        return false;
+
+    centers.resize(in.vertices());
+    for(size_t i=0; i<in.vertices(); i++)
+        centers[i] = in.point(i);
+    return true;
+}
+
+//Occupancy of one z layer of a volume as bits, words per row 64 bit words
+//for each y.  Layers outside the volume are empty.
+typedef unsigned long long OccupancyWord;
+
+static void occupancyLayer(const Volume& volume, int z, int words, vector<OccupancyWord>& bits)
+{
+    std::fill(bits.begin(), bits.end(), 0);
+    Vector3i dim = volume.size();
+    if(z < 0 || z >= dim.z())
+        return;
+
+    for(int y=0; y<dim.y(); y++)
+    for(int bx=0; bx<volume.brickDims().x(); bx++)
+    {
+        const Color* row = volume.brick(Vector3i(bx, y >> Volume::BRICK_BITS, z >> Volume::BRICK_BITS)) +
+            Volume::BRICK_SIZE * ((y & Volume::BRICK_MASK) + Volume::BRICK_SIZE * (z & Volume::BRICK_MASK));
+        OccupancyWord* out = &bits[y * words];
+        int x0 = bx * Volume::BRICK_SIZE, x1 = min(x0 + (int)Volume::BRICK_SIZE, dim.x());
+        for(int x=x0; x<x1; x++)
+            if(row[x & Volume::BRICK_MASK] != Color(0,0,0))
+                out[x >> 6] |= 1ULL << (x & 63);
+    }
+}
+
+//Scans z layers [z0, z1) of a volume for surface voxels, 64 voxels at a
+//time: a voxel is on the surface if it is set and not all six neighbours
+//are.  Calls emit(x, y, z) for each in z, y, x order.
+template<class Emit>
+static void scanSurface(const Volume& volume, int z0, int z1, Emit& emit)
+{
+    Vector3i dim   = volume.size();
+    int      words = (dim.x() + 63) >> 6;
+    size_t   layer = (size_t)words * dim.y();
+
+    vector<OccupancyWord> la(layer), lb(layer), lc(layer);
+    vector<OccupancyWord> *prev = &la, *cur = &lb, *next = &lc;
+
+    occupancyLayer(volume, z0 - 1, words, *prev);
+    occupancyLayer(volume, z0, words, *cur);
+    for(int z=z0; z<z1; z++)
     {
-        if(volume.surface(p))
+        occupancyLayer(volume, z + 1, words, *next);
+
+        for(int y=0; y<dim.y(); y++)
         {
-            points.push_back(Transform3d(volume.xform().inverse()) * p);
-            colors.push_back(volume(p));
+            const OccupancyWord* c = &(*cur)[y * words];
+            const OccupancyWord* p = &(*prev)[y * words];
+            const OccupancyWord* n = &(*next)[y * words];
+            const OccupancyWord* u = y > 0 ? c - words : 0;
+            const OccupancyWord* d = y + 1 < dim.y() ? c + words : 0;
+
+            for(int i=0; i<words; i++)
+            {
+                if(!c[i])
+                    continue;
+                OccupancyWord left  = (c[i] << 1) | (i > 0 ? c[i - 1] >> 63 : 0);
+                OccupancyWord right = (c[i] >> 1) | (i + 1 < words ? c[i + 1] << 63 : 0);
+                OccupancyWord full  = left & right & p[i] & n[i] & (u ? u[i] : 0) & (d ? d[i] : 0);
+                OccupancyWord surface = c[i] & ~full;
+
+                while(surface)
+                {
+                    emit((i << 6) + __builtin_ctzll(surface), y, z);
+                    surface &= surface - 1;
+                }
+            }
         }
+
+        std::swap(prev, cur);
+        std::swap(cur, next);
     }
-    
-    savePLY(filename, points, colors);
 }
 
+//Surface voxels in world coordinates, appended to vectors or encoded as
+//PLY vertex records
+struct SurfaceTransform
+{
+    SurfaceTransform(const Volume& volume_) : volume(volume_)
+    {
+        //Voxel -> world, inverted once
+        Matrix4d W = volume.xform().matrix().inverse();
+        R = W.block(0,0,3,3);
+        T = W.block(0,3,3,1);
+    }
+
+    Vector3d point(int x, int y, int z) const { return R * Vector3d(x, y, z) + T; }
+
+    const Volume&   volume;
+    Matrix3d        R;
+    Vector3d        T;
+};
+
+struct SurfacePoints : SurfaceTransform
+{
+    SurfacePoints(const Volume& volume) : SurfaceTransform(volume) {}
+
+    void operator()(int x, int y, int z)
+    {
+        points.push_back(point(x, y, z));
+        colors.push_back(volume(Vector3i(x, y, z)));
+    }
 
+    vector<Vector3d>    points;
+    vector<Color>       colors;
+};
+
+struct SurfaceRecords : SurfaceTransform
+{
+    SurfaceRecords(const Volume& volume) : SurfaceTransform(volume) {}
+
+    void operator()(int x, int y, int z)
+    {
+        Vector3d q = point(x, y, z);
+        size_t at = out.size();
+        out.resize(at + PlyWriter::VERTEX_BYTES);
+        PlyWriter::encodeVertex(&out[at], (float)q.x(), (float)q.y(), (float)q.z(),
+            volume(Vector3i(x, y, z)));
+    }
+
+    vector<ubyte>       out;
+};
+
+//Number of z slabs the surface scans are split into
+static int surfaceSlabs(const Volume& volume)
+{
+    return min(volume.size().z(), 4 * threadCount());
+}
+
+//Collects the surface voxels of a volume.
+//  Slabs of z layers are scanned in parallel and concatenated in order, so
+//  the output does not depend on the thread count.
+void volumeSurface(
+    const Volume& volume,
+    vector<Vector3d>& points,
+    vector<Color>& colors)
+{
+    int nslabs = surfaceSlabs(volume);
+    vector< boost::shared_ptr<SurfacePoints> > slabs(max(nslabs, 0));
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int k=0; k<nslabs; k++)
+    {
+        slabs[k].reset(new SurfacePoints(volume));
+        scanSurface(volume, volume.size().z() * k / nslabs, volume.size().z() * (k + 1) / nslabs, *slabs[k]);
+    }
+
+    points.clear();
+    colors.clear();
+    for(size_t k=0; k<slabs.size(); k++)
+    {
+        points.insert(points.end(), slabs[k]->points.begin(), slabs[k]->points.end());
+        colors.insert(colors.end(), slabs[k]->colors.begin(), slabs[k]->colors.end());
+        slabs[k].reset();
+    }
+}
+
+//Saves a volume, streaming the surface voxels straight to the file.  Each
+//slab encodes its vertices into its own buffer, the buffers are written in
+//order.
+bool saveVolumePLY(
+    const std::string& filename,
+    const Volume& volume)
+{
+    MetricTimer timer("export/volume_ply");
+
+    int nslabs = surfaceSlabs(volume);
+    vector< boost::shared_ptr<SurfaceRecords> > slabs(max(nslabs, 0));
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int k=0; k<nslabs; k++)
+    {
+        slabs[k].reset(new SurfaceRecords(volume));
+        scanSurface(volume, volume.size().z() * k / nslabs, volume.size().z() * (k + 1) / nslabs, *slabs[k]);
+    }
+
+    PlyWriter out(filename);
+    for(size_t k=0; k<slabs.size(); k++)
+    {
+        const vector<ubyte>& records = slabs[k]->out;
+        if(!records.empty())
+            out.rawVertices(&records[0], records.size() / PlyWriter::VERTEX_BYTES);
+        slabs[k].reset();
+    }
+    return out.close();
+}
+
+//Voxelizes a point cloud into a volume
+bool loadVolumePLY(
+    const string& filename,
+    Volume& volume)
+{
+    PlyReader in(filename);
+    if(!in.ok())
+        return false;
+
+    Matrix4d X   = volume.xform().matrix();
+    Vector3i dim = volume.size();
+    for(size_t i=0; i<in.vertices(); i++)
+    {
+        Vector3d q = X.block(0,0,3,3) * in.point(i) + X.block(0,3,3,1);
+        Vector3i v((int)floor(q.x() + 0.5), (int)floor(q.y() + 0.5), (int)floor(q.z() + 0.5));
+        if(v.x() < 0 || v.y() < 0 || v.z() < 0 ||
+            v.x() >= dim.x() || v.y() >= dim.y() || v.z() >= dim.z())
+            continue;
+
+        //Black is empty
+        Color c = in.color(i);
+        volume(v) = c == Color(0,0,0) ? Color(1,1,1) : c;
+    }
+    return true;
+}
@@ -8,6 +8,7 @@
 
 #include <Eigen/Core>
 
+#include "ply.h"
 #include "system.h"
 #include "view.h"
 #include "volume.h"
@@ -21,21 +22,33 @@ void saveTempViews(
 //Restores some temporary views
 std::vector<View> loadTempViews(const std::string& filename);
 
-//Saves a PLY file
-void savePLY(
-    const std::string& filename, 
-    const std::vector<Eigen::Vector3d>& points, 
-    const std::vector<Color>& color);
-
 
 //Save cameras to PLY
 void saveCameraPLY(
     const std::string& filename, 
     const std::vector<View>& views);
 
-//Saves a volume
-void saveVolumePLY(
+//Loads the camera centers saved by saveCameraPLY
+bool loadCameraPLY(
+    const std::string& filename,
+    std::vector<Eigen::Vector3d>& centers);
+
+//Collects the surface voxels of a volume as world space points
+void volumeSurface(
+    const Volume& volume,
+    std::vector<Eigen::Vector3d>& points,
+    std::vector<Color>& colors);
+
+//Saves a volume, returns false if writing failed
+bool saveVolumePLY(
     const std::string& filename,
     const Volume& volume);
 
+//Voxelizes a point cloud into a volume, eg. one saved by saveVolumePLY.
+//  Points go to the nearest voxel index, which is where saveVolumePLY put
+//  them.  Only the voxels hit are written, the rest of the volume is kept.
+bool loadVolumePLY(
+    const std::string& filename,
+    Volume& volume);
+
 #endif
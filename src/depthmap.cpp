@@ -0,0 +1,551 @@
+//Plane sweep depth map stereo.
+//  Every view is matched against its nearest views over fronto-parallel
+//  planes spaced uniformly in inverse depth.  Window costs come from box
+//  filtered image moments, so the work per plane is linear in the pixels
+//  regardless of the window size.
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+#include <Eigen/Core>
+#include <Eigen/LU>
+
+#include "stereo.h"
+#include "metrics.h"
+#include "system.h"
+
+using namespace std;
+using namespace Eigen;
+
+//Fixed point scale of the cost volume
+static const int DEPTH_COST_SCALE = 1024;
+
+//Windows whose variance is below this (per pixel, in gray levels^2) are
+//textureless and cannot be matched by NCC
+static const float NCC_MIN_VARIANCE = 4.0f;
+
+//A view prepared for matching
+struct MatchView
+{
+    int             width, height;
+    vector<float>   gray;
+
+    //Projection, image = A X + b up to w
+    Matrix3d        A, inverse;
+    Vector3d        b;
+
+    //Range of projective depths of the bounding box, 0 if it is not in front
+    double          near, far;
+};
+
+//Converts an image to gray levels and sets up its projection
+static void prepareView(const View& view, const Vector3d& low, const Vector3d& high, MatchView& m)
+{
+    Image image  = view.image();
+    m.width      = image.width();
+    m.height     = image.height();
+    m.gray.resize((size_t)m.width * m.height);
+
+    const ubyte* pixels = (const ubyte*)((const Image&)image);
+    for(int y=0; y<m.height; y++)
+    {
+        const ubyte* row = pixels + y * image.widthStep();
+        for(int x=0; x<m.width; x++)
+            m.gray[x + y * m.width] =
+                0.114f * row[3*x] + 0.587f * row[3*x+1] + 0.299f * row[3*x+2];
+    }
+
+    //Rows x, y, w of the camera matrix, with the sign which puts the box in front
+    Matrix4d M = view.camera().matrix();
+    Vector3d mid = 0.5 * (low + high);
+    double s = M(3,0) * mid.x() + M(3,1) * mid.y() + M(3,2) * mid.z() + M(3,3) < 0 ? -1.0 : 1.0;
+    for(int j=0; j<3; j++)
+    {
+        m.A(0,j) = s * M(0,j);
+        m.A(1,j) = s * M(1,j);
+        m.A(2,j) = s * M(3,j);
+    }
+    m.b = s * Vector3d(M(0,3), M(1,3), M(3,3));
+    m.inverse = m.A.inverse();
+
+    m.near = 1e30;
+    m.far  = 0;
+    for(int i=0; i<8; i++)
+    {
+        Vector3d c(
+            i & 1        ? high.x() : low.x(),
+            (i >> 1) & 1 ? high.y() : low.y(),
+            i >> 2       ? high.z() : low.z());
+        double w = m.A(2,0) * c.x() + m.A(2,1) * c.y() + m.A(2,2) * c.z() + m.b.z();
+        m.near = min(m.near, w);
+        m.far  = max(m.far, w);
+    }
+    if(m.far <= 0)
+        m.near = m.far = 0;
+    else
+        m.near = max(m.near, 1e-3 * m.far);
+}
+
+//Picks the views whose centers are closest in angle as seen from the middle
+//of the box, skipping views at the same position
+static vector<int> nearestViews(const vector<View>& views, int r, const Vector3d& mid, int k)
+{
+    Vector3d a = (views[r].center() - mid).normalized();
+
+    vector< pair<double, int> > order;
+    for(size_t i=0; i<views.size(); i++)
+    {
+        if((int)i == r || (views[i].center() - views[r].center()).norm() < 1e-9)
+            continue;
+        Vector3d c = (views[i].center() - mid).normalized();
+        order.push_back(make_pair(-a.dot(c), (int)i));
+    }
+    std::sort(order.begin(), order.end());
+
+    vector<int> result;
+    for(size_t i=0; i<order.size() && (int)i<k; i++)
+        result.push_back(order[i].second);
+    return result;
+}
+
+//Sum over a (2r+1)^2 window, clipped at the image border.
+//  Both passes are running sums, so the cost does not depend on r.  The
+//  sums are carried in double, in float the error of a recurrence grows
+//  with the image size and ends up in the window variances of the NCC.
+static void boxFilter(const float* in, float* out, float* tmp, int w, int h, int r)
+{
+    //Rows go four at a time, so their running sums overlap
+    for(int y0=0; y0<h; y0+=4)
+    {
+        const float* row[4];
+        float* t[4];
+        double sum[4];
+        for(int k=0; k<4; k++)
+        {
+            int y  = min(y0 + k, h - 1);
+            row[k] = in + (size_t)y * w;
+            t[k]   = tmp + (size_t)y * w;
+            sum[k] = 0;
+        }
+
+        //Window enters the row, slides, then leaves it
+        int a = min(r + 1, w), b = max(w - r, a);
+        for(int x=0; x<min(r, w); x++)
+            for(int k=0; k<4; k++)
+                sum[k] += row[k][x];
+        int x = 0;
+        for(; x<a && x<w; x++)
+            for(int k=0; k<4; k++)
+            {
+                if(x + r < w)
+                    sum[k] += row[k][x + r];
+                t[k][x] = (float)sum[k];
+            }
+        for(; x<b; x++)
+            for(int k=0; k<4; k++)
+            {
+                sum[k] += (double)row[k][x + r] - row[k][x - r - 1];
+                t[k][x] = (float)sum[k];
+            }
+        for(; x<w; x++)
+            for(int k=0; k<4; k++)
+            {
+                sum[k] -= row[k][x - r - 1];
+                t[k][x] = (float)sum[k];
+            }
+    }
+
+    //Column sums of the first window, then add the row entering and drop the
+    //one leaving
+    vector<double> acc(w, 0.0);
+    for(int k=0; k<=min(r, h - 1); k++)
+    {
+        const float* t = tmp + (size_t)k * w;
+        for(int x=0; x<w; x++)
+            acc[x] += t[x];
+    }
+    for(int x=0; x<w; x++)
+        out[x] = (float)acc[x];
+
+    for(int y=1; y<h; y++)
+    {
+        const float* e = y + r < h ? tmp + (size_t)(y + r) * w : 0;
+        const float* l = y - r - 1 >= 0 ? tmp + (size_t)(y - r - 1) * w : 0;
+        float* o = out + (size_t)y * w;
+        if(e && l)
+            for(int x=0; x<w; x++)
+                o[x] = (float)(acc[x] += (double)e[x] - l[x]);
+        else if(e)
+            for(int x=0; x<w; x++)
+                o[x] = (float)(acc[x] += e[x]);
+        else if(l)
+            for(int x=0; x<w; x++)
+                o[x] = (float)(acc[x] -= l[x]);
+        else
+            std::copy(out + (size_t)(y - 1) * w, out + (size_t)y * w, o);
+    }
+}
+
+//Box filtered moments of one plane
+struct Moments
+{
+    //Reference sums (fixed), neighbour sums (per plane)
+    const float *n, *si, *sii;
+    const float *sj, *sjj, *sij, *sad, *sv;
+};
+
+//Adds the NCC cost of pixels [0, count) to acc and counts where the whole
+//window was valid.  cost = (1 - ncc) / 2, textureless windows cost 1.
+static void nccCost(const Moments& m, float* acc, float* cnt, int count)
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128 half = _mm_set1_ps(0.5f), one = _mm_set1_ps(1.0f),
+                 minvar = _mm_set1_ps(NCC_MIN_VARIANCE);
+    for(; i+4<=count; i+=4)
+    {
+        __m128 n   = _mm_loadu_ps(m.n + i),
+               si  = _mm_loadu_ps(m.si + i),
+               sj  = _mm_loadu_ps(m.sj + i);
+        __m128 rn  = _mm_div_ps(one, n);
+        __m128 vi  = _mm_sub_ps(_mm_loadu_ps(m.sii + i), _mm_mul_ps(_mm_mul_ps(si, si), rn)),
+               vj  = _mm_sub_ps(_mm_loadu_ps(m.sjj + i), _mm_mul_ps(_mm_mul_ps(sj, sj), rn)),
+               cij = _mm_sub_ps(_mm_loadu_ps(m.sij + i), _mm_mul_ps(_mm_mul_ps(si, sj), rn));
+
+        //Textured windows get the correlation cost, the rest cost 1
+        __m128 floor = _mm_mul_ps(minvar, n);
+        __m128 tex   = _mm_and_ps(_mm_cmpgt_ps(vi, floor), _mm_cmpgt_ps(vj, floor));
+        __m128 ncc   = _mm_div_ps(cij, _mm_sqrt_ps(_mm_max_ps(_mm_mul_ps(vi, vj), one)));
+        __m128 cost  = _mm_mul_ps(half, _mm_sub_ps(one, ncc));
+        cost = _mm_or_ps(_mm_and_ps(tex, cost), _mm_andnot_ps(tex, one));
+
+        __m128 valid = _mm_cmpeq_ps(_mm_loadu_ps(m.sv + i), n);
+        _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_and_ps(valid, cost)));
+        _mm_storeu_ps(cnt + i, _mm_add_ps(_mm_loadu_ps(cnt + i), _mm_and_ps(valid, one)));
+    }
+#endif
+
+    //Scalar fallback
+    for(; i<count; i++)
+    {
+        if(m.sv[i] != m.n[i])
+            continue;
+        float rn  = 1.0f / m.n[i];
+        float vi  = m.sii[i] - m.si[i] * m.si[i] * rn,
+              vj  = m.sjj[i] - m.sj[i] * m.sj[i] * rn,
+              cij = m.sij[i] - m.si[i] * m.sj[i] * rn;
+        float floor = NCC_MIN_VARIANCE * m.n[i];
+        acc[i] += vi > floor && vj > floor ?
+            0.5f * (1.0f - cij / sqrt(max(vi * vj, 1.0f))) : 1.0f;
+        cnt[i] += 1.0f;
+    }
+}
+
+//Adds the SAD cost of pixels [0, count), normalized to 0-1
+static void sadCost(const Moments& m, float* acc, float* cnt, int count)
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128 one = _mm_set1_ps(1.0f), scale = _mm_set1_ps(1.0f / 255.0f);
+    for(; i+4<=count; i+=4)
+    {
+        __m128 n     = _mm_loadu_ps(m.n + i);
+        __m128 cost  = _mm_div_ps(_mm_mul_ps(_mm_loadu_ps(m.sad + i), scale), n);
+        __m128 valid = _mm_cmpeq_ps(_mm_loadu_ps(m.sv + i), n);
+        _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_and_ps(valid, cost)));
+        _mm_storeu_ps(cnt + i, _mm_add_ps(_mm_loadu_ps(cnt + i), _mm_and_ps(valid, one)));
+    }
+#endif
+
+    //Scalar fallback
+    for(; i<count; i++)
+    {
+        if(m.sv[i] != m.n[i])
+            continue;
+        acc[i] += m.sad[i] / (255.0f * m.n[i]);
+        cnt[i] += 1.0f;
+    }
+}
+
+//One step along an SGM path:
+//  l = c + min(p, p +- 1 plane + P1, min(p) + P2) - min(p), added to s
+static inline void sgmStep(
+    const unsigned short* c, const int* p, int* l, unsigned short* s,
+    int D, int P1, int P2)
+{
+    int lo = *std::min_element(p, p + D);
+    for(int d=0; d<D; d++)
+    {
+        int v = min(p[d], lo + P2);
+        if(d > 0)       v = min(v, p[d-1] + P1);
+        if(d + 1 < D)   v = min(v, p[d+1] + P1);
+        l[d]  = c[d] + v - lo;
+        s[d] += l[d];
+    }
+}
+
+//Semi-global aggregation of cost volume C (pixel major) along the four
+//axis aligned paths, the sum goes to S
+static void aggregate(
+    const vector<unsigned short>&   C,
+    vector<unsigned short>&         S,
+    int w, int h, int D, int P1, int P2)
+{
+    S.assign(C.size(), 0);
+    vector<int> prev((size_t)w * D), cur((size_t)w * D);
+
+    //Horizontal paths, one row at a time
+    for(int dir=0; dir<2; dir++)
+    for(int y=0; y<h; y++)
+    {
+        int x0 = dir ? w - 1 : 0, dx = dir ? -1 : 1;
+        size_t o = ((size_t)y * w + x0) * D;
+        int* p = &prev[0];
+        int* l = &cur[0];
+        for(int d=0; d<D; d++)
+        {
+            p[d] = C[o + d];
+            S[o + d] += p[d];
+        }
+        for(int x=x0+dx; x>=0 && x<w; x+=dx)
+        {
+            o = ((size_t)y * w + x) * D;
+            sgmStep(&C[o], p, l, &S[o], D, P1, P2);
+            std::swap(p, l);
+        }
+    }
+
+    //Vertical paths, a whole row of paths at a time
+    for(int dir=0; dir<2; dir++)
+    {
+        int y0 = dir ? h - 1 : 0, dy = dir ? -1 : 1;
+        for(size_t i=0; i<(size_t)w * D; i++)
+        {
+            prev[i] = C[(size_t)y0 * w * D + i];
+            S[(size_t)y0 * w * D + i] += prev[i];
+        }
+        for(int y=y0+dy; y>=0 && y<h; y+=dy)
+        {
+            for(int x=0; x<w; x++)
+            {
+                size_t o = ((size_t)y * w + x) * D;
+                sgmStep(&C[o], &prev[(size_t)x * D], &cur[(size_t)x * D], &S[o], D, P1, P2);
+            }
+            prev.swap(cur);
+        }
+    }
+}
+
+//Computes the depth map of view r
+static void computeDepthMap(
+    const vector<MatchView>&    mviews,
+    int                         r,
+    const vector<int>&          nbrs,
+    const DepthMapParams&       params,
+    DepthMap&                   result)
+{
+    const MatchView& ref = mviews[r];
+    int w = ref.width, h = ref.height, D = max(params.planes, 2);
+    size_t N = (size_t)w * h;
+
+    result.view    = r;
+    result.width   = w;
+    result.height  = h;
+    result.inverse = ref.inverse;
+    result.offset  = ref.b;
+    result.depth.assign(N, 0.0f);
+    result.cost.assign(N, 1.0f);
+    if(ref.far <= 0 || nbrs.empty())
+        return;
+
+    //Reference moments
+    vector<float> tmp(N), ones(N, 1.0f), n(N), si(N), sii(N), ii(N);
+    for(size_t i=0; i<N; i++)
+        ii[i] = ref.gray[i] * ref.gray[i];
+    boxFilter(&ones[0], &n[0], &tmp[0], w, h, params.window);
+    boxFilter(&ref.gray[0], &si[0], &tmp[0], w, h, params.window);
+    boxFilter(&ii[0], &sii[0], &tmp[0], w, h, params.window);
+
+    //Neighbour moments, per plane
+    vector<float> J(N), V(N), JJ(N), IJ(N), AD(N);
+    vector<float> sj(N), sjj(N), sij(N), sad(N), sv(N);
+    vector<float> acc(N), cnt(N);
+
+    Moments m;
+    m.n = &n[0];   m.si = &si[0];   m.sii = &sii[0];
+    m.sj = &sj[0]; m.sjj = &sjj[0]; m.sij = &sij[0]; m.sad = &sad[0]; m.sv = &sv[0];
+
+    //Neighbour pixel = w * H (x, y, 1) + c, for reference pixel (x, y) at depth w
+    vector<Matrix3d> H(nbrs.size());
+    vector<Vector3d> c(nbrs.size());
+    for(size_t k=0; k<nbrs.size(); k++)
+    {
+        H[k] = mviews[nbrs[k]].A * ref.inverse;
+        c[k] = mviews[nbrs[k]].b - H[k] * ref.b;
+    }
+
+    vector<unsigned short> C(N * D);
+    double inear = 1.0 / ref.near, ifar = 1.0 / ref.far;
+
+    for(int d=0; d<D; d++)
+    {
+        double depth = 1.0 / (inear + (ifar - inear) * d / (D - 1));
+        std::fill(acc.begin(), acc.end(), 0.0f);
+        std::fill(cnt.begin(), cnt.end(), 0.0f);
+
+        for(size_t k=0; k<nbrs.size(); k++)
+        {
+            const MatchView& nb = mviews[nbrs[k]];
+
+            //Warp the neighbour onto the plane, bilinear between pixel centers.
+            //The homogeneous position steps linearly along a row, which is
+            //accurate enough in float for images of a few thousand pixels.
+            float umax = nb.width - 1, vmax = nb.height - 1;
+            Vector3d dq = depth * H[k].col(0);
+            for(int y=0; y<h; y++)
+            {
+                Vector3d q0 = depth * (H[k] * Vector3d(0.5, y + 0.5, 1)) + c[k];
+                float qx = q0.x(), qy = q0.y(), qz = q0.z();
+                float dx = dq.x(), dy = dq.y(), dz = dq.z();
+                float* Jr = &J[(size_t)y * w];
+                float* Vr = &V[(size_t)y * w];
+                for(int x=0; x<w; x++, qx+=dx, qy+=dy, qz+=dz)
+                {
+                    float rz = 1.0f / qz;
+                    float u = qx * rz - 0.5f, v = qy * rz - 0.5f;
+                    if(qz <= 0 || !(u >= 0 && v >= 0 && u < umax && v < vmax))
+                    {
+                        Jr[x] = Vr[x] = 0;
+                        continue;
+                    }
+
+                    int iu = (int)u, iv = (int)v;
+                    float fu = u - iu, fv = v - iv;
+                    const float* g = &nb.gray[iu + (size_t)iv * nb.width];
+                    float top = g[0] + fu * (g[1] - g[0]);
+                    float bot = g[nb.width] + fu * (g[nb.width + 1] - g[nb.width]);
+                    Jr[x] = top + fv * (bot - top);
+                    Vr[x] = 1;
+                }
+            }
+            boxFilter(&V[0], &sv[0], &tmp[0], w, h, params.window);
+
+            if(params.cost == DEPTH_NCC)
+            {
+                for(size_t i=0; i<N; i++)
+                {
+                    JJ[i] = J[i] * J[i];
+                    IJ[i] = J[i] * ref.gray[i];
+                }
+                boxFilter(&J[0],  &sj[0],  &tmp[0], w, h, params.window);
+                boxFilter(&JJ[0], &sjj[0], &tmp[0], w, h, params.window);
+                boxFilter(&IJ[0], &sij[0], &tmp[0], w, h, params.window);
+                nccCost(m, &acc[0], &cnt[0], (int)N);
+            }
+            else
+            {
+                for(size_t i=0; i<N; i++)
+                    AD[i] = V[i] * fabs(ref.gray[i] - J[i]);
+                boxFilter(&AD[0], &sad[0], &tmp[0], w, h, params.window);
+                sadCost(m, &acc[0], &cnt[0], (int)N);
+            }
+        }
+
+        //Mean over the neighbours which saw the whole window
+        for(size_t i=0; i<N; i++)
+            C[i * D + d] = cnt[i] > 0 ?
+                (unsigned short)(min(acc[i] / cnt[i], 1.0f) * DEPTH_COST_SCALE) :
+                DEPTH_COST_SCALE;
+    }
+
+    //Aggregate and pick the best plane per pixel
+    vector<unsigned short> S;
+    if(params.sgm)
+        aggregate(C, S, w, h, D,
+            (int)(params.p1 * DEPTH_COST_SCALE), (int)(params.p2 * DEPTH_COST_SCALE));
+    const vector<unsigned short>& T = params.sgm ? S : C;
+
+    for(size_t i=0; i<N; i++)
+    {
+        const unsigned short* t = &T[i * D];
+        int best = std::min_element(t, t + D) - t;
+
+        float cost = (float)C[i * D + best] / DEPTH_COST_SCALE;
+        if(cost > params.max_cost)
+            continue;
+
+        //Sub-plane refinement by a parabola through the neighbouring planes
+        double f = best;
+        if(best > 0 && best < D - 1)
+        {
+            double a = t[best - 1], b = t[best], e = t[best + 1];
+            double den = a - 2 * b + e;
+            if(den > 0)
+                f += 0.5 * (a - e) / den;
+        }
+
+        result.depth[i] = (float)(1.0 / (inear + (ifar - inear) * f / (D - 1)));
+        result.cost[i]  = cost;
+    }
+}
+
+//Computes the depth map of view r alone, preparing only the views it is
+//matched against
+DepthMap stereoDepthMap(
+    const vector<View>& views,
+    int r,
+    Vector3d low,
+    Vector3d high,
+    const DepthMapParams& params)
+{
+    vector<int> nbrs = nearestViews(views, r, 0.5 * (low + high), params.neighbours);
+
+    //Reference first, then the neighbours
+    vector<MatchView> mviews(nbrs.size() + 1);
+    vector<int> local(nbrs.size());
+    prepareView(views[r], low, high, mviews[0]);
+    for(size_t k=0; k<nbrs.size(); k++)
+    {
+        prepareView(views[nbrs[k]], low, high, mviews[k + 1]);
+        local[k] = (int)k + 1;
+    }
+
+    DepthMap map;
+    computeDepthMap(mviews, 0, local, params, map);
+    map.view = r;
+    return map;
+}
+
+//Computes depth maps for all views, one view per thread
+vector<DepthMap> stereoDepthMaps(
+    const vector<View>& views,
+    Vector3d low,
+    Vector3d high,
+    const DepthMapParams& params)
+{
+    MetricTimer timer("depthmaps");
+
+    ThreadCountScope threads(params.threads);
+
+    int nviews = (int)views.size();
+    vector<MatchView> mviews(nviews);
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int i=0; i<nviews; i++)
+        prepareView(views[i], low, high, mviews[i]);
+
+    vector<DepthMap> maps(nviews);
+    Vector3d mid = 0.5 * (low + high);
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int i=0; i<nviews; i++)
+        computeDepthMap(mviews, i, nearestViews(views, i, mid, params.neighbours), params, maps[i]);
+
+    return maps;
+}
@@ -0,0 +1,216 @@
+//Volumetric graph cut reconstruction.
+//  The surface is the minimum cut of a graph over the voxels in a band below
+//  the visual hull: cutting the face between two voxels costs their
+//  photo-consistency, keeping a voxel inside earns a small balloon reward.
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "stereo.h"
+#include "carve.h"
+#include "consistency.h"
+#include "maxflow.h"
+#include "metrics.h"
+#include "system.h"
+
+using namespace std;
+using namespace Eigen;
+
+//Cost of a perfectly consistent face relative to one at threshold, keeps the
+//surface smooth where color gives no information
+static const float GRAPH_CUT_MIN_COST = 0.05f;
+
+//Number of voxels scored per batch
+static const int GRAPH_CUT_BATCH = 256;
+
+//Scores the photo-consistency of every node.
+//  Visibility is approximated from the hull: a view sees a voxel if it lies
+//  within max_angle of the hull normal there, occlusion by other parts of the
+//  object is ignored.  Normals are the gradient of the depth below the hull.
+static void scoreNodes(
+    const vector<CarveView>&    views,
+    const vector<Vector3i>&     nodes,
+    const vector<ubyte>&        depth,
+    const Vector3i&             dim,
+    const GraphCutParams&       params,
+    vector<float>&              cost,
+    vector<Color>&              color)
+{
+    int n = (int)nodes.size();
+    double cosmax = cos(params.max_angle * M_PI / 180.0);
+
+    cost.resize(n);
+    color.resize(n);
+
+    #pragma omp parallel
+    {
+        ConsistencyBatch batch(GRAPH_CUT_BATCH, views.size());
+
+        #pragma omp for schedule(dynamic, 1)
+        for(int b0=0; b0<n; b0+=GRAPH_CUT_BATCH)
+        {
+            int b1 = min(b0 + GRAPH_CUT_BATCH, n);
+            batch.clear();
+
+            for(int i=b0; i<b1; i++)
+            {
+                const Vector3i& p = nodes[i];
+
+                //Depth increases inwards, so the outward normal is minus its gradient
+                Vector3d normal(0, 0, 0);
+                for(int dz=-1; dz<=1; dz++)
+                for(int dy=-1; dy<=1; dy++)
+                for(int dx=-1; dx<=1; dx++)
+                {
+                    Vector3i q = p + Vector3i(dx, dy, dz);
+                    if(q.x() < 0 || q.y() < 0 || q.z() < 0 ||
+                        q.x() >= dim.x() || q.y() >= dim.y() || q.z() >= dim.z())
+                        continue;
+                    double d = depth[q.x() + dim.x() * ((size_t)q.y() + dim.y() * q.z())];
+                    normal -= d * Vector3d(dx, dy, dz);
+                }
+                double len = normal.norm();
+
+                int slot = batch.add();
+                Vector3d c(p.x() + 0.5, p.y() + 0.5, p.z() + 0.5);
+                for(size_t v=0; v<views.size(); v++)
+                {
+                    Vector3d ray = views[v].center - c;
+                    if(len > 0 && ray.dot(normal) < cosmax * len * ray.norm())
+                        continue;
+
+                    double u, w;
+                    if(!views[v].project(c.x(), c.y(), c.z(), u, w) ||
+                        u < 0 || w < 0 || u >= views[v].width || w >= views[v].height)
+                        continue;
+                    batch.sample(slot, views[v].pixel((int)u, (int)w));
+                }
+            }
+
+            batch.evaluate(params.threshold);
+
+            //Voxels seen by fewer than two views cannot be judged and get the full cost
+            for(int i=b0; i<b1; i++)
+            {
+                int slot  = i - b0;
+                cost[i]   = batch.count[slot] < 2 ? 1.0f : min(batch.score[slot], 1.0f);
+                color[i]  = batch.color[slot];
+            }
+        }
+    }
+}
+
+//Computes a surface by volumetric graph cuts
+Volume stereoGraphCut(
+    const vector<View>& views,
+    Vector3i dim,
+    Vector3d low,
+    Vector3d high,
+    const GraphCutParams& params)
+{
+    MetricTimer timer("graphcut");
+
+    ThreadCountScope threads(params.threads);
+
+    //Outer bound
+    Volume volume = visualHull(views, dim, low, high, params.hull);
+    volume.detach();
+
+    //Depth of every voxel below the hull surface, in the chessboard metric
+    //so the band is as thick across diagonal faces as across flat ones
+    size_t nvox = (size_t)dim.x() * dim.y() * dim.z();
+    int limit = min(params.depth + 2, 254);
+    vector<ubyte> depth(nvox);
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int z=0; z<dim.z(); z++)
+    for(int y=0; y<dim.y(); y++)
+    for(int x=0; x<dim.x(); x++)
+        depth[x + dim.x() * ((size_t)y + dim.y() * z)] =
+            volume.interior(Vector3i(x, y, z)) ? limit : 0;
+
+    chamferDistance(depth, dim);
+
+    //Voxels in the band become nodes, deeper ones stay inside
+    vector<int>         id(nvox, -1);
+    vector<Vector3i>    nodes;
+    for(int z=0; z<dim.z(); z++)
+    for(int y=0; y<dim.y(); y++)
+    for(int x=0; x<dim.x(); x++)
+    {
+        size_t idx = x + dim.x() * ((size_t)y + dim.y() * z);
+        if(depth[idx] == 0 || depth[idx] > params.depth)
+            continue;
+        id[idx] = (int)nodes.size();
+        nodes.push_back(Vector3i(x, y, z));
+    }
+
+    if(nodes.empty())
+        return volume;
+
+    vector<CarveView> cviews;
+    for(size_t i=0; i<views.size(); i++)
+        cviews.push_back(CarveView(views[i], volume));
+
+    vector<float> cost;
+    vector<Color> color;
+    scoreNodes(cviews, nodes, depth, dim, params, cost, color);
+
+    //Build the graph.  Neighbour k is one step along axis k / 2, backwards
+    //for even k, so neighbour k ^ 1 is the opposite one.
+    GridGraph graph((int)nodes.size());
+    for(int i=0; i<(int)nodes.size(); i++)
+    {
+        const Vector3i& p = nodes[i];
+        float source = params.balloon, sink = 0;
+
+        for(int k=0; k<6; k++)
+        {
+            Vector3i q = p;
+            q[k >> 1] += k & 1 ? 1 : -1;
+
+            //Faces towards the outside of the hull or the deep interior are
+            //cut at the cost of p alone
+            float w = params.smoothness * (GRAPH_CUT_MIN_COST + cost[i]);
+            if(q.x() < 0 || q.y() < 0 || q.z() < 0 ||
+                q.x() >= dim.x() || q.y() >= dim.y() || q.z() >= dim.z())
+            {
+                sink += w;
+                continue;
+            }
+
+            size_t qidx = q.x() + dim.x() * ((size_t)q.y() + dim.y() * q.z());
+            if(depth[qidx] == 0)
+                sink += w;
+            else if(id[qidx] < 0)
+                source += w;
+            else if(k & 1)
+            {
+                int j = id[qidx];
+                w = params.smoothness * (GRAPH_CUT_MIN_COST + 0.5f * (cost[i] + cost[j]));
+                graph.link(i, k, j, w, w);
+            }
+        }
+
+        graph.terminal(i, source, sink);
+    }
+
+    vector<int>().swap(id);
+    graph.maxflow();
+
+    //Write the cut back, black is reserved for empty space
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for(int i=0; i<(int)nodes.size(); i++)
+    {
+        Color c = color[i];
+        if(!graph.source(i))
+            c = Color(0,0,0);
+        else if(c == Color(0,0,0))
+            c = Color(1,1,1);
+        volume(nodes[i]) = c;
+    }
+
+    return volume;
+}
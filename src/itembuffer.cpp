@@ -0,0 +1,411 @@
+//Generalized voxel coloring with per-view item buffers.
+//  Every view keeps a depth buffer and the id of the nearest surface voxel at
+//  each pixel, so a voxel is only tested against the pixels it really covers.
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "carve.h"
+#include "consistency.h"
+#include "metrics.h"
+#include "system.h"
+
+using namespace std;
+using namespace Eigen;
+
+//Number of voxels tested between item buffer updates
+static const size_t ITEM_BUFFER_CHUNK = 16384;
+
+//Marks an empty item buffer pixel
+static const unsigned NO_ITEM = ~0u;
+
+//The voxels splatted into a buffer are indexed by 8x8 pixel tiles
+static const int ITEM_TILE_SHIFT = 3;
+
+//A voxel splatted into a buffer, with the footprint and depth it was
+//splatted with
+struct ItemEntry
+{
+    unsigned        id;
+    float           z;
+    unsigned short  x0, y0, x1, y1;
+};
+
+//Nearest surface voxel per pixel of one view
+struct ItemBuffer
+{
+    ItemBuffer(int w, int h) :
+        width(w),
+        tiles_x(((w - 1) >> ITEM_TILE_SHIFT) + 1),
+        depth(w * h),
+        item(w * h),
+        tiles(tiles_x * (((h - 1) >> ITEM_TILE_SHIFT) + 1)),
+        dirty(tiles.size(), 0) { clear(); }
+
+    void clear()
+    {
+        std::fill(depth.begin(), depth.end(), 1e30f);
+        std::fill(item.begin(), item.end(), NO_ITEM);
+    }
+
+    //Writes id over the footprint wherever it is nearer, ties go to the
+    //lower id so the buffer does not depend on the splatting order
+    template<class Box> void splat(const Box& fp, float z, unsigned id)
+    {
+        for(int y=fp.y0; y<=fp.y1; y++)
+        for(int x=fp.x0; x<=fp.x1; x++)
+        {
+            size_t i = x + (size_t)y * width;
+            if(z < depth[i] || (z == depth[i] && id < item[i]))
+            {
+                depth[i] = z;
+                item[i]  = id;
+            }
+        }
+    }
+
+    //Adds id to the index of every tile the footprint overlaps
+    void index(const Footprint& fp, float z, unsigned id)
+    {
+        ItemEntry e = { id, z,
+            (unsigned short)fp.x0, (unsigned short)fp.y0,
+            (unsigned short)fp.x1, (unsigned short)fp.y1 };
+        for(int ty=fp.y0 >> ITEM_TILE_SHIFT; ty<=fp.y1 >> ITEM_TILE_SHIFT; ty++)
+        for(int tx=fp.x0 >> ITEM_TILE_SHIFT; tx<=fp.x1 >> ITEM_TILE_SHIFT; tx++)
+            tiles[tx + (size_t)ty * tiles_x].push_back(e);
+    }
+
+    //Removes id from the footprint, marking the tiles where it leaves
+    //pixels empty
+    void erase(const Footprint& fp, unsigned id)
+    {
+        for(int y=fp.y0; y<=fp.y1; y++)
+        for(int x=fp.x0; x<=fp.x1; x++)
+        {
+            size_t i = x + (size_t)y * width;
+            if(item[i] == id)
+            {
+                depth[i] = 1e30f;
+                item[i]  = NO_ITEM;
+
+                size_t t = (x >> ITEM_TILE_SHIFT) + (size_t)(y >> ITEM_TILE_SHIFT) * tiles_x;
+                if(!dirty[t])
+                {
+                    dirty[t] = 1;
+                    erased.push_back(t);
+                }
+            }
+        }
+    }
+
+    //First tile with erased pixels which the footprint overlaps, -1 if none
+    long firstDirty(const ItemEntry& fp) const
+    {
+        for(int ty=fp.y0 >> ITEM_TILE_SHIFT; ty<=fp.y1 >> ITEM_TILE_SHIFT; ty++)
+        for(int tx=fp.x0 >> ITEM_TILE_SHIFT; tx<=fp.x1 >> ITEM_TILE_SHIFT; tx++)
+        {
+            size_t t = tx + (size_t)ty * tiles_x;
+            if(dirty[t])
+                return (long)t;
+        }
+        return -1;
+    }
+
+    int                 width, tiles_x;
+    vector<float>       depth;
+    vector<unsigned>    item;
+
+    //Voxels splatted in this pass whose footprint overlaps each tile
+    vector< vector<ItemEntry> > tiles;
+
+    //Tiles with pixels erased since the last repair, as a mask and a list
+    vector<ubyte>       dirty;
+    vector<size_t>      erased;
+};
+
+//Voxel id <-> coordinates
+static inline unsigned voxelId(const Vector3i& p, const Vector3i& dim)
+{
+    return p.x() + dim.x() * (p.y() + dim.y() * p.z());
+}
+static inline Vector3i voxelAt(unsigned id, const Vector3i& dim)
+{
+    return Vector3i(id % dim.x(), (id / dim.x()) % dim.y(), id / (dim.x() * dim.y()));
+}
+
+//Footprint and depth of a voxel, false if it is behind the camera or out of frame.
+//  The footprint is the box around the projected face centers rather than the
+//  corners.  The corner box overhangs the voxel by up to sqrt(3), which lets
+//  voxels steal the center pixels of their neighbours behind them.
+static inline bool voxelFootprint(const CarveView& view, const Vector3i& p, Footprint& fp, float& z)
+{
+    double x = p.x() + 0.5, y = p.y() + 0.5, zc = p.z() + 0.5, u, v, w;
+    if(!view.project(x, y, zc, u, v, w) ||
+        u < 0 || v < 0 || u >= view.width || v >= view.height)
+        return false;
+    z     = (float)w;
+    fp.cx = (int)u;
+    fp.cy = (int)v;
+
+    double umin = u, umax = u, vmin = v, vmax = v;
+    for(int i=0; i<6; i++)
+    {
+        double d[3] = { 0, 0, 0 };
+        d[i >> 1] = i & 1 ? 0.5 : -0.5;
+        if(!view.project(x + d[0], y + d[1], zc + d[2], u, v))
+            return false;
+        umin = min(umin, u); umax = max(umax, u);
+        vmin = min(vmin, v); vmax = max(vmax, v);
+    }
+
+    fp.x0 = max(0, (int)floor(umin));
+    fp.y0 = max(0, (int)floor(vmin));
+    fp.x1 = min(view.width  - 1, (int)floor(umax));
+    fp.y1 = min(view.height - 1, (int)floor(vmax));
+    return true;
+}
+
+//Splats and indexes voxels into every buffer, one view per thread
+static void splatVoxels(
+    const vector<CarveView>&    views,
+    vector<ItemBuffer>&         buffers,
+    const vector<unsigned>&     ids,
+    const Vector3i&             dim)
+{
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int i=0; i<(int)views.size(); i++)
+    {
+        ItemBuffer& buffer = buffers[i];
+        Footprint fp;
+        float z;
+        for(size_t k=0; k<ids.size(); k++)
+            if(voxelFootprint(views[i], voxelAt(ids[k], dim), fp, z))
+            {
+                buffer.splat(fp, z, ids[k]);
+                buffer.index(fp, z, ids[k]);
+            }
+    }
+}
+
+//Splats again the remaining voxels indexed in tiles with erased pixels, so
+//the pixels uncovered by carving show the voxels behind them.  Carved voxels
+//are dropped from the index of those tiles.
+static void repairBuffers(
+    const vector<CarveView>&    views,
+    vector<ItemBuffer>&         buffers,
+    const Volume&               volume)
+{
+    MetricTimer timer("photohull/item_buffer/repair");
+    Vector3i dim = volume.size();
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int i=0; i<(int)views.size(); i++)
+    {
+        ItemBuffer& buffer = buffers[i];
+        for(size_t k=0; k<buffer.erased.size(); k++)
+        {
+            size_t t = buffer.erased[k];
+            vector<ItemEntry>& tile = buffer.tiles[t];
+            size_t kept = 0;
+            for(size_t j=0; j<tile.size(); j++)
+            {
+                const ItemEntry& e = tile[j];
+                if(!volume.interior(voxelAt(e.id, dim)))
+                    continue;
+                tile[kept++] = e;
+
+                //Each voxel is splatted once, from the first tile it overlaps
+                if(buffer.firstDirty(e) == (long)t)
+                    buffer.splat(e, e.z, e.id);
+            }
+            tile.resize(kept);
+        }
+
+        for(size_t k=0; k<buffer.erased.size(); k++)
+            buffer.dirty[buffer.erased[k]] = 0;
+        buffer.erased.clear();
+    }
+}
+
+//Runs one pass of generalized voxel coloring over all surface voxels.
+//  Item buffers are rendered from the surface at the start of the pass, then
+//  voxels are tested in chunks.  After each chunk the carved voxels are
+//  erased from the buffers, the voxels they expose are splatted in and the
+//  voxels behind them, found through a per tile index of the splatted
+//  voxels, splatted again where they were erased, so later chunks see exact
+//  visibility.  Exposed voxels are queued in this pass.
+size_t itemBufferPass(CarveState& state)
+{
+    MetricTimer timer("photohull/item_buffer");
+
+    Volume&             volume = *state.volume;
+    vector<CarveView>&  views  = state.views;
+    const Vector3f      thresh = state.params->threshold;
+    Vector3i            dim    = volume.size();
+
+    //Collect surface voxels
+    vector<unsigned> surface;
+    for(int z=0; z<dim.z(); z++)
+    for(int y=0; y<dim.y(); y++)
+    for(int x=0; x<dim.x(); x++)
+    {
+        Vector3i p(x, y, z);
+        if((!state.band || (*state.band)[voxelId(p, dim)]) && volume.surface(p))
+            surface.push_back(voxelId(p, dim));
+    }
+
+    //Render item buffers
+    vector<ItemBuffer> buffers;
+    for(size_t i=0; i<views.size(); i++)
+        buffers.push_back(ItemBuffer(views[i].width, views[i].height));
+    splatVoxels(views, buffers, surface, dim);
+
+    size_t removed = 0;
+    for(size_t c0=0; c0<surface.size(); c0+=ITEM_BUFFER_CHUNK)
+    {
+        int n = (int)min(ITEM_BUFFER_CHUNK, surface.size() - c0);
+        vector<ubyte> carve(n, 0);
+
+        //Test the chunk against the current buffers
+        #pragma omp parallel
+        {
+            ConsistencyBatch batch(256, views.size());
+            vector<int>      slots(256);
+
+            #pragma omp for schedule(dynamic, 1)
+            for(int b0=0; b0<n; b0+=256)
+            {
+                int b1 = min(b0 + 256, n);
+                batch.clear();
+
+                for(int k=b0; k<b1; k++)
+                {
+                    unsigned id = surface[c0 + k];
+                    Vector3i p  = voxelAt(id, dim);
+                    int slot    = -1;
+
+                    //Directions in which p has an empty neighbour
+                    int open = 0;
+                    for(int d=0; d<6; d++)
+                    {
+                        Vector3i q = p;
+                        q[N_DIM[d]] -= N_SGN[d];
+                        if(!volume.interior(q))
+                            open |= 1 << d;
+                    }
+
+                    //Sample each view whose center pixel this voxel owns and
+                    //which looks steeply through one of the open faces.
+                    //Grazing views and the overhanging rest of the footprint
+                    //pick up background near the silhouette.
+                    for(size_t i=0; i<views.size(); i++)
+                    {
+                        int d = 0;
+                        while(d < 6 && !((open >> d) & 1 && views[i].sweeps(p, d)))
+                            d++;
+
+                        Footprint fp;
+                        float z;
+                        if(d == 6 || !voxelFootprint(views[i], p, fp, z) ||
+                            buffers[i].item[fp.cx + (size_t)fp.cy * buffers[i].width] != id)
+                            continue;
+
+                        if(slot < 0)
+                            slot = batch.add();
+                        batch.sample(slot, views[i].pixel(fp.cx, fp.cy));
+                    }
+                    slots[k - b0] = slot;
+                }
+
+                batch.evaluate(thresh);
+
+                //Voxels which no view sees are left alone
+                for(int k=b0; k<b1; k++)
+                {
+                    int slot = slots[k - b0];
+                    if(slot < 0)
+                        continue;
+                    if(batch.consistent[slot])
+                    {
+                        Color c = batch.color[slot];
+                        if(c == Color(0,0,0))
+                            c = Color(1,1,1);
+                        (*state.writer)(voxelAt(surface[c0 + k], dim)) = c;
+                    }
+                    else
+                        carve[k] = 1;
+                }
+
+                if(metricsEnabled())
+                {
+                    size_t samples = 0, carved = 0;
+                    for(int slot=0; slot<batch.size; slot++)
+                        samples += batch.count[slot];
+                    for(int k=b0; k<b1; k++)
+                        carved += carve[k];
+                    countMetric(METRIC_VOXELS_TESTED, b1 - b0);
+                    countMetric(METRIC_VOXELS_CARVED, carved);
+                    countMetric(METRIC_VIEWS_SAMPLED, samples);
+                    countMetric(METRIC_PIXELS_READ, samples);
+                }
+            }
+        }
+
+        //Find voxels exposed by the carved ones, before carving
+        vector<unsigned> carved, exposed;
+        for(int k=0; k<n; k++)
+        {
+            if(!carve[k])
+                continue;
+            unsigned id = surface[c0 + k];
+            Vector3i p  = voxelAt(id, dim);
+            carved.push_back(id);
+
+            for(int j=0; j<6; j++)
+            {
+                Vector3i q = p;
+                q[j >> 1] += j & 1 ? 1 : -1;
+                if(volume.interior(q) && !volume.surface(q))
+                    exposed.push_back(voxelId(q, dim));
+            }
+        }
+        std::sort(exposed.begin(), exposed.end());
+        exposed.erase(std::unique(exposed.begin(), exposed.end()), exposed.end());
+
+        for(size_t k=0; k<carved.size(); k++)
+            (*state.writer)(voxelAt(carved[k], dim)) = Color(0,0,0);
+        removed += carved.size();
+
+        //Update buffers incrementally
+        #pragma omp parallel for schedule(dynamic, 1)
+        for(int i=0; i<(int)views.size(); i++)
+        {
+            Footprint fp;
+            float z;
+            for(size_t k=0; k<carved.size(); k++)
+                if(voxelFootprint(views[i], voxelAt(carved[k], dim), fp, z))
+                    buffers[i].erase(fp, carved[k]);
+        }
+        splatVoxels(views, buffers, exposed, dim);
+        repairBuffers(views, buffers, volume);
+
+        //Exposed voxels get tested later in this pass
+        for(size_t k=0; k<exposed.size(); k++)
+            if(!state.band || (*state.band)[exposed[k]])
+                surface.push_back(exposed[k]);
+
+        //Report progress
+        CarveProgress& progress = state.progress;
+        progress.direction = -1;
+        progress.plane     = (int)min(c0 + n, surface.size());
+        progress.planes    = (int)surface.size();
+        progress.tested   += n;
+        progress.removed  += carved.size();
+        if(state.params->progress)
+            state.params->progress(progress);
+    }
+
+    return removed;
+}
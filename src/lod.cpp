@@ -0,0 +1,702 @@
+//Level of detail output.
+//  Point levels average the points in the cells of an octree: points are
+//  sorted by the Morton code of their finest cell, so the cells of every
+//  level are runs of equal code prefixes and each level is one linear scan
+//  of the next finer one.
+//
+//  Mesh levels come from Garland-Heckbert quadric edge collapses, run on
+//  blocks of the mesh in parallel.
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/LU>
+
+#include "debug.h"
+#include "lod.h"
+#include "metrics.h"
+#include "system.h"
+
+using namespace std;
+using namespace Eigen;
+
+//Maximum octree depth, 21 bits per axis fill a 64 bit Morton code
+static const int LOD_MAX_DEPTH = 21;
+
+//Triangles per decimation block
+static const double DECIMATE_BLOCK_SIZE = 20000;
+
+typedef unsigned long long          MortonCode;
+typedef pair<MortonCode, unsigned>  KeyIndex;
+
+//Spreads the low 21 bits of x to every third bit
+static MortonCode spreadBits(MortonCode x)
+{
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffULL;
+    x = (x | x << 16) & 0x1f0000ff0000ffULL;
+    x = (x | x << 8)  & 0x100f00f00f00f00fULL;
+    x = (x | x << 4)  & 0x10c30c30c30c30c3ULL;
+    x = (x | x << 2)  & 0x1249249249249249ULL;
+    return x;
+}
+
+static MortonCode mortonCode(int x, int y, int z)
+{
+    return spreadBits(x) | (spreadBits(y) << 1) | (spreadBits(z) << 2);
+}
+
+//Sorts chunks in parallel, then merges them pairwise
+static void parallelSort(vector<KeyIndex>& v)
+{
+    int chunks = max(1, min(threadCount(), (int)(v.size() / 4096)));
+    vector<size_t> bounds(chunks + 1);
+    for(int i=0; i<=chunks; i++)
+        bounds[i] = v.size() * i / chunks;
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int i=0; i<chunks; i++)
+        std::sort(v.begin() + bounds[i], v.begin() + bounds[i + 1]);
+
+    for(int width=1; width<chunks; width*=2)
+    {
+        #pragma omp parallel for schedule(dynamic, 1)
+        for(int i=0; i<chunks; i+=2*width)
+            if(i + width < chunks)
+                std::inplace_merge(
+                    v.begin() + bounds[i],
+                    v.begin() + bounds[i + width],
+                    v.begin() + bounds[min(i + 2 * width, chunks)]);
+    }
+}
+
+//Sums of the points in one octree cell
+struct LodCell
+{
+    MortonCode  key;
+    Vector3d    position;
+    double      r, g, b;
+    size_t      count;
+};
+
+//Turns sorted finest cell codes into levels
+static PointLod buildLevels(
+    const vector<KeyIndex>& keys,
+    const vector<Vector3d>& points,
+    const vector<Color>& colors,
+    int levels)
+{
+    PointLod lod;
+    levels = max(levels, 1);
+    lod.points.resize(levels);
+    lod.colors.resize(levels);
+
+    vector<LodCell> cells, coarser;
+    for(size_t i=0; i<keys.size(); i++)
+    {
+        if(cells.empty() || cells.back().key != keys[i].first)
+        {
+            LodCell c = { keys[i].first, Vector3d(0,0,0), 0, 0, 0, 0 };
+            cells.push_back(c);
+        }
+        LodCell& c = cells.back();
+        unsigned j = keys[i].second;
+        Color    col = j < colors.size() ? colors[j] : Color(255, 255, 255);
+        c.position += points[j];
+        c.r += col.r; c.g += col.g; c.b += col.b;
+        c.count++;
+    }
+
+    for(int l=levels-1; l>=0; l--)
+    {
+        vector<Vector3d>& p = lod.points[l];
+        vector<Color>&    c = lod.colors[l];
+        p.resize(cells.size());
+        c.resize(cells.size());
+        for(size_t i=0; i<cells.size(); i++)
+        {
+            double n = (double)cells[i].count;
+            p[i] = cells[i].position / n;
+            c[i] = Color(
+                (ubyte)(cells[i].r / n + 0.5),
+                (ubyte)(cells[i].g / n + 0.5),
+                (ubyte)(cells[i].b / n + 0.5));
+        }
+        if(l == 0)
+            break;
+
+        //Parent cells drop the last octant
+        coarser.clear();
+        for(size_t i=0; i<cells.size(); i++)
+        {
+            MortonCode key = cells[i].key >> 3;
+            if(coarser.empty() || coarser.back().key != key)
+            {
+                LodCell parent = cells[i];
+                parent.key = key;
+                coarser.push_back(parent);
+                continue;
+            }
+            LodCell& parent = coarser.back();
+            parent.position += cells[i].position;
+            parent.r += cells[i].r; parent.g += cells[i].g; parent.b += cells[i].b;
+            parent.count += cells[i].count;
+        }
+        cells.swap(coarser);
+    }
+    return lod;
+}
+
+PointLod buildPointLod(
+    const vector<Vector3d>& points,
+    const vector<Color>& colors,
+    const LodParams& params)
+{
+    MetricTimer timer("lod/points");
+
+    ThreadCountScope threads(params.threads);
+
+    //Bounding cube
+    Vector3d low  = points.empty() ? Vector3d(0,0,0) : points[0];
+    Vector3d high = low;
+    for(size_t i=1; i<points.size(); i++)
+    for(int a=0; a<3; a++)
+    {
+        low[a]  = min(low[a], points[i][a]);
+        high[a] = max(high[a], points[i][a]);
+    }
+    double side = max(high.x() - low.x(), max(high.y() - low.y(), high.z() - low.z()));
+    int    cells = 1 << max(0, min(params.depth, LOD_MAX_DEPTH));
+    double scale = side > 0 ? cells / side : 0;
+
+    vector<KeyIndex> keys(points.size());
+
+    #pragma omp parallel for schedule(static)
+    for(int i=0; i<(int)points.size(); i++)
+    {
+        int q[3];
+        for(int a=0; a<3; a++)
+            q[a] = max(0, min(cells - 1, (int)((points[i][a] - low[a]) * scale)));
+        keys[i] = KeyIndex(mortonCode(q[0], q[1], q[2]), i);
+    }
+
+    parallelSort(keys);
+    return buildLevels(keys, points, colors, params.levels);
+}
+
+PointLod buildVolumeLod(const Volume& volume, const LodParams& params)
+{
+    ThreadCountScope threads(params.threads);
+
+    vector<Vector3d> points;
+    vector<Color>    colors;
+    volumeSurface(volume, points, colors);
+
+    //The surface points sit on voxel corners, their voxel indices are the
+    //finest cells
+    Matrix4d X = volume.xform().matrix();
+    vector<KeyIndex> keys(points.size());
+
+    #pragma omp parallel for schedule(static)
+    for(int i=0; i<(int)points.size(); i++)
+    {
+        Vector3d q = X.block(0,0,3,3) * points[i] + X.block(0,3,3,1);
+        keys[i] = KeyIndex(mortonCode(
+            (int)floor(q.x() + 0.5),
+            (int)floor(q.y() + 0.5),
+            (int)floor(q.z() + 0.5)), i);
+    }
+
+    parallelSort(keys);
+    return buildLevels(keys, points, colors, params.levels);
+}
+
+//Symmetric 4x4 error quadric of a set of planes
+struct Quadric
+{
+    Quadric() { std::fill(q, q + 10, 0.0); }
+
+    //Plane n.p + d = 0 weighted by w
+    Quadric(const Vector3d& n, double d, double w)
+    {
+        double a = n.x(), b = n.y(), c = n.z();
+        q[0] = w*a*a; q[1] = w*a*b; q[2] = w*a*c; q[3] = w*a*d;
+        q[4] = w*b*b; q[5] = w*b*c; q[6] = w*b*d;
+        q[7] = w*c*c; q[8] = w*c*d;
+        q[9] = w*d*d;
+    }
+
+    void operator+=(const Quadric& o)
+    {
+        for(int i=0; i<10; i++)
+            q[i] += o.q[i];
+    }
+
+    double error(const Vector3d& p) const
+    {
+        double x = p.x(), y = p.y(), z = p.z();
+        return max(0.0,
+            q[0]*x*x + 2*q[1]*x*y + 2*q[2]*x*z + 2*q[3]*x +
+            q[4]*y*y + 2*q[5]*y*z + 2*q[6]*y +
+            q[7]*z*z + 2*q[8]*z + q[9]);
+    }
+
+    //Point of least error, false if the quadric is singular
+    bool optimum(Vector3d& p) const
+    {
+        double c00 = q[4]*q[7] - q[5]*q[5];
+        double c01 = q[2]*q[5] - q[1]*q[7];
+        double c02 = q[1]*q[5] - q[2]*q[4];
+        double det = q[0]*c00 + q[1]*c01 + q[2]*c02;
+        double s   = q[0] + q[4] + q[7];
+        if(fabs(det) <= 1e-9 * s * s * s)
+            return false;
+
+        double c11 = q[0]*q[7] - q[2]*q[2];
+        double c12 = q[1]*q[2] - q[0]*q[5];
+        double c22 = q[0]*q[4] - q[1]*q[1];
+        Vector3d b(-q[3], -q[6], -q[8]);
+        p = Vector3d(
+            c00*b.x() + c01*b.y() + c02*b.z(),
+            c01*b.x() + c11*b.y() + c12*b.z(),
+            c02*b.x() + c12*b.y() + c22*b.z()) / det;
+        return true;
+    }
+
+    double q[10];
+};
+
+//Candidate edge collapse, ordered cheapest first in a priority queue
+struct Collapse
+{
+    double      cost;
+    int         u, v;
+    unsigned    su, sv;     //Vertex stamps when the candidate was made
+    Vector3d    position;
+
+    bool operator<(const Collapse& o) const { return cost > o.cost; }
+};
+
+//Decimates the triangles of one block.  Locked vertices never move, every
+//other vertex of the block has all of its triangles in the block.
+struct BlockDecimator
+{
+    BlockDecimator(const Mesh& mesh, const vector<ubyte>& locked_, const int* ids, size_t n) :
+        ntris(n),
+        alive(n)
+    {
+        //Local vertex numbering
+        for(size_t t=0; t<n; t++)
+        for(int k=0; k<3; k++)
+            verts.push_back(mesh.triangles[3 * ids[t] + k]);
+        std::sort(verts.begin(), verts.end());
+        verts.erase(std::unique(verts.begin(), verts.end()), verts.end());
+
+        size_t nv = verts.size();
+        pos.resize(nv);
+        col.resize(nv);
+        locked.resize(nv);
+        stamp.assign(nv, 0);
+        dead.assign(nv, 0);
+        vtris.resize(nv);
+        quadrics.resize(nv);
+        for(size_t i=0; i<nv; i++)
+        {
+            pos[i]    = mesh.vertices[verts[i]];
+            col[i]    = mesh.colors[verts[i]];
+            locked[i] = locked_[verts[i]];
+        }
+
+        tris.resize(3 * n);
+        live.assign(n, 1);
+        for(size_t t=0; t<n; t++)
+        {
+            for(int k=0; k<3; k++)
+            {
+                int v = mesh.triangles[3 * ids[t] + k];
+                tris[3 * t + k] = std::lower_bound(verts.begin(), verts.end(), v) - verts.begin();
+                vtris[tris[3 * t + k]].push_back(t);
+            }
+
+            //Area weighted plane quadrics
+            const Vector3d& a = pos[tris[3 * t]];
+            Vector3d nrm = (pos[tris[3 * t + 1]] - a).cross(pos[tris[3 * t + 2]] - a);
+            double area = nrm.norm();
+            if(area <= 0)
+                continue;
+            nrm /= area;
+            Quadric plane(nrm, -nrm.dot(a), 0.5 * area);
+            for(int k=0; k<3; k++)
+                quadrics[tris[3 * t + k]] += plane;
+        }
+    }
+
+    //Collapses edges until target triangles are left or none can go
+    void run(size_t target)
+    {
+        for(size_t t=0; t<ntris; t++)
+        for(int k=0; k<3; k++)
+        {
+            int u = tris[3 * t + k], v = tris[3 * t + (k + 1) % 3];
+            if(u < v)
+                push(u, v);
+        }
+
+        vector<int> nk, nr;
+        while(alive > target && !heap.empty())
+        {
+            Collapse c = heap.top();
+            heap.pop();
+            if(dead[c.u] || dead[c.v] || stamp[c.u] != c.su || stamp[c.v] != c.sv)
+                continue;
+            collapse(c, nk, nr);
+        }
+    }
+
+    //Writes the moved vertices and the remaining triangles back
+    void output(Mesh& mesh, vector<int>& triangles) const
+    {
+        for(size_t i=0; i<verts.size(); i++)
+        {
+            if(locked[i] || dead[i])
+                continue;
+            mesh.vertices[verts[i]] = pos[i];
+            mesh.colors[verts[i]]   = col[i];
+        }
+        for(size_t t=0; t<ntris; t++)
+            if(live[t])
+                for(int k=0; k<3; k++)
+                    triangles.push_back(verts[tris[3 * t + k]]);
+    }
+
+private:
+    //Queues the collapse of edge (u, v)
+    void push(int u, int v)
+    {
+        if(locked[u] && locked[v])
+            return;
+
+        Quadric q = quadrics[u];
+        q += quadrics[v];
+
+        Vector3d p;
+        if(locked[u])
+            p = pos[u];
+        else if(locked[v])
+            p = pos[v];
+        else
+        {
+            //Fall back to the best of the ends and the middle if the optimum
+            //is missing or far off
+            Vector3d mid = 0.5 * (pos[u] + pos[v]);
+            if(!q.optimum(p) || (p - mid).norm() > (pos[u] - pos[v]).norm())
+            {
+                p = mid;
+                if(q.error(pos[u]) < q.error(p)) p = pos[u];
+                if(q.error(pos[v]) < q.error(p)) p = pos[v];
+            }
+        }
+
+        Collapse c = { q.error(p), u, v, stamp[u], stamp[v], p };
+        heap.push(c);
+    }
+
+    //Sorted neighbours of a vertex over its live triangles, dropping dead
+    //triangles from its list
+    void neighbours(int v, vector<int>& out)
+    {
+        out.clear();
+        vector<int>& list = vtris[v];
+        size_t n = 0;
+        for(size_t i=0; i<list.size(); i++)
+        {
+            int t = list[i];
+            if(!live[t])
+                continue;
+            list[n++] = t;
+            for(int k=0; k<3; k++)
+                if(tris[3 * t + k] != v)
+                    out.push_back(tris[3 * t + k]);
+        }
+        list.resize(n);
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    }
+
+    //Normal of triangle t with vertex r moved to k at p
+    Vector3d normal(int t, int r, int k, const Vector3d& p) const
+    {
+        Vector3d q[3];
+        for(int j=0; j<3; j++)
+        {
+            int v = tris[3 * t + j];
+            q[j] = (v == r || v == k) ? p : pos[v];
+        }
+        return (q[1] - q[0]).cross(q[2] - q[0]);
+    }
+
+    void collapse(const Collapse& c, vector<int>& nk, vector<int>& nr)
+    {
+        //r is merged into k, which stays if locked
+        int k = c.u, r = c.v;
+        if(locked[r])
+            std::swap(k, r);
+
+        //Link condition: the ends share exactly the vertices opposite the
+        //edge, otherwise the collapse makes the surface non-manifold
+        neighbours(k, nk);
+        neighbours(r, nr);
+        int shared = 0, common = 0;
+        for(size_t i=0; i<vtris[r].size(); i++)
+        {
+            int t = vtris[r][i];
+            shared += tris[3 * t] == k || tris[3 * t + 1] == k || tris[3 * t + 2] == k;
+        }
+        for(size_t i=0, j=0; i<nk.size() && j<nr.size(); )
+        {
+            if(nk[i] < nr[j]) i++;
+            else if(nr[j] < nk[i]) j++;
+            else { common++; i++; j++; }
+        }
+        if(shared == 0 || common != shared)
+            return;
+
+        //No triangle may flip or collapse to a sliver
+        for(int e=0; e<2; e++)
+        {
+            const vector<int>& list = vtris[e ? r : k];
+            for(size_t i=0; i<list.size(); i++)
+            {
+                int t = list[i];
+                const int* v = &tris[3 * t];
+                if((v[0] == k || v[1] == k || v[2] == k) && (v[0] == r || v[1] == r || v[2] == r))
+                    continue;
+                Vector3d before = (pos[v[1]] - pos[v[0]]).cross(pos[v[2]] - pos[v[0]]);
+                Vector3d after  = normal(t, r, k, c.position);
+                if(after.dot(before) <= 0.2 * after.norm() * before.norm())
+                    return;
+            }
+        }
+
+        //Merge r into k
+        for(size_t i=0; i<vtris[r].size(); i++)
+        {
+            int  t = vtris[r][i];
+            int* v = &tris[3 * t];
+            if(v[0] == k || v[1] == k || v[2] == k)
+            {
+                live[t] = 0;
+                alive--;
+                continue;
+            }
+            for(int j=0; j<3; j++)
+                if(v[j] == r)
+                    v[j] = k;
+            vtris[k].push_back(t);
+        }
+        vector<int>().swap(vtris[r]);
+
+        pos[k] = c.position;
+        col[k] = Color(
+            (col[k].r + col[r].r + 1) / 2,
+            (col[k].g + col[r].g + 1) / 2,
+            (col[k].b + col[r].b + 1) / 2);
+        quadrics[k] += quadrics[r];
+        dead[r] = 1;
+        stamp[k]++;
+        stamp[r]++;
+
+        neighbours(k, nk);
+        for(size_t i=0; i<nk.size(); i++)
+            push(k, nk[i]);
+    }
+
+    size_t                  ntris, alive;
+    vector<int>             verts;      //Local -> mesh vertex
+    vector<Vector3d>        pos;
+    vector<Color>           col;
+    vector<ubyte>           locked, dead;
+    vector<unsigned>        stamp;
+    vector< vector<int> >   vtris;
+    vector<Quadric>         quadrics;
+    vector<int>             tris;
+    vector<ubyte>           live;
+    priority_queue<Collapse> heap;
+};
+
+//One parallel decimation pass over a grid of blocks, offset is in blocks
+static void decimatePass(Mesh& mesh, size_t target, double offset)
+{
+    size_t ntris = mesh.triangleCount();
+    if(ntris == 0)
+        return;
+
+    //Block grid over the bounding box
+    Vector3d low = mesh.vertices[mesh.triangles[0]], high = low;
+    for(size_t i=0; i<mesh.triangles.size(); i++)
+    for(int a=0; a<3; a++)
+    {
+        low[a]  = min(low[a], mesh.vertices[mesh.triangles[i]][a]);
+        high[a] = max(high[a], mesh.vertices[mesh.triangles[i]][a]);
+    }
+    int grid = max(1, (int)floor(pow(ntris / DECIMATE_BLOCK_SIZE, 1.0 / 3.0) + 0.5));
+    int cells = grid + (offset > 0);
+
+    vector<int> block(ntris);
+    for(size_t t=0; t<ntris; t++)
+    {
+        Vector3d c = (mesh.vertices[mesh.triangles[3 * t]] +
+                      mesh.vertices[mesh.triangles[3 * t + 1]] +
+                      mesh.vertices[mesh.triangles[3 * t + 2]]) / 3;
+        int b[3];
+        for(int a=0; a<3; a++)
+        {
+            double size = (high[a] - low[a]) / grid;
+            b[a] = size > 0 ? (int)floor((c[a] - low[a]) / size + offset) : 0;
+            b[a] = max(0, min(cells - 1, b[a]));
+        }
+        block[t] = b[0] + cells * (b[1] + cells * b[2]);
+    }
+
+    //Vertices in several blocks stay put, as do the ends of edges which
+    //are not shared by exactly two triangles
+    size_t nv = mesh.vertices.size();
+    vector<int>   owner(nv, -1);
+    vector<ubyte> locked(nv, 0);
+    vector< pair<int,int> > edges;
+    edges.reserve(3 * ntris);
+    for(size_t t=0; t<ntris; t++)
+    for(int k=0; k<3; k++)
+    {
+        int v = mesh.triangles[3 * t + k], w = mesh.triangles[3 * t + (k + 1) % 3];
+        if(owner[v] < 0)
+            owner[v] = block[t];
+        else if(owner[v] != block[t])
+            locked[v] = 1;
+        edges.push_back(make_pair(min(v, w), max(v, w)));
+    }
+    std::sort(edges.begin(), edges.end());
+    for(size_t i=0; i<edges.size(); )
+    {
+        size_t j = i + 1;
+        while(j < edges.size() && edges[j] == edges[i])
+            j++;
+        if(j - i != 2)
+            locked[edges[i].first] = locked[edges[i].second] = 1;
+        i = j;
+    }
+    vector< pair<int,int> >().swap(edges);
+
+    //Triangles grouped by block
+    int nblocks = cells * cells * cells;
+    vector<size_t> start(nblocks + 1, 0);
+    for(size_t t=0; t<ntris; t++)
+        start[block[t] + 1]++;
+    for(int b=0; b<nblocks; b++)
+        start[b + 1] += start[b];
+    vector<int> order(ntris);
+    vector<size_t> fill(start.begin(), start.end() - 1);
+    for(size_t t=0; t<ntris; t++)
+        order[fill[block[t]]++] = t;
+
+    double keep = min(1.0, (double)target / ntris);
+    vector< vector<int> > kept(nblocks);
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int b=0; b<nblocks; b++)
+    {
+        size_t n = start[b + 1] - start[b];
+        if(n == 0)
+            continue;
+        BlockDecimator d(mesh, locked, &order[start[b]], n);
+        d.run((size_t)(n * keep + 0.5));
+        d.output(mesh, kept[b]);
+    }
+
+    mesh.triangles.clear();
+    for(int b=0; b<nblocks; b++)
+        mesh.triangles.insert(mesh.triangles.end(), kept[b].begin(), kept[b].end());
+}
+
+Mesh decimateMesh(const Mesh& input, size_t triangles, int threads)
+{
+    MetricTimer timer("lod/decimate");
+
+    ThreadCountScope scope(threads);
+
+    Mesh mesh = input;
+    decimatePass(mesh, triangles, 0);
+    if(mesh.triangleCount() > triangles)
+        decimatePass(mesh, triangles, 0.5);
+
+    //Drop the vertices no triangle uses any more
+    vector<int> index(mesh.vertices.size(), -1);
+    Mesh result;
+    for(size_t i=0; i<mesh.triangles.size(); i++)
+    {
+        int& v = index[mesh.triangles[i]];
+        if(v < 0)
+        {
+            v = result.vertices.size();
+            result.vertices.push_back(mesh.vertices[mesh.triangles[i]]);
+            result.colors.push_back(mesh.colors[mesh.triangles[i]]);
+        }
+        result.triangles.push_back(v);
+    }
+    return result;
+}
+
+vector<Mesh> buildMeshLod(const Mesh& mesh, const LodParams& params)
+{
+    vector<Mesh> lod(max(params.levels, 1));
+    lod.back() = mesh;
+    for(int l=(int)lod.size()-2; l>=0; l--)
+        lod[l] = decimateMesh(lod[l + 1], (size_t)(lod[l + 1].triangleCount() * params.ratio), params.threads);
+    return lod;
+}
+
+//File name of a level
+static string lodFilename(const string& basename, size_t level)
+{
+    ostringstream name;
+    name << basename << ".lod" << level << ".ply";
+    return name.str();
+}
+
+bool saveLodPLY(
+    const string& basename,
+    const PointLod& lod,
+    PlyFormat format)
+{
+    bool ok = true;
+    for(size_t l=0; l<lod.points.size(); l++)
+    {
+        PlyWriter out(lodFilename(basename, l), format);
+        for(size_t i=0; i<lod.points[l].size(); i++)
+            out.vertex(lod.points[l][i], lod.colors[l][i]);
+        ok = out.close() && ok;
+    }
+    return ok;
+}
+
+bool saveLodPLY(
+    const string& basename,
+    const vector<Mesh>& lod,
+    PlyFormat format)
+{
+    bool ok = true;
+    for(size_t l=0; l<lod.size(); l++)
+    {
+        PlyWriter out(lodFilename(basename, l), format, true);
+        for(size_t i=0; i<lod[l].vertices.size(); i++)
+            out.vertex(lod[l].vertices[i], lod[l].colors[i]);
+        for(size_t i=0; i+2<lod[l].triangles.size(); i+=3)
+            out.face(&lod[l].triangles[i], 3);
+        ok = out.close() && ok;
+    }
+    return ok;
+}
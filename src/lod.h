@@ -0,0 +1,83 @@
+//Level of detail output for viewers
+#ifndef LOD_H
+#define LOD_H
+
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "mesh.h"
+#include "ply.h"
+#include "system.h"
+#include "volume.h"
+
+//Level of detail parameters
+struct LodParams
+{
+    LodParams() :
+        levels(5),
+        depth(10),
+        ratio(0.25),
+        threads(0) {}
+
+    //Number of levels written, including the full resolution one
+    int levels;
+
+    //Octree depth of the finest point level, whose cells are 2^-depth of
+    //the bounding cube of the points (at most 21)
+    int depth;
+
+    //Fraction of the triangles kept by each coarser mesh level
+    double ratio;
+
+    //Number of threads, 0 to keep the current setting
+    int threads;
+};
+
+//Octree subsampled point cloud, level 0 is the coarsest.  Each point of a
+//level is the mean position and color of the input points in one octree
+//cell, levels are in Morton order.
+struct PointLod
+{
+    std::vector< std::vector<Eigen::Vector3d> > points;
+    std::vector< std::vector<Color> >           colors;
+};
+
+//Builds the levels of a point cloud
+extern PointLod buildPointLod(
+    const std::vector<Eigen::Vector3d>& points,
+    const std::vector<Color>& colors,
+    const LodParams& params = LodParams());
+
+//Builds the levels of the surface voxels of a volume, the finest level has
+//one point per surface voxel
+extern PointLod buildVolumeLod(
+    const Volume& volume,
+    const LodParams& params = LodParams());
+
+//Quadric error edge collapse down to about the given number of triangles.
+//  The mesh is cut into blocks decimated in parallel, vertices shared
+//  between blocks are kept in place.  A second pass over blocks offset by
+//  half a block then decimates the seams.  The block grid only depends on
+//  the mesh, so the output does not depend on the thread count.
+extern Mesh decimateMesh(const Mesh& mesh, size_t triangles, int threads = 0);
+
+//Repeatedly decimated meshes, level 0 is the coarsest and the last level
+//is the input mesh
+extern std::vector<Mesh> buildMeshLod(
+    const Mesh& mesh,
+    const LodParams& params = LodParams());
+
+//Writes each level to its own file, basename.lod0.ply being the coarsest,
+//so viewers can stream the coarse levels first
+extern bool saveLodPLY(
+    const std::string& basename,
+    const PointLod& lod,
+    PlyFormat format = PLY_BINARY);
+extern bool saveLodPLY(
+    const std::string& basename,
+    const std::vector<Mesh>& lod,
+    PlyFormat format = PLY_BINARY);
+
+#endif
@@ -1,4 +1,6 @@
 //STL
+#include <cstdlib>
+#include <iostream>
 #include <vector>
 #include <fstream>
 
@@ -6,21 +8,132 @@
 #include <Eigen/Core>
 
 //Project files
+#include "batch.h"
+#include "benchmark.h"
+#include "metrics.h"
+#include "params.h"
+#include "pipeline.h"
 #include "view.h"
 #include "sfm.h"
 #include "debug.h"
+#include "system.h"
 
 using namespace std;
 
 
+//Command line help
+static void usage(const char* program)
+{
+    cout << "Usage: " << program << " [options] config[:section]..." << endl
+         << "       " << program << " -benchmark results.json" << endl
+         << "  -j cores    cores shared by the datasets (default all)" << endl
+         << "  -m MB       memory budget (default 3/4 of physical memory)" << endl
+         << "  -o dir      output directory (default out)" << endl
+         << "  -mesh       also write surface meshes" << endl
+         << "  -cache dir  reuse stage outputs cached in dir, datasets run one at a time" << endl
+         << "  -bundler f  bundler script for datasets without cameras" << endl
+         << "  -metrics f  write stage timings and counters to f as JSON" << endl;
+}
 
 //Program start point
 int main(int argc, char** argv)
 {
-    vector<View> views = parseBundlerTemps("data/lincoln");
-    
-    saveCameraPLY("out/test.ply", views);
-    
-    return 0;
-}
+    if(argc < 2)
+    {
+        vector<View> views = parseBundlerTemps("data/lincoln");
+
+        saveCameraPLY("out/test.ply", views);
+
+        return 0;
+    }
+
+    BatchParams params;
+    vector<BatchJob> jobs;
+    string benchmark, metrics, cache, bundler;
+    for(int i=1; i<argc; i++)
+    {
+        string arg = argv[i];
+        bool value = i + 1 < argc;
+        if(arg == "-benchmark" && value)
+            benchmark = argv[++i];
+        else if(arg == "-metrics" && value)
+            metrics = argv[++i];
+        else if(arg == "-j" && value)
+            params.threads = atoi(argv[++i]);
+        else if(arg == "-m" && value)
+            params.memory = (size_t)atol(argv[++i]) << 20;
+        else if(arg == "-o" && value)
+            params.output = argv[++i];
+        else if(arg == "-cache" && value)
+            cache = argv[++i];
+        else if(arg == "-bundler" && value)
+            bundler = argv[++i];
+        else if(arg == "-mesh")
+            params.mesh = true;
+        else if(arg[0] == '-')
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            size_t colon = arg.rfind(':');
+            if(colon == string::npos)
+                jobs.push_back(BatchJob(arg));
+            else
+                jobs.push_back(BatchJob(arg.substr(0, colon), arg.substr(colon + 1)));
+        }
+    }
 
+    if(!metrics.empty())
+        enableMetrics();
+
+    int failed = 0;
+    if(!benchmark.empty())
+    {
+        ofstream json(benchmark.c_str());
+        failed = !runBenchmarks(json);
+    }
+    else if(!cache.empty())
+    {
+        for(size_t i=0; i<jobs.size(); i++)
+        {
+            PipelineParams pipeline;
+            pipeline.cache   = cache;
+            pipeline.threads = params.threads;
+            pipeline.mesh    = params.mesh;
+            if(!bundler.empty())
+                pipeline.bundler = bundler;
+
+            double start = wallTime();
+            bool ok = loadScanParams(jobs[i].config, pipeline.scan, jobs[i].section);
+            if(ok)
+            {
+                pipeline.output = params.output + "/" + batchOutputName(jobs[i], pipeline.scan.name);
+                ok = runPipeline(pipeline);
+            }
+
+            cout << (ok ? "ok     " : "FAILED ") << jobs[i].config;
+            if(!jobs[i].section.empty())
+                cout << ":" << jobs[i].section;
+            cout << "  " << wallTime() - start << "s" << endl;
+            failed += !ok;
+        }
+    }
+    else
+    {
+        vector<BatchResult> results = runBatch(jobs, params);
+        for(size_t i=0; i<results.size(); i++)
+        {
+            cout << (results[i].ok ? "ok     " : "FAILED ") << results[i].job.config;
+            if(!results[i].job.section.empty())
+                cout << ":" << results[i].job.section;
+            cout << "  " << results[i].seconds << "s" << endl;
+            failed += !results[i].ok;
+        }
+    }
+
+    if(!metrics.empty() && !saveMetrics(metrics))
+        failed++;
+    return failed > 0;
+}
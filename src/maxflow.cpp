@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+#include "maxflow.h"
+
+using namespace std;
+
+void GridGraph::reset(int n)
+{
+    nodes = n;
+    total = 0;
+    nbr.assign(6 * (size_t)n, -1);
+    cap.assign(6 * (size_t)n, 0.0f);
+    tr.assign(n, 0.0f);
+}
+
+//True if the edge between p and its neighbour k has residual capacity in the
+//direction the tree of p grows (away from the source, towards the sink)
+inline bool GridGraph::residual(int p, int k) const
+{
+    int q = nbr[6 * p + k];
+    if(q < 0)
+        return false;
+    return tree[p] == SOURCE_TREE ? cap[6 * p + k] > 0 : cap[6 * q + (k ^ 1)] > 0;
+}
+
+inline void GridGraph::activate(int p)
+{
+    if(!queued[p])
+    {
+        queued[p] = 1;
+        active.push_back(p);
+    }
+}
+
+inline void GridGraph::orphan(int p)
+{
+    parent[p] = ORPHAN;
+    orphans.push_back(p);
+}
+
+//Pushes the bottleneck flow along source -> ... -> s -> t -> ... -> sink,
+//where t is neighbour k of s.  Nodes whose parent edge saturates become orphans.
+void GridGraph::augment(int s, int t, int k)
+{
+    float f = cap[6 * s + k];
+
+    int i;
+    for(i=s; parent[i]!=TERMINAL; i=nbr[6 * i + parent[i]])
+        f = min(f, cap[6 * nbr[6 * i + parent[i]] + (parent[i] ^ 1)]);
+    f = min(f, tr[i]);
+    for(i=t; parent[i]!=TERMINAL; i=nbr[6 * i + parent[i]])
+        f = min(f, cap[6 * i + parent[i]]);
+    f = min(f, -tr[i]);
+
+    cap[6 * s + k]       -= f;
+    cap[6 * t + (k ^ 1)] += f;
+
+    //Source side, parent edges point towards i
+    for(i=s; parent[i]!=TERMINAL; )
+    {
+        int pk = parent[i], j = nbr[6 * i + pk];
+        cap[6 * j + (pk ^ 1)] -= f;
+        cap[6 * i + pk]       += f;
+        if(cap[6 * j + (pk ^ 1)] <= 0)
+            orphan(i);
+        i = j;
+    }
+    tr[i] -= f;
+    if(tr[i] <= 0)
+        orphan(i);
+
+    //Sink side, parent edges point away from i
+    for(i=t; parent[i]!=TERMINAL; )
+    {
+        int pk = parent[i], j = nbr[6 * i + pk];
+        cap[6 * i + pk]       -= f;
+        cap[6 * j + (pk ^ 1)] += f;
+        if(cap[6 * i + pk] <= 0)
+            orphan(i);
+        i = j;
+    }
+    tr[i] += f;
+    if(tr[i] >= 0)
+        orphan(i);
+
+    total += f;
+}
+
+//Finds new parents for orphans, or frees them along with their subtrees
+void GridGraph::adopt()
+{
+    while(!orphans.empty())
+    {
+        int p = orphans.front();
+        orphans.pop_front();
+
+        //Look for the neighbour closest to a terminal whose own path is intact
+        int best = -1, dmin = INT_MAX;
+        for(int k=0; k<6; k++)
+        {
+            int q = nbr[6 * p + k];
+            if(q < 0 || tree[q] != tree[p] ||
+                !(tree[p] == SOURCE_TREE ? cap[6 * q + (k ^ 1)] > 0 : cap[6 * p + k] > 0))
+                continue;
+
+            int d = 0, j = q;
+            for(;;)
+            {
+                if(ts[j] == time)
+                {
+                    d += dist[j];
+                    break;
+                }
+                d++;
+                if(parent[j] == TERMINAL)
+                {
+                    ts[j]   = time;
+                    dist[j] = 1;
+                    break;
+                }
+                if(parent[j] == ORPHAN || parent[j] == NO_PARENT)
+                {
+                    d = INT_MAX;
+                    break;
+                }
+                j = nbr[6 * j + parent[j]];
+            }
+
+            if(d == INT_MAX)
+                continue;
+            if(d < dmin)
+            {
+                dmin = d;
+                best = k;
+            }
+
+            //Cache distances along the path for the following orphans
+            for(j=q; ts[j]!=time; j=nbr[6 * j + parent[j]])
+            {
+                ts[j]   = time;
+                dist[j] = d--;
+            }
+        }
+
+        if(best >= 0)
+        {
+            parent[p] = best;
+            ts[p]     = time;
+            dist[p]   = dmin + 1;
+            continue;
+        }
+
+        //No parent, children become orphans and neighbours which could
+        //reach p again go back to growing
+        for(int k=0; k<6; k++)
+        {
+            int q = nbr[6 * p + k];
+            if(q < 0 || tree[q] != tree[p])
+                continue;
+            if(tree[p] == SOURCE_TREE ? cap[6 * q + (k ^ 1)] > 0 : cap[6 * p + k] > 0)
+                activate(q);
+            if(parent[q] < TERMINAL && nbr[6 * q + parent[q]] == p)
+                orphan(q);
+        }
+        tree[p]   = FREE;
+        parent[p] = NO_PARENT;
+    }
+}
+
+double GridGraph::maxflow()
+{
+    tree.assign(nodes, FREE);
+    parent.assign(nodes, NO_PARENT);
+    queued.assign(nodes, 0);
+    ts.assign(nodes, 0);
+    dist.assign(nodes, 0);
+    active.clear();
+    orphans.clear();
+    time = 0;
+
+    for(int i=0; i<nodes; i++)
+    {
+        if(tr[i] == 0)
+            continue;
+        tree[i]   = tr[i] > 0 ? SOURCE_TREE : SINK_TREE;
+        parent[i] = TERMINAL;
+        dist[i]   = 1;
+        activate(i);
+    }
+
+    while(!active.empty())
+    {
+        int p = active.front();
+        if(tree[p] == FREE)
+        {
+            active.pop_front();
+            queued[p] = 0;
+            continue;
+        }
+
+        //Grow the tree of p until it touches the other one
+        int s = -1, t = -1, k = 0;
+        for(int e=0; e<6; e++)
+        {
+            if(!residual(p, e))
+                continue;
+
+            int q = nbr[6 * p + e];
+            if(tree[q] == FREE)
+            {
+                tree[q]   = tree[p];
+                parent[q] = e ^ 1;
+                ts[q]     = ts[p];
+                dist[q]   = dist[p] + 1;
+                activate(q);
+            }
+            else if(tree[q] != tree[p])
+            {
+                if(tree[p] == SOURCE_TREE)
+                    s = p, t = q, k = e;
+                else
+                    s = q, t = p, k = e ^ 1;
+                break;
+            }
+            else if(ts[q] <= ts[p] && dist[q] > dist[p])
+            {
+                //Shorten the path of q through p
+                parent[q] = e ^ 1;
+                ts[q]     = ts[p];
+                dist[q]   = dist[p] + 1;
+            }
+        }
+
+        //p is done once it has no path left, otherwise it is grown again
+        if(s < 0)
+        {
+            active.pop_front();
+            queued[p] = 0;
+            continue;
+        }
+
+        time++;
+        augment(s, t, k);
+        adopt();
+    }
+
+    return total;
+}
@@ -0,0 +1,72 @@
+//Minimum cuts on 6-connected grid graphs
+#ifndef MAXFLOW_H
+#define MAXFLOW_H
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include "system.h"
+
+//Boykov-Kolmogorov max-flow specialized for 6-connected grids.
+//  Neighbour k of a node is reached by the opposite edge k ^ 1, so reverse
+//  edges never have to be stored or searched for.  Neighbour ids and residual
+//  capacities live in flat arrays of 6 per node, and the search trees keep a
+//  parent direction (one byte) instead of an edge pointer.
+struct GridGraph
+{
+    GridGraph() : nodes(0), total(0) {}
+    explicit GridGraph(int n) { reset(n); }
+
+    //Removes all edges and resizes the graph to n nodes
+    void reset(int n);
+
+    //Makes j neighbour k of node i (and i neighbour k ^ 1 of j), with
+    //capacity cij from i to j and cji back
+    void link(int i, int k, int j, float cij, float cji)
+    {
+        nbr[6 * i + k]       = j;
+        nbr[6 * j + (k ^ 1)] = i;
+        cap[6 * i + k]       = cij;
+        cap[6 * j + (k ^ 1)] = cji;
+    }
+
+    //Adds terminal capacities to node i
+    void terminal(int i, float source, float sink)
+    {
+        tr[i] += source - sink;
+        total += std::min(source, sink);
+    }
+
+    //Computes the maximum flow, returns its value
+    double maxflow();
+
+    //True if node i is on the source side of the minimum cut
+    bool source(int i) const { return tree[i] == SOURCE_TREE; }
+
+    int nodes;
+
+private:
+    enum { FREE, SOURCE_TREE, SINK_TREE };
+    enum { TERMINAL = 6, ORPHAN = 7, NO_PARENT = 8 };
+
+    bool residual(int p, int k) const;
+    void activate(int p);
+    void orphan(int p);
+    void augment(int s, int t, int k);
+    void adopt();
+
+    //Graph, neighbour ids are -1 where there is no edge
+    std::vector<int>    nbr;
+    std::vector<float>  cap;
+    std::vector<float>  tr;
+    double              total;
+
+    //Search trees
+    std::vector<ubyte>  tree, parent, queued;
+    std::vector<int>    ts, dist;
+    std::deque<int>     active, orphans;
+    int                 time;
+};
+
+#endif
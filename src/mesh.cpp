@@ -0,0 +1,421 @@
+//Surface nets mesh extraction.
+//  Samples sit at voxel centers and every cell between 8 samples with both
+//  inside and outside corners gets one vertex, at the mean of the crossings
+//  on its edges.  Each edge with a sign change then becomes a quad over the
+//  four cells around it.  Unlike marching cubes there are no case tables and
+//  vertices are shared between faces by construction.
+//
+//  The grid is cut into z slabs meshed in parallel.  A first pass counts the
+//  vertices of each cell layer, so every vertex has a global index known in
+//  advance (layers in order, cells in raster order within a layer).  A slab
+//  recomputes the indices of the layer just below it, stitching its faces to
+//  the previous slab without any merging afterwards, and the output does not
+//  depend on the number of threads.
+#include <algorithm>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/LU>
+
+#include "mesh.h"
+#include "metrics.h"
+#include "system.h"
+
+using namespace std;
+using namespace Eigen;
+
+//Sample states
+enum { OUTSIDE = 0, INSIDE = 1, UNKNOWN = 2 };
+
+//Samples of one z layer, padded by an outside sample on each side.  Rows
+//also keep the set of states found in them, so the runs of uniform rows
+//inside and outside the surface are skipped.
+struct FieldLayer
+{
+    FieldLayer(const Vector3i& dim) :
+        stride(dim.x() + 2),
+        state(stride * (dim.y() + 2), (ubyte)OUTSIDE),
+        value(state.size(), 1.0f),
+        color(state.size(), Color(0,0,0)),
+        rows(dim.y() + 2, 1 << OUTSIDE) {}
+
+    //Sets every sample outside
+    void clear()
+    {
+        std::fill(state.begin(), state.end(), (ubyte)OUTSIDE);
+        std::fill(value.begin(), value.end(), 1.0f);
+        std::fill(color.begin(), color.end(), Color(0,0,0));
+    }
+
+    //Index of sample (x, y), x and y are in [-1, dim]
+    int index(int x, int y) const { return (x + 1) + (y + 1) * stride; }
+
+    //Updates the row states after the samples changed
+    void summarize()
+    {
+        for(size_t y=1; y+1<rows.size(); y++)
+        {
+            const ubyte* s = &state[y * stride];
+            int flags = 0;
+            for(int x=1; x<stride-1; x++)
+                flags |= 1 << s[x];
+            rows[y] = flags;
+        }
+    }
+
+    int                 stride;
+    std::vector<ubyte>  state;
+    std::vector<float>  value;          //<= 0 inside
+    std::vector<Color>  color;
+    std::vector<int>    rows;           //Bit set of the states in each row, padding excluded
+};
+
+//Scalar field over a voxel grid
+struct MeshField
+{
+    MeshField(const Vector3i& dim_) : dim(dim_) {}
+    virtual ~MeshField() {}
+
+    //Fills the samples of layer z, which may be outside the grid.  The
+    //padding is never written and stays outside.
+    virtual void sample(int z, FieldLayer& layer) const = 0;
+
+    void sampleLayer(int z, FieldLayer& layer) const
+    {
+        sample(z, layer);
+        layer.summarize();
+    }
+
+    Vector3i dim;
+};
+
+//Occupancy of a volume, non-black voxels are inside
+struct VolumeField : MeshField
+{
+    VolumeField(const Volume& volume_) : MeshField(volume_.size()), volume(volume_) {}
+
+    void sample(int z, FieldLayer& layer) const
+    {
+        if(z < 0 || z >= dim.z())
+        {
+            layer.clear();
+            return;
+        }
+
+        //Read whole brick rows
+        for(int y=0; y<dim.y(); y++)
+        for(int bx=0; bx<volume.brickDims().x(); bx++)
+        {
+            const Color* row = volume.brick(Vector3i(bx, y >> Volume::BRICK_BITS, z >> Volume::BRICK_BITS)) +
+                Volume::BRICK_SIZE * ((y & Volume::BRICK_MASK) + Volume::BRICK_SIZE * (z & Volume::BRICK_MASK));
+            int x0 = bx * Volume::BRICK_SIZE, x1 = min(x0 + (int)Volume::BRICK_SIZE, dim.x());
+            int i  = layer.index(x0, y);
+            for(int x=x0; x<x1; x++, i++)
+            {
+                const Color& c = row[x & Volume::BRICK_MASK];
+                bool inside = !(c == Color(0,0,0));
+                layer.state[i] = inside ? INSIDE : OUTSIDE;
+                layer.value[i] = inside ? -1.0f : 1.0f;
+                layer.color[i] = c;
+            }
+        }
+    }
+
+    const Volume& volume;
+};
+
+//Signed distance of a TSDF, unobserved voxels are unknown
+struct TsdfField : MeshField
+{
+    TsdfField(const TsdfVolume& tsdf_) : MeshField(tsdf_.size()), tsdf(tsdf_) {}
+
+    void sample(int z, FieldLayer& layer) const
+    {
+        if(z < 0 || z >= dim.z())
+        {
+            layer.clear();
+            return;
+        }
+
+        for(int y=0; y<dim.y(); y++)
+        for(int x=0; x<dim.x(); x++)
+        {
+            Vector3i p(x, y, z);
+            int i = layer.index(x, y);
+            if(tsdf.weight(p) <= 0)
+            {
+                layer.state[i] = UNKNOWN;
+                layer.value[i] = 1.0f;
+                layer.color[i] = Color(0,0,0);
+                continue;
+            }
+            float d = tsdf.sdf(p);
+            layer.state[i] = d <= 0 ? INSIDE : OUTSIDE;
+            layer.value[i] = d;
+            layer.color[i] = tsdf.color(p);
+        }
+    }
+
+    const TsdfVolume& tsdf;
+};
+
+//Extraction state shared by the slabs
+struct SurfaceNets
+{
+    SurfaceNets(const MeshField& field_, const Transform3d& xform, Mesh& mesh_) :
+        field(field_),
+        mesh(mesh_),
+        dim(field_.dim),
+        cstride(dim.x() + 1),
+        cells(cstride * (dim.y() + 1))
+    {
+        //Voxel -> world, voxel centers are at +0.5
+        Matrix4d W = xform.matrix().inverse();
+        R = W.block(0,0,3,3);
+        T = W.block(0,3,3,1) + R * Vector3d(0.5, 0.5, 0.5);
+    }
+
+    //Index of cell (x, y) in a layer map, x and y are in [-1, dim)
+    int cell(int x, int y) const { return (x + 1) + (y + 1) * cstride; }
+
+    //Assigns indices first, first + 1, ... to the active cells of layer z,
+    //given the samples of layers z and z + 1.  Writes their vertices if
+    //asked to, returns the number of active cells.
+    int buildCells(int z, const FieldLayer& s0, const FieldLayer& s1, vector<int>& map, int first, bool write)
+    {
+        int id = first;
+        for(int y=-1; y<dim.y(); y++)
+        {
+            //Rows of one state only have active cells next to the padding
+            int flags = s0.rows[y + 1] | s0.rows[y + 2] | s1.rows[y + 1] | s1.rows[y + 2];
+            if(flags == 1 << OUTSIDE || flags == 1 << UNKNOWN || flags == 1 << INSIDE)
+            {
+                std::fill(&map[cell(-1, y)], &map[cell(-1, y)] + cstride, -1);
+                if(flags == 1 << INSIDE)
+                {
+                    buildCell(-1, y, z, s0, s1, map, id, write);
+                    buildCell(dim.x() - 1, y, z, s0, s1, map, id, write);
+                }
+                continue;
+            }
+
+            for(int x=-1; x<dim.x(); x++)
+                buildCell(x, y, z, s0, s1, map, id, write);
+        }
+        return id - first;
+    }
+
+    //Indexes cell (x, y) if active
+    void buildCell(int x, int y, int z, const FieldLayer& s0, const FieldLayer& s1, vector<int>& map, int& id, bool write)
+    {
+        int s = s0.index(x, y), c = cell(x, y);
+        int corner[8] = { s, s + 1, s + s0.stride, s + s0.stride + 1, s, s + 1, s + s0.stride, s + s0.stride + 1 };
+
+        int in = 0, unknown = 0;
+        for(int k=0; k<8; k++)
+        {
+            ubyte st = (k < 4 ? s0 : s1).state[corner[k]];
+            in      |= (st == INSIDE) << k;
+            unknown |= (st == UNKNOWN) << k;
+        }
+        if(in == 0 || in == 0xff || unknown)
+        {
+            map[c] = -1;
+            return;
+        }
+
+        map[c] = id;
+        if(write)
+            vertex(id, x, y, z, s0, s1, corner, in);
+        id++;
+    }
+
+    //Places the vertex of a cell at the mean edge crossing
+    void vertex(int id, int x, int y, int z, const FieldLayer& s0, const FieldLayer& s1, const int* corner, int in)
+    {
+        float f[8];
+        int   sum[3] = { 0, 0, 0 }, n = 0;
+        for(int k=0; k<8; k++)
+        {
+            const FieldLayer& l = k < 4 ? s0 : s1;
+            f[k] = l.value[corner[k]];
+            const Color& c = l.color[corner[k]];
+            if(c == Color(0,0,0))
+                continue;
+            sum[0] += c.r; sum[1] += c.g; sum[2] += c.b;
+            n++;
+        }
+
+        Vector3d p(0,0,0);
+        int crossings = 0;
+        for(int k=0; k<8; k++)
+        for(int a=0; a<3; a++)
+        {
+            int j = k | (1 << a);
+            if(j == k || ((in >> k) & 1) == ((in >> j) & 1))
+                continue;
+            float t = f[k] / (f[k] - f[j]);
+            Vector3d q(k & 1, (k >> 1) & 1, k >> 2);
+            q[a] = t < 0 ? 0 : (t > 1 ? 1 : t);
+            p += q;
+            crossings++;
+        }
+        p = p / crossings + Vector3d(x, y, z);
+
+        mesh.vertices[id] = R * p + T;
+        mesh.colors[id] = n ? Color(sum[0] / n, sum[1] / n, sum[2] / n) : Color(255, 255, 255);
+    }
+
+    //Emits a quad over four cells, wound so its normal points outward
+    static void quad(vector<int>& out, bool flip, int a, int b, int c, int d)
+    {
+        if(a < 0 || b < 0 || c < 0 || d < 0)
+            return;
+        if(flip)
+            std::swap(b, d);
+        out.push_back(a); out.push_back(b); out.push_back(c);
+        out.push_back(a); out.push_back(c); out.push_back(d);
+    }
+
+    //Faces for the edges leaving the samples of layer z, between the cells
+    //of layers z - 1 (prev) and z (cur)
+    void faces(const FieldLayer& s0, const FieldLayer& s1,
+        const vector<int>& prev, const vector<int>& cur, vector<int>& out)
+    {
+        for(int y=-1; y<=dim.y(); y++)
+        {
+            int flags = s0.rows[y + 1] | s1.rows[y + 1] | (y < dim.y() ? s0.rows[y + 2] : 1 << OUTSIDE);
+            if(flags == 1 << OUTSIDE || flags == 1 << UNKNOWN || flags == 1 << INSIDE)
+            {
+                if(flags == 1 << INSIDE)
+                {
+                    edges(-1, y, s0, s1, prev, cur, out);
+                    edges(dim.x() - 1, y, s0, s1, prev, cur, out);
+                }
+                continue;
+            }
+
+            for(int x=-1; x<=dim.x(); x++)
+                edges(x, y, s0, s1, prev, cur, out);
+        }
+    }
+
+    //Faces for the three edges leaving sample (x, y)
+    void edges(int x, int y, const FieldLayer& s0, const FieldLayer& s1,
+        const vector<int>& prev, const vector<int>& cur, vector<int>& out)
+    {
+        int s = s0.index(x, y);
+        ubyte a = s0.state[s], b;
+        if(a == UNKNOWN)
+            return;
+        bool flip = a != INSIDE;
+
+        //Cells around each edge in the cyclic order of the other two axes
+        if(x < dim.x() && (b = s0.state[s + 1]) != UNKNOWN && b != a)
+            quad(out, flip, prev[cell(x, y - 1)], prev[cell(x, y)], cur[cell(x, y)], cur[cell(x, y - 1)]);
+        if(y < dim.y() && (b = s0.state[s + s0.stride]) != UNKNOWN && b != a)
+            quad(out, flip, prev[cell(x - 1, y)], cur[cell(x - 1, y)], cur[cell(x, y)], prev[cell(x, y)]);
+        if((b = s1.state[s]) != UNKNOWN && b != a)
+            quad(out, flip, cur[cell(x - 1, y - 1)], cur[cell(x, y - 1)], cur[cell(x, y)], cur[cell(x - 1, y)]);
+    }
+
+    const MeshField&    field;
+    Mesh&               mesh;
+    Vector3i            dim;
+    int                 cstride;
+    size_t              cells;
+    Matrix3d            R;
+    Vector3d            T;
+};
+
+//Meshes a field, layers -1 .. dim.z - 1 of cells and samples are split into
+//slabs processed in parallel
+static Mesh surfaceNets(const MeshField& field, const Transform3d& xform, int threads)
+{
+    ThreadCountScope scope(threads);
+
+    Mesh mesh;
+    SurfaceNets nets(field, xform, mesh);
+
+    int layers = field.dim.z() + 1;
+    int nslabs = min(layers, 4 * threadCount());
+    vector<int> counts(layers, 0);
+
+    //Count the vertices of each cell layer
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int k=0; k<nslabs; k++)
+    {
+        int z0 = layers * k / nslabs - 1, z1 = layers * (k + 1) / nslabs - 1;
+        FieldLayer  la(field.dim), lb(field.dim), *s0 = &la, *s1 = &lb;
+        vector<int> map(nets.cells);
+
+        field.sampleLayer(z0, *s0);
+        for(int z=z0; z<z1; z++)
+        {
+            field.sampleLayer(z + 1, *s1);
+            counts[z + 1] = nets.buildCells(z, *s0, *s1, map, 0, false);
+            std::swap(s0, s1);
+        }
+    }
+
+    vector<int> offsets(layers + 1, 0);
+    for(int z=0; z<layers; z++)
+        offsets[z + 1] = offsets[z] + counts[z];
+    mesh.vertices.resize(offsets[layers]);
+    mesh.colors.resize(offsets[layers]);
+
+    //Place the vertices and connect them, each slab also rebuilds the cell
+    //indices of the layer below it
+    vector< vector<int> > triangles(nslabs);
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int k=0; k<nslabs; k++)
+    {
+        int z0 = layers * k / nslabs - 1, z1 = layers * (k + 1) / nslabs - 1;
+        FieldLayer  la(field.dim), lb(field.dim), *s0 = &la, *s1 = &lb;
+        vector<int> prev(nets.cells, -1), cur(nets.cells);
+
+        if(z0 > -1)
+        {
+            field.sampleLayer(z0 - 1, *s0);
+            field.sampleLayer(z0, *s1);
+            nets.buildCells(z0 - 1, *s0, *s1, prev, offsets[z0], false);
+            std::swap(s0, s1);
+        }
+        else
+            field.sampleLayer(z0, *s0);
+
+        for(int z=z0; z<z1; z++)
+        {
+            field.sampleLayer(z + 1, *s1);
+            nets.buildCells(z, *s0, *s1, cur, offsets[z + 1], true);
+            nets.faces(*s0, *s1, prev, cur, triangles[k]);
+            std::swap(prev, cur);
+            std::swap(s0, s1);
+        }
+    }
+
+    size_t ntriangles = 0;
+    for(int k=0; k<nslabs; k++)
+        ntriangles += triangles[k].size();
+    mesh.triangles.reserve(ntriangles);
+    for(int k=0; k<nslabs; k++)
+    {
+        mesh.triangles.insert(mesh.triangles.end(), triangles[k].begin(), triangles[k].end());
+        vector<int>().swap(triangles[k]);
+    }
+
+    return mesh;
+}
+
+Mesh meshVolume(const Volume& volume, int threads)
+{
+    MetricTimer timer("mesh");
+    return surfaceNets(VolumeField(volume), volume.xform(), threads);
+}
+
+Mesh meshTsdf(const TsdfVolume& tsdf, int threads)
+{
+    MetricTimer timer("mesh");
+    return surfaceNets(TsdfField(tsdf), tsdf.xform(), threads);
+}
@@ -0,0 +1,40 @@
+//Surface extraction from voxel grids
+#ifndef MESH_H
+#define MESH_H
+
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "ply.h"
+#include "system.h"
+#include "tsdf.h"
+#include "volume.h"
+
+//Indexed triangle mesh with per-vertex colors, in world coordinates
+struct Mesh
+{
+    std::vector<Eigen::Vector3d>    vertices;
+    std::vector<Color>              colors;
+    std::vector<int>                triangles;      //3 vertex indices per triangle
+
+    size_t triangleCount() const { return triangles.size() / 3; }
+
+    //Returns false if writing failed
+    bool save(const std::string& filename, PlyFormat format = PLY_BINARY) const
+    {
+        return savePLY(filename, vertices, colors, triangles, format);
+    }
+};
+
+//Extracts the boundary of the non-empty voxels of a volume.  The mesh is
+//closed, voxels outside the grid count as empty.  Vertex colors average the
+//non-empty voxels around them.
+extern Mesh meshVolume(const Volume& volume, int threads = 0);
+
+//Extracts the zero crossing of a TSDF.  Only cells whose corners have all
+//been observed produce a surface, so the mesh is open where the band ends.
+extern Mesh meshTsdf(const TsdfVolume& tsdf, int threads = 0);
+
+#endif
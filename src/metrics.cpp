@@ -0,0 +1,164 @@
+//STL
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+
+//Project files
+#include "metrics.h"
+#include "system.h"
+
+using namespace std;
+
+volatile bool metrics_enabled = false;
+
+static const char* COUNTER_NAMES[METRIC_COUNTERS] =
+{
+    "voxels_tested",
+    "voxels_carved",
+    "views_sampled",
+    "pixels_read"
+};
+
+//Totals of a stage
+struct StageMetrics
+{
+    StageMetrics() : calls(0), seconds(0), longest(0), peak_memory(0) {}
+
+    string  name;
+    size_t  calls;
+    double  seconds, longest;
+    size_t  peak_memory;
+};
+
+//Everything below is guarded by metrics_lock.  Counter blocks are never
+//freed, threads keep pointers to them.
+static pthread_mutex_t              metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+static vector<MetricCounters*>      thread_counters;
+static vector<StageMetrics>         stages;
+static map<string, size_t>          stage_index;
+static double                       metrics_start = 0;
+
+static __thread MetricCounters*     local_counters = NULL;
+
+MetricCounters::MetricCounters()
+{
+    fill(count, count + METRIC_COUNTERS, 0);
+}
+
+void enableMetrics(bool on)
+{
+    pthread_mutex_lock(&metrics_lock);
+    if(on)
+    {
+        for(size_t t=0; t<thread_counters.size(); t++)
+            *thread_counters[t] = MetricCounters();
+        stages.clear();
+        stage_index.clear();
+        metrics_start = wallTime();
+    }
+    metrics_enabled = on;
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+MetricCounters& threadMetrics()
+{
+    if(!local_counters)
+    {
+        local_counters = new MetricCounters();
+        pthread_mutex_lock(&metrics_lock);
+        thread_counters.push_back(local_counters);
+        pthread_mutex_unlock(&metrics_lock);
+    }
+    return *local_counters;
+}
+
+void recordStage(const char* name, double seconds)
+{
+    size_t memory = peakMemory();
+
+    pthread_mutex_lock(&metrics_lock);
+    map<string, size_t>::iterator i = stage_index.find(name);
+    if(i == stage_index.end())
+    {
+        i = stage_index.insert(make_pair(string(name), stages.size())).first;
+        stages.push_back(StageMetrics());
+        stages.back().name = name;
+    }
+
+    StageMetrics& s = stages[i->second];
+    s.calls++;
+    s.seconds    += seconds;
+    s.longest     = max(s.longest, seconds);
+    s.peak_memory = max(s.peak_memory, memory);
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+void writeMetrics(ostream& json)
+{
+    pthread_mutex_lock(&metrics_lock);
+
+    json << "{\n"
+         << "  \"seconds\": " << wallTime() - metrics_start << ",\n"
+         << "  \"peak_memory\": " << peakMemory() << ",\n"
+         << "  \"stages\": [";
+    for(size_t i=0; i<stages.size(); i++)
+    {
+        const StageMetrics& s = stages[i];
+        json << (i ? ",\n" : "\n")
+             << "    { \"name\": \"" << s.name << "\""
+             << ", \"calls\": " << s.calls
+             << ", \"seconds\": " << s.seconds
+             << ", \"longest\": " << s.longest
+             << ", \"peak_memory\": " << s.peak_memory << " }";
+    }
+    json << "\n  ],\n";
+
+    //Threads that never counted anything are left out
+    MetricCounters total;
+    vector<const MetricCounters*> active;
+    for(size_t t=0; t<thread_counters.size(); t++)
+    {
+        const MetricCounters& c = *thread_counters[t];
+        bool any = false;
+        for(int k=0; k<METRIC_COUNTERS; k++)
+        {
+            total.count[k] += c.count[k];
+            any = any || c.count[k];
+        }
+        if(any)
+            active.push_back(&c);
+    }
+
+    json << "  \"counters\": {";
+    for(int k=0; k<METRIC_COUNTERS; k++)
+        json << (k ? ", " : " ") << "\"" << COUNTER_NAMES[k] << "\": " << total.count[k];
+    json << " },\n"
+         << "  \"threads\": [";
+    for(size_t t=0; t<active.size(); t++)
+    {
+        json << (t ? ",\n" : "\n") << "    {";
+        for(int k=0; k<METRIC_COUNTERS; k++)
+            json << (k ? ", " : " ") << "\"" << COUNTER_NAMES[k] << "\": " << active[t]->count[k];
+        json << " }";
+    }
+    json << "\n  ]\n}" << endl;
+
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+bool saveMetrics(const string& filename)
+{
+    ofstream json(filename.c_str());
+    if(!json)
+    {
+        cout << "Could not write metrics to " << filename << endl;
+        return false;
+    }
+    writeMetrics(json);
+    return !json.fail();
+}
@@ -0,0 +1,80 @@
+//Run metrics: stage timers, per thread counters and peak memory.
+//  Metrics are off until enableMetrics() is called, until then a timer or a
+//  counter costs one test of a global flag.  Counters are kept per thread
+//  with no locking, so count per batch of work rather than per voxel.
+//  Timers take a lock when they stop, use them for stages, not kernels.
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <ostream>
+#include <string>
+
+#include "system.h"
+
+//Counted quantities
+enum MetricCounter
+{
+    METRIC_VOXELS_TESTED,   //Consistency tests
+    METRIC_VOXELS_CARVED,   //Voxels removed
+    METRIC_VIEWS_SAMPLED,   //Views a tested voxel was projected into
+    METRIC_PIXELS_READ,     //Pixels read by the consistency tests
+    METRIC_COUNTERS
+};
+
+//Counters of one thread, a cache line apart from those of other threads
+struct MetricCounters
+{
+    MetricCounters();
+
+    size_t  count[METRIC_COUNTERS];
+    char    pad[64];
+};
+
+extern volatile bool metrics_enabled;
+
+//Turns metrics on (clearing what was collected before) or off
+extern void enableMetrics(bool on = true);
+inline bool metricsEnabled() { return metrics_enabled; }
+
+//Counters of the calling thread
+extern MetricCounters& threadMetrics();
+
+//Adds to a counter of the calling thread
+inline void countMetric(MetricCounter counter, size_t n)
+{
+    if(metrics_enabled)
+        threadMetrics().count[counter] += n;
+}
+
+//Adds the time of one run of a stage, and notes the peak memory use so far
+extern void recordStage(const char* name, double seconds);
+
+//Times a stage from construction to destruction.  Stages may nest, name
+//them "outer/inner" to keep them apart in the output.
+struct MetricTimer
+{
+    explicit MetricTimer(const char* stage) :
+        name(metrics_enabled ? stage : NULL),
+        start(name ? wallTime() : 0) {}
+    ~MetricTimer()
+    {
+        if(name)
+            recordStage(name, wallTime() - start);
+    }
+
+private:
+    MetricTimer(const MetricTimer&);
+    void operator=(const MetricTimer&);
+
+    const char* name;
+    double      start;
+};
+
+//Writes the metrics collected since enableMetrics() as JSON: wall time,
+//peak resident memory, each stage (calls, total and longest seconds, peak
+//memory at its end) in order of first use, counter totals and the
+//counters of each thread
+extern void writeMetrics(std::ostream& json);
+extern bool saveMetrics(const std::string& filename);
+
+#endif
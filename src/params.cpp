@@ -0,0 +1,159 @@
+#include <iostream>
+#include <string>
+
+#include <Eigen/Core>
+
+#include "params.h"
+
+using namespace std;
+using namespace Eigen;
+
+//Keys resolveParams understands
+static const char* SCAN_KEYS[] =
+{
+    "low", "high", "views_file", "volume_resolution",
+    "photohull_threshold", "approx_consistency_threshold", "approx_pad",
+    "threads", "levels", "margin", "max_passes", "worklist", "visual_hull",
+    "deterministic", "checkpoint", "checkpoint_interval"
+};
+
+//Reads an optional key, false if it is present but malformed
+template<class T>
+static bool optional(const cfg::config& section, const char* key, T& out)
+{
+    if(!section.has(key) || section.lookup(key, out))
+        return true;
+    cout << "Bad value for " << key << " in [" << section.getName() << "]" << endl;
+    return false;
+}
+
+static bool optional(const cfg::config& section, const char* key, Vector3d& out)
+{
+    cfg::vec3 v = out.cast<float>();
+    if(!optional(section, key, v))
+        return false;
+    out = v.cast<double>();
+    return true;
+}
+
+//Checks a condition on a resolved value
+static bool check(bool ok, const cfg::config& section, const char* key, const char* what)
+{
+    if(!ok)
+        cout << key << " in [" << section.getName() << "] must be " << what << endl;
+    return ok;
+}
+
+bool resolveParams(const cfg::config& section, ScanParams& params)
+{
+    for(cfg::config::data_map::const_iterator i=section.dataBegin(); i!=section.dataEnd(); ++i)
+    {
+        bool known = false;
+        for(size_t k=0; k<sizeof(SCAN_KEYS)/sizeof(SCAN_KEYS[0]) && !known; k++)
+            known = i->first == SCAN_KEYS[k];
+        if(!known)
+            cout << "Ignoring unknown setting " << i->first << " in [" << section.getName() << "]" << endl;
+    }
+
+    PhotoHullParams& ph = params.photohull;
+    bool ok =
+        optional(section, "low", params.low) &&
+        optional(section, "high", params.high) &&
+        optional(section, "views_file", params.views_file) &&
+        optional(section, "volume_resolution", params.resolution) &&
+        optional(section, "photohull_threshold", ph.threshold) &&
+        optional(section, "approx_consistency_threshold", ph.approx_threshold) &&
+        optional(section, "approx_pad", ph.approx_pad) &&
+        optional(section, "threads", ph.threads) &&
+        optional(section, "levels", ph.levels) &&
+        optional(section, "margin", ph.margin) &&
+        optional(section, "max_passes", ph.max_passes) &&
+        optional(section, "worklist", ph.worklist) &&
+        optional(section, "visual_hull", ph.visual_hull) &&
+        optional(section, "deterministic", ph.deterministic) &&
+        optional(section, "checkpoint", ph.checkpoint) &&
+        optional(section, "checkpoint_interval", ph.checkpoint_interval);
+    if(!ok)
+        return false;
+
+    return
+        check(params.low.x() < params.high.x() && params.low.y() < params.high.y() &&
+            params.low.z() < params.high.z(), section, "low", "below high") &&
+        check(params.resolution > 0, section, "volume_resolution", "positive") &&
+        check(ph.threshold.minCoeff() >= 0, section, "photohull_threshold", "non-negative") &&
+        check(ph.approx_threshold.minCoeff() >= 0, section, "approx_consistency_threshold", "non-negative") &&
+        check(ph.threads >= 0, section, "threads", "non-negative") &&
+        check(ph.levels > 0, section, "levels", "positive") &&
+        check(ph.margin >= 0, section, "margin", "non-negative") &&
+        check(ph.max_passes >= 0, section, "max_passes", "non-negative") &&
+        check(ph.checkpoint_interval > 0, section, "checkpoint_interval", "positive");
+}
+
+//Follows [global] config_file at most this many times
+static const int MAX_CONFIG_INCLUDES = 8;
+
+static bool loadScanParams(
+    const string& filename,
+    ScanParams& params,
+    const string& section,
+    int depth)
+{
+    cfg::config root;
+    if(!root.load(filename))
+        return false;
+
+    //Paths in the file are relative to it
+    size_t slash = filename.rfind('/');
+    string dir = slash == string::npos ? "" : filename.substr(0, slash + 1);
+
+    const cfg::config* global = root.child("global");
+    string include;
+    if((section.empty() || !root.child(section)) && global && global->lookup("config_file", include))
+    {
+        if(depth >= MAX_CONFIG_INCLUDES)
+        {
+            cout << "Too many nested config files at " << filename << endl;
+            return false;
+        }
+        return loadScanParams(dir + include, params, section, depth + 1);
+    }
+
+    const cfg::config* chosen = NULL;
+    if(!section.empty())
+        chosen = root.child(section);
+    else
+    {
+        int count = 0;
+        for(cfg::config::child_map::const_iterator i=root.childBegin(); i!=root.childEnd(); ++i)
+            if(i->first != "global")
+            {
+                chosen = &i->second;
+                count++;
+            }
+        if(count > 1)
+        {
+            cout << filename << " holds several datasets, pick one" << endl;
+            return false;
+        }
+    }
+    if(!chosen)
+    {
+        cout << "No dataset " << section << " in " << filename << endl;
+        return false;
+    }
+
+    params.name = chosen->getName();
+    if(!resolveParams(*chosen, params))
+        return false;
+    if(!params.views_file.empty() && params.views_file[0] != '/')
+        params.views_file = dir + params.views_file;
+    return true;
+}
+
+bool loadScanParams(
+    const string& filename,
+    ScanParams& params,
+    const string& section)
+{
+    return loadScanParams(filename, params, section, 0);
+}
@@ -0,0 +1,51 @@
+//Typed settings resolved from configuration files
+#ifndef PARAMS_H
+#define PARAMS_H
+
+#include <string>
+
+#include <Eigen/Core>
+
+#include "config.h"
+#include "stereo.h"
+
+//Settings of one dataset.  Config values are parsed and checked once, the
+//engines only ever see these structs.
+struct ScanParams
+{
+    ScanParams() :
+        low(-1, -1, -1),
+        high(1, 1, 1),
+        resolution(100) {}
+
+    //Config section the settings came from
+    std::string name;
+
+    //Bundler directory or camera file (see loadDatasetViews), relative to
+    //the config file it was named in
+    std::string views_file;
+
+    //Bounding box of the scene
+    Eigen::Vector3d low, high;
+
+    //Voxels along each axis
+    int resolution;
+    Eigen::Vector3i dims() const { return Eigen::Vector3i::Constant(resolution); }
+
+    PhotoHullParams photohull;
+};
+
+//Resolves a config section, keys it does not set keep their defaults.
+//Returns false (and says why) if a value is malformed or out of range.
+extern bool resolveParams(const cfg::config& section, ScanParams& params);
+
+//Loads the settings of a dataset from a config file.  If the file does not
+//have the section, [global] config_file (relative to the file) may point at
+//the file to use.  Without a section name the file must hold a single
+//dataset section.
+extern bool loadScanParams(
+    const std::string& filename,
+    ScanParams& params,
+    const std::string& section = "");
+
+#endif
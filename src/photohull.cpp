@@ -0,0 +1,781 @@
+//Multithreaded space carving (photo hull) engine
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <Eigen/Core>
+
+#include "stereo.h"
+#include "carve.h"
+#include "checkpoint.h"
+#include "consistency.h"
+#include "metrics.h"
+#include "system.h"
+
+using namespace std;
+using namespace Eigen;
+
+//Passes stay full until one removes less than 1 / WORKLIST_RATIO of the
+//voxels it tests
+static const size_t WORKLIST_RATIO = 16;
+
+//Voxels which have to be tested again after part of the volume was carved.
+//  A voxel is queued when a neighbour is carved (it may have become surface)
+//  or when it is the first solid voxel behind a carved one in some view (it
+//  may have become visible).  Flags keep each list free of duplicates.  The
+//  number of interior voxels per brick lets rays skip empty space.
+struct Worklist
+{
+    enum { PASS = 1, NEXT = 2, SWEEP = 4 };
+    enum { B = Volume::BRICK_BITS };
+
+    Worklist(const Volume& volume) :
+        dim(volume.size()),
+        bdim(volume.brickDims()),
+        full(true),
+        flags((size_t)dim.x() * dim.y() * dim.z(), 0),
+        bricks((size_t)bdim.x() * bdim.y() * bdim.z(), 0)
+    {
+        for(int z=0; z<dim.z(); z++)
+        for(int y=0; y<dim.y(); y++)
+        for(int x=0; x<dim.x(); x++)
+            if(volume.interior(Vector3i(x, y, z)))
+                bricks[brick(Vector3i(x, y, z))]++;
+    }
+
+    unsigned id(const Vector3i& p) const
+    {
+        return p.x() + dim.x() * (p.y() + dim.y() * p.z());
+    }
+    Vector3i voxel(unsigned id) const
+    {
+        return Vector3i(id % dim.x(), (id / dim.x()) % dim.y(), id / (dim.x() * dim.y()));
+    }
+    size_t brick(const Vector3i& p) const
+    {
+        return (p.x() >> B) + bdim.x() * ((size_t)(p.y() >> B) + bdim.y() * (p.z() >> B));
+    }
+
+    //Position of voxel id in the sweep order of direction d
+    int order(unsigned id, int d) const
+    {
+        int c = voxel(id)[N_DIM[d]];
+        return N_SGN[d] > 0 ? c : dim[N_DIM[d]] - 1 - c;
+    }
+
+    //Queues a voxel for the next pass and, unless the current pass is a full
+    //one, for the rest of this pass and this sweep (if its plane is ahead)
+    void push(unsigned id)
+    {
+        ubyte& f = flags[id];
+        if(!(f & NEXT))
+        {
+            f |= NEXT;
+            next.push_back(id);
+        }
+        if(full)
+            return;
+        if(!(f & PASS))
+        {
+            f |= PASS;
+            pass.push_back(id);
+        }
+        if(!(f & SWEEP) && order(id, direction) > plane)
+        {
+            f |= SWEEP;
+            planes[order(id, direction)].push_back(id);
+        }
+    }
+
+    //Steps from x along dir (one voxel along its major axis per step) for
+    //at most steps steps.  Returns true and sets hit at the first interior
+    //voxel, empty bricks are crossed in one go.
+    bool march(const Volume& volume, Vector3d x, const Vector3d& dir, int steps, Vector3i& hit) const
+    {
+        for(int i=0; i<steps; )
+        {
+            x += dir;
+            i++;
+
+            Vector3i q((int)floor(x.x()), (int)floor(x.y()), (int)floor(x.z()));
+            if(q.x() < 0 || q.y() < 0 || q.z() < 0 ||
+                q.x() >= dim.x() || q.y() >= dim.y() || q.z() >= dim.z())
+                return false;
+
+            if(bricks[brick(q)] > 0)
+            {
+                if(volume.interior(q))
+                {
+                    hit = q;
+                    return true;
+                }
+                continue;
+            }
+
+            //Jump to the last step inside this brick
+            double t = 1e30;
+            for(int k=0; k<3; k++)
+            {
+                double lo = (q[k] >> B) << B;
+                if(dir[k] > 0)
+                    t = min(t, ceil((lo + (1 << B) - x[k]) / dir[k]) - 1);
+                else if(dir[k] < 0)
+                    t = min(t, floor((x[k] - lo) / -dir[k]));
+            }
+            int skip = min((int)t, steps - i);
+            if(skip > 0)
+            {
+                x += skip * dir;
+                i += skip;
+            }
+        }
+        return false;
+    }
+
+    //Buckets the voxels of this pass by plane for sweep d
+    void beginSweep(int d)
+    {
+        direction = d;
+        plane     = -1;
+        planes.assign(dim[N_DIM[d]], vector<unsigned>());
+        for(size_t k=0; k<pass.size(); k++)
+        {
+            flags[pass[k]] |= SWEEP;
+            planes[order(pass[k], d)].push_back(pass[k]);
+        }
+    }
+
+    //Takes the voxels of plane i of the current sweep
+    void takePlane(int i, vector<unsigned>& ids)
+    {
+        plane = i;
+        ids.swap(planes[i]);
+        planes[i].clear();
+        for(size_t k=0; k<ids.size(); k++)
+            flags[ids[k]] &= ~SWEEP;
+    }
+
+    //The voxels queued for the next pass become this pass, or with
+    //full_next, every voxel is tested again
+    void endPass(bool full_next)
+    {
+        for(size_t k=0; k<pass.size(); k++)
+            flags[pass[k]] &= ~PASS;
+        for(size_t k=0; k<next.size(); k++)
+            flags[next[k]] = (flags[next[k]] & ~NEXT) | (full_next ? 0 : PASS);
+        pass.swap(next);
+        next.clear();
+        carved.clear();
+        full = full_next;
+        if(full)
+            pass.clear();
+    }
+
+    //Restores the queue of a checkpoint taken after endPass()
+    void restore(bool full_next, const vector<unsigned>& ids)
+    {
+        full = full_next;
+        pass.clear();
+        for(size_t k=0; !full && k<ids.size(); k++)
+            if(ids[k] < flags.size() && !(flags[ids[k]] & PASS))
+            {
+                flags[ids[k]] |= PASS;
+                pass.push_back(ids[k]);
+            }
+    }
+
+    Vector3i                    dim, bdim;
+    bool                        full;
+    int                         direction, plane;
+    vector<ubyte>               flags;
+    vector<int>                 bricks;
+    vector<unsigned>            pass, next, carved;
+    vector< vector<unsigned> >  planes;
+};
+
+//Queues the voxels whose test may change now that p is carved
+static void requeue(const CarveState& state, Worklist& work, const Vector3i& p)
+{
+    const Volume& volume = *state.volume;
+
+    for(int k=0; k<6; k++)
+    {
+        Vector3i q = p;
+        q[k >> 1] += k & 1 ? 1 : -1;
+        if(volume.interior(q))
+            work.push(work.id(q));
+    }
+
+    //Walk away from every camera which sees p
+    Vector3d c(p.x() + 0.5, p.y() + 0.5, p.z() + 0.5);
+    int steps = work.dim.maxCoeff();
+    for(size_t t=0; t<state.views.size(); t++)
+    {
+        const CarveView& view = state.views[t];
+        double u, v;
+        if(!view.project(c.x(), c.y(), c.z(), u, v) ||
+            u < 0 || v < 0 || u >= view.width || v >= view.height)
+            continue;
+
+        Vector3d dir = c - view.center;
+        double m = max(fabs(dir.x()), max(fabs(dir.y()), fabs(dir.z())));
+        Vector3i hit;
+        if(m > 0 && work.march(volume, c, dir / m, steps, hit))
+            work.push(work.id(hit));
+    }
+}
+
+//True if an interior voxel lies between p and the camera of view.  Used
+//instead of the pixel masks on partial sweeps, where most consistent voxels
+//are not tested again and so never claim their pixels.  sweeps() puts the
+//camera behind the plane of p, so every step lands on a plane already swept.
+static bool occluded(const CarveState& state, const Worklist& work, const CarveView& view, const Vector3i& p, int d)
+{
+    Vector3d c(p.x() + 0.5, p.y() + 0.5, p.z() + 0.5);
+    Vector3d dir = view.center - c;
+    double m = fabs(dir[N_DIM[d]]);
+    Vector3i hit;
+    return work.march(*state.volume, c, dir / m, (int)m, hit);
+}
+
+//Per thread buffers of a sweep
+struct SweepScratch
+{
+    SweepScratch(int capacity, int views) :
+        batch(capacity, views),
+        fps((size_t)capacity * views),
+        slots(capacity) {}
+
+    ConsistencyBatch        batch;
+    ApproximateConsistency  approx;
+    vector<Footprint>       fps;
+    vector<int>             slots;
+    vector<Vector3i>        voxels;
+};
+
+//Tests a run of voxels on the current plane of sweep d.
+//  Consistent voxels are colored and their footprints added to claimed,
+//  carved ones are appended to carved (and only removed from the volume
+//  here unless the carve is deterministic).  Voxels not seen by any active view
+//  are left alone.  Partial sweeps find occlusion by marching rays.
+static void testVoxels(
+    CarveState&                     state,
+    int                             d,
+    const Worklist*                 work,
+    const vector<int>&              active,
+    SweepScratch&                   scratch,
+    vector< vector<Footprint> >&    claimed,
+    vector<Vector3i>&               carved)
+{
+    const vector<CarveView>&    views  = state.views;
+    const vector<Vector3i>&     voxels = scratch.voxels;
+    ConsistencyBatch&           batch  = scratch.batch;
+    bool                        partial = work && !work->full;
+    size_t                      carved_before = carved.size();
+
+    //Gather the unoccluded views of each voxel
+    batch.clear();
+    for(size_t k=0; k<voxels.size(); k++)
+    {
+        const Vector3i& p = voxels[k];
+
+        int slot = batch.size;
+        Footprint* fp = &scratch.fps[slot * active.size()];
+        for(size_t a=0; a<active.size(); a++)
+        {
+            const CarveView& view = views[active[a]];
+            if(!view.sweeps(p, d) || !view.footprint(p, *fp) ||
+                (partial ? occluded(state, *work, view, p, d) : view.consistent(fp->cx, fp->cy)))
+                continue;
+
+            if(batch.size == slot)
+                batch.add();
+            batch.sample(slot, view.pixel(fp->cx, fp->cy));
+            (fp++)->view = active[a];
+        }
+
+        if(batch.size > slot)
+            scratch.slots[slot] = k;
+    }
+
+    batch.evaluate(state.params->threshold);
+
+    //The approximate test overrides the center pixel one
+    if(state.params->approx_pad >= 0)
+    for(int slot=0; slot<batch.size; slot++)
+    {
+        const Footprint* fp = &scratch.fps[slot * active.size()];
+        scratch.approx.clear();
+        for(int a=0; a<batch.count[slot]; a++)
+            scratch.approx.add(views[fp[a].view], fp[a], state.params->approx_pad);
+        batch.consistent[slot] = scratch.approx.evaluate(
+            state.params->approx_threshold, batch.color[slot]);
+    }
+
+    //Apply results
+    for(int slot=0; slot<batch.size; slot++)
+    {
+        const Vector3i& p = voxels[scratch.slots[slot]];
+
+        if(batch.consistent[slot])
+        {
+            //Black is reserved for empty space
+            Color c = batch.color[slot];
+            if(c == Color(0,0,0))
+                c = Color(1,1,1);
+            (*state.writer)(p) = c;
+
+            const Footprint* fp = &scratch.fps[slot * active.size()];
+            for(int a=0; a<batch.count[slot]; a++)
+                claimed[fp[a].view].push_back(fp[a]);
+        }
+        else
+        {
+            //Deterministic sweeps carve once the whole plane is tested
+            if(!state.params->deterministic)
+                (*state.writer)(p) = Color(0,0,0);
+            carved.push_back(p);
+        }
+    }
+
+    if(metricsEnabled())
+    {
+        size_t samples = 0, pixels = 0;
+        int pad = state.params->approx_pad;
+        for(int slot=0; slot<batch.size; slot++)
+        {
+            samples += batch.count[slot];
+            const Footprint* fp = &scratch.fps[slot * active.size()];
+            for(int a=0; pad>=0 && a<batch.count[slot]; a++)
+            {
+                const CarveView& view = views[fp[a].view];
+                pixels += (size_t)(min(fp[a].x1 + pad, view.width  - 1) - max(fp[a].x0 - pad, 0) + 1) *
+                                  (min(fp[a].y1 + pad, view.height - 1) - max(fp[a].y0 - pad, 0) + 1);
+            }
+        }
+        countMetric(METRIC_VOXELS_TESTED, voxels.size());
+        countMetric(METRIC_VOXELS_CARVED, carved.size() - carved_before);
+        countMetric(METRIC_VIEWS_SAMPLED, samples);
+        countMetric(METRIC_PIXELS_READ, samples + pixels);
+    }
+}
+
+//Voxel order in which deterministic sweeps commit removals
+static bool voxelLess(const Vector3i& a, const Vector3i& b)
+{
+    if(a.z() != b.z()) return a.z() < b.z();
+    if(a.y() != b.y()) return a.y() < b.y();
+    return a.x() < b.x();
+}
+
+//Sweeps a plane through the volume along direction d.
+//  Each plane is split across threads, by rows or, when work is set, into
+//  runs of the voxels queued on that plane.  Pixels claimed by consistent
+//  voxels are collected per thread and only merged into the view masks once
+//  the plane is done, so every voxel of a plane sees the same masks.
+//  Returns the number of voxels removed.
+static size_t planeSweep(CarveState& state, int d, Worklist* work)
+{
+    MetricTimer timer("photohull/sweep");
+
+    Volume&             volume = *state.volume;
+    vector<CarveView>&  views  = state.views;
+
+    Vector3i dim = volume.size();
+    int n = N_DIM[d], u = U_DIM[d], w = V_DIM[d];
+    int si = dim[n], sj = dim[u], sk = dim[w];
+    int nthreads = threadCount();
+    bool partial = work && !work->full;
+
+    for(size_t t=0; t<views.size(); t++)
+        views[t].resetConsist();
+    if(partial)
+        work->beginSweep(d);
+
+    //Consistent footprints found on the current plane and carved voxels,
+    //per thread
+    vector< vector< vector<Footprint> > > marks(nthreads,
+        vector< vector<Footprint> >(views.size()));
+    vector< vector<Vector3i> > carved(nthreads);
+    vector<unsigned> queued;
+
+    size_t removed = 0;
+    for(int i=0; i<si; i++)
+    {
+        int plane = N_SGN[d] > 0 ? i : si - 1 - i;
+
+        //Only cameras behind the sweep plane can see it front to back
+        vector<int> active;
+        for(size_t t=0; t<views.size(); t++)
+            if(N_SGN[d] * (views[t].center[n] - (plane + 0.5)) < 0)
+                active.push_back(t);
+
+        if(partial)
+            work->takePlane(i, queued);
+
+        size_t tested = 0, plane_removed = 0;
+        if(!active.empty() && (!partial || !queued.empty()))
+        {
+            int runs = partial ? ((int)queued.size() + sk - 1) / sk : sj;
+
+            #pragma omp parallel reduction(+:tested)
+            {
+                int h = threadIndex();
+                SweepScratch scratch(sk, active.size());
+
+                #pragma omp for schedule(dynamic, 1)
+                for(int j=0; j<runs; j++)
+                {
+                    //Gather surface voxels of the run
+                    scratch.voxels.clear();
+                    for(int k=0; k<sk; k++)
+                    {
+                        Vector3i p;
+                        if(partial)
+                        {
+                            if((size_t)j * sk + k >= queued.size())
+                                break;
+                            p = work->voxel(queued[(size_t)j * sk + k]);
+                        }
+                        else
+                        {
+                            p[n] = plane;
+                            p[u] = j;
+                            p[w] = k;
+                        }
+
+                        if(state.band && !(*state.band)[p.x() + dim.x() * (p.y() + dim.y() * p.z())])
+                            continue;
+                        if(!volume.surface(p))
+                            continue;
+                        scratch.voxels.push_back(p);
+                    }
+
+                    tested += scratch.voxels.size();
+                    testVoxels(state, d, work, active, scratch, marks[h], carved[h]);
+                }
+            }
+
+            //Claim the pixels of this plane's consistent voxels, the masks
+            //take concurrent marks so every (thread, view) list is a task
+            int lists = nthreads * (int)views.size();
+
+            #pragma omp parallel for schedule(dynamic, 1)
+            for(int k=0; k<lists; k++)
+            {
+                int t = k % (int)views.size();
+                vector<Footprint>& claimed = marks[k / views.size()][t];
+                for(size_t f=0; f<claimed.size(); f++)
+                    views[t].mark(claimed[f]);
+                claimed.clear();
+            }
+
+            //In deterministic mode every voxel of the plane was tested
+            //against the volume as it was before the plane.  Removals are
+            //committed in voxel order, so the queues below do not depend on
+            //which thread tested what either.
+            if(state.params->deterministic)
+            {
+                for(int h=1; h<nthreads; h++)
+                {
+                    carved[0].insert(carved[0].end(), carved[h].begin(), carved[h].end());
+                    carved[h].clear();
+                }
+                std::sort(carved[0].begin(), carved[0].end(), voxelLess);
+                for(size_t c=0; c<carved[0].size(); c++)
+                    (*state.writer)(carved[0][c]) = Color(0,0,0);
+            }
+
+            //Queue what the carved voxels affect.  Full passes only record
+            //them, the next pass may well be a full one too.
+            for(int h=0; h<nthreads; h++)
+            {
+                plane_removed += carved[h].size();
+                for(size_t c=0; work && c<carved[h].size(); c++)
+                {
+                    const Vector3i& p = carved[h][c];
+                    work->bricks[work->brick(p)]--;
+                    if(partial)
+                        requeue(state, *work, p);
+                    else
+                        work->carved.push_back(work->id(p));
+                }
+                carved[h].clear();
+            }
+        }
+
+        removed += plane_removed;
+
+        //Report progress
+        CarveProgress& progress = state.progress;
+        progress.direction = d;
+        progress.plane     = i;
+        progress.planes    = si;
+        progress.tested   += tested;
+        progress.removed  += plane_removed;
+        if(state.params->progress)
+            state.params->progress(progress);
+    }
+
+    return removed;
+}
+
+//Chessboard distance transform of a dense voxel grid, in place.
+//  Seed voxels hold 0, the rest an upper bound (at most 254).  Each raster
+//  pass takes the 13 neighbours it has already visited, which makes the two
+//  passes exact for the chessboard metric.
+void chamferDistance(vector<ubyte>& dist, const Vector3i& dim)
+{
+    for(int pass=0; pass<2; pass++)
+    {
+        int s = pass ? -1 : 1;
+        for(int z=(pass ? dim.z()-1 : 0); z>=0 && z<dim.z(); z+=s)
+        for(int y=(pass ? dim.y()-1 : 0); y>=0 && y<dim.y(); y+=s)
+        for(int x=(pass ? dim.x()-1 : 0); x>=0 && x<dim.x(); x+=s)
+        {
+            ubyte& d = dist[x + dim.x() * ((size_t)y + dim.y() * z)];
+            for(int dz=-1; dz<=0; dz++)
+            for(int dy=-1; dy<=1; dy++)
+            for(int dx=-1; dx<=1; dx++)
+            {
+                //Neighbours before this voxel in scan order
+                if(dz == 0 && (dy > 0 || (dy == 0 && dx >= 0)))
+                    continue;
+
+                int nx = x + s * dx, ny = y + s * dy, nz = z + s * dz;
+                if(nx < 0 || ny < 0 || nz < 0 ||
+                    nx >= dim.x() || ny >= dim.y() || nz >= dim.z())
+                    continue;
+                d = min<int>(d, dist[nx + dim.x() * ((size_t)ny + dim.y() * nz)] + 1);
+            }
+        }
+    }
+}
+
+//Initializes a volume from the hull of the previous (coarser) level.
+//  Occupancy is upsampled and dilated by margin voxels, and band is set for
+//  the voxels within margin of the upsampled surface.  Only those get tested.
+static void upsampleHull(
+    const Volume&   coarse,
+    Volume&         fine,
+    vector<ubyte>&  band,
+    int             margin)
+{
+    Vector3i cd = coarse.size(), fd = fine.size();
+    int limit = min(margin + 1, 255);
+
+    //Distance to the coarse surface (chessboard metric, in fine voxels)
+    band.assign((size_t)fd.x() * fd.y() * fd.z(), limit);
+    vector<ubyte> inside(band.size());
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int z=0; z<fd.z(); z++)
+    for(int y=0; y<fd.y(); y++)
+    for(int x=0; x<fd.x(); x++)
+    {
+        Vector3i c(
+            min(x * cd.x() / fd.x(), cd.x() - 1),
+            min(y * cd.y() / fd.y(), cd.y() - 1),
+            min(z * cd.z() / fd.z(), cd.z() - 1));
+
+        size_t idx = x + fd.x() * ((size_t)y + fd.y() * z);
+        inside[idx] = coarse.interior(c);
+        if(coarse.surface(c))
+            band[idx] = 0;
+    }
+
+    chamferDistance(band, fd);
+
+    //Dilate occupancy and threshold the band
+    fine.fill(Color(0,0,0));
+    fine.detach();
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int z=0; z<fd.z(); z++)
+    for(int y=0; y<fd.y(); y++)
+    for(int x=0; x<fd.x(); x++)
+    {
+        size_t idx = x + fd.x() * ((size_t)y + fd.y() * z);
+        band[idx] = band[idx] <= margin;
+        if(inside[idx] || band[idx])
+            fine(Vector3i(x, y, z)) = Color(255, 255, 255);
+    }
+}
+
+//Computes a photohull from a set of views
+Volume stereoPhotoHull(
+    vector<View> views,
+    Vector3i dim,
+    Vector3d low,
+    Vector3d high)
+{
+    return stereoPhotoHull(views, dim, low, high, PhotoHullParams());
+}
+
+Volume stereoPhotoHull(
+    vector<View> views,
+    Vector3i dim,
+    Vector3d low,
+    Vector3d high,
+    const PhotoHullParams& params)
+{
+    MetricTimer timer("photohull");
+
+    ThreadCountScope threads(params.threads);
+
+    CarveState state;
+    state.params = &params;
+    state.band   = NULL;
+    state.writer = NULL;
+    state.progress.tested  = 0;
+    state.progress.removed = 0;
+
+    Volume          volume;
+    boost::shared_ptr<const vector<ubyte> > band;
+    int             levels = max(params.levels, 1);
+
+    //Pick up from the last snapshot of an identical carve
+    boost::scoped_ptr<Checkpointer> checkpoint;
+    CarveSnapshot   snapshot;
+    vector<double>  key = checkpointKey(params, views, dim, low, high);
+    bool            resumed = false;
+    if(!params.checkpoint.empty())
+    {
+        checkpoint.reset(new Checkpointer(params.checkpoint));
+        resumed = params.resume && checkpoint->load(snapshot) && snapshot.key == key &&
+            snapshot.level >= 0 && snapshot.level < levels;
+        if(!resumed)
+            snapshot = CarveSnapshot();
+    }
+
+    for(int level=levels-1; level>=0; level--)
+    {
+        MetricTimer level_timer("photohull/level");
+
+        Vector3i ldim(
+            max(dim.x() >> level, 1),
+            max(dim.y() >> level, 1),
+            max(dim.z() >> level, 1));
+
+        int first = 1;
+        if(resumed && level > snapshot.level)
+            continue;
+        if(resumed && level == snapshot.level)
+        {
+            volume = snapshot.volume;
+            band = snapshot.band;
+            state.progress.tested  = snapshot.tested;
+            state.progress.removed = snapshot.removed;
+            first = snapshot.pass + 1;
+            if(snapshot.finished)
+            {
+                resumed = false;
+                continue;
+            }
+        }
+
+        //Coarsest level starts solid (or from the visual hull), the others
+        //from the previous level
+        else
+        {
+            Volume next(ldim, low, high);
+            if(level != levels-1)
+            {
+                //A new band, the last snapshot may still hold the old one
+                vector<ubyte>* fine = new vector<ubyte>;
+                band.reset(fine);
+                upsampleHull(volume, next, *fine, params.margin);
+            }
+            else if(params.visual_hull)
+                next = visualHull(views, ldim, low, high, params.hull);
+            volume = next;
+        }
+        
+        //Workers write voxels concurrently, so no brick may be shared
+        volume.detach();
+
+        state.volume = &volume;
+        state.band   = band && !band->empty() ? band.get() : NULL;
+        state.views.clear();
+        for(size_t i=0; i<views.size(); i++)
+            state.views.push_back(CarveView(views[i], volume));
+
+        state.progress.level = level;
+
+        //After the first full pass only queued voxels are tested
+        boost::scoped_ptr<Worklist> work;
+        if(params.worklist && params.mode == CARVE_SWEEP)
+            work.reset(new Worklist(volume));
+
+        if(resumed)
+        {
+            if(work)
+                work->restore(snapshot.full, snapshot.queued);
+            snapshot = CarveSnapshot();
+            resumed  = false;
+        }
+
+        for(int pass=first; ; pass++)
+        {
+            state.progress.pass = pass;
+
+            //Bricks still shared with the last snapshot are copied as the
+            //workers first write them
+            DetachOnWrite writer(volume);
+            state.writer = &writer;
+
+            size_t removed = 0, tested = state.progress.tested;
+            if(params.mode == CARVE_ITEM_BUFFER)
+                removed = itemBufferPass(state);
+            else
+            {
+                for(int d=0; d<6; d++)
+                    removed += planeSweep(state, d, work.get());
+                tested = state.progress.tested - tested;
+
+                //Switch to the worklist once a pass changes little enough
+                //that re-queueing is cheaper than testing everything
+                if(work)
+                {
+                    bool full = work->full && removed * WORKLIST_RATIO > tested;
+                    for(size_t k=0; !full && k<work->carved.size(); k++)
+                        requeue(state, *work, work->voxel(work->carved[k]));
+                    work->endPass(full);
+                }
+            }
+
+            bool done = removed == 0 || (params.max_passes > 0 && pass >= params.max_passes);
+
+            //Snapshot between passes.  The copy shares its bricks with the
+            //volume until the next pass writes them and shares the band, and
+            //is handed to the writer thread whole.  The last one is always
+            //written.
+            state.writer = NULL;
+            if(checkpoint && (done || pass % max(params.checkpoint_interval, 1) == 0))
+            {
+                CarveSnapshot s;
+                s.key       = key;
+                s.level     = level;
+                s.pass      = pass;
+                s.finished  = done;
+                s.full      = !work || work->full;
+                if(work && !work->full)
+                    s.queued = work->pass;
+                s.tested    = state.progress.tested;
+                s.removed   = state.progress.removed;
+                s.volume    = volume;
+                s.band      = band;
+
+                checkpoint->save(s, done);
+            }
+
+            if(done)
+                break;
+        }
+    }
+
+    return volume;
+}
@@ -0,0 +1,295 @@
+//STL
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+//Project files
+#include "cache.h"
+#include "checkpoint.h"
+#include "debug.h"
+#include "image.h"
+#include "mesh.h"
+#include "metrics.h"
+#include "pipeline.h"
+#include "sfm.h"
+#include "stereo.h"
+#include "system.h"
+#include "view.h"
+#include "volume.h"
+
+using namespace std;
+
+//Bump when a stage changes its output for the same inputs
+static const double PIPELINE_VERSION = 1;
+
+//Report order of the stages
+enum
+{
+    PIPELINE_SFM,
+    PIPELINE_CARVE,
+    PIPELINE_EXPORT
+};
+
+//A run and its stage keys
+struct Pipeline
+{
+    Pipeline(const PipelineParams& params_) :
+        params(params_),
+        cache(params_.cache),
+        cameras(".out"),
+        sfm("sfm"),
+        carve("carve"),
+        exported("export")
+    {
+        stages.push_back(PipelineStage("sfm"));
+        stages.push_back(PipelineStage("carve"));
+        stages.push_back(PipelineStage("export"));
+    }
+
+    const PipelineParams&   params;
+    StageCache              cache;
+
+    vector<string>          images;
+    string                  bundle;     //Camera file of the dataset, if it has one
+    string                  cameras;    //Cache extension of the cameras, by format
+
+    StageKey                sfm, carve, exported;
+    vector<PipelineStage>   stages;
+};
+
+static bool fileExists(const string& path)
+{
+    struct stat s;
+    return stat(path.c_str(), &s) == 0;
+}
+
+static bool isDirectory(const string& path)
+{
+    struct stat s;
+    return stat(path.c_str(), &s) == 0 && S_ISDIR(s.st_mode);
+}
+
+//Output files of the export stage
+static vector<string> exportFiles(const PipelineParams& params)
+{
+    vector<string> ext(1, ".ply");
+    if(params.mesh)
+        ext.push_back(".mesh.ply");
+    return ext;
+}
+
+//Hashes the inputs of every stage
+static bool stageKeys(Pipeline& p)
+{
+    const ScanParams& scan = p.params.scan;
+
+    //A camera file is the dataset's own calibration
+    bool calibrated = fileExists(scan.views_file) && !isDirectory(scan.views_file);
+    p.images = calibrated ?
+        cameraFileImages(scan.views_file) :
+        bundlerImageList(scan.views_file);
+    if(p.images.empty())
+    {
+        cout << "No images in " << scan.views_file << endl;
+        return false;
+    }
+
+    //Cameras depend on the image contents, not their names
+    p.sfm.add(PIPELINE_VERSION);
+    p.sfm.add((double)p.images.size());
+    for(size_t i=0; i<p.images.size(); i++)
+        if(!p.sfm.addFile(p.images[i]))
+            return false;
+
+    string bundle = scan.views_file + "/bundle/bundle.out";
+    if(calibrated)
+    {
+        p.bundle = scan.views_file;
+        p.cameras = ".cams";
+        if(!p.sfm.addFile(p.bundle))
+            return false;
+    }
+    else if(fileExists(bundle))
+    {
+        p.bundle = bundle;
+        if(!p.sfm.addFile(bundle))
+            return false;
+    }
+    else
+        p.sfm.add(p.params.bundler);
+
+    p.carve.add(p.sfm);
+    p.carve.add(checkpointKey(scan.photohull, p.images.size(), scan.dims(), scan.low, scan.high));
+
+    //A checkpoint may be resumed with more passes, a cached carve may not
+    p.carve.add((double)scan.photohull.max_passes);
+
+    p.exported.add(p.carve);
+    p.exported.add(p.params.mesh ? 1.0 : 0.0);
+
+    p.stages[PIPELINE_SFM].key    = p.sfm.hex();
+    p.stages[PIPELINE_CARVE].key  = p.carve.hex();
+    p.stages[PIPELINE_EXPORT].key = p.exported.hex();
+    return true;
+}
+
+//Loads the images and makes sure their cameras are cached
+static bool viewsStage(Pipeline& p, vector<View>& views)
+{
+    vector<Image> frames;
+    for(size_t i=0; i<p.images.size(); i++)
+    {
+        cout << "Loading image " << p.images[i] << endl;
+        frames.push_back(Image(p.images[i]));
+    }
+
+    PipelineStage& stage = p.stages[PIPELINE_SFM];
+    double start = wallTime();
+    {
+        MetricTimer timer("pipeline/sfm");
+        if(p.cache.has(p.sfm, p.cameras))
+            stage.status = PIPELINE_CACHED;
+        else
+        {
+            string temp = p.cache.temp(p.sfm, p.cameras);
+            bool ok = p.bundle.empty() ?
+                bundlerCameraFile(frames, p.params.bundler, temp) :
+                copyFile(p.bundle, temp);
+            if(!ok || !p.cache.commit(p.sfm, p.cameras, temp))
+                return false;
+            stage.status = PIPELINE_COMPUTED;
+        }
+    }
+    stage.seconds = wallTime() - start;
+
+    string cameras = p.cache.path(p.sfm, p.cameras);
+    views = p.cameras == ".cams" ?
+        loadCameraViews(frames, cameras) :
+        loadBundlerViews(frames, cameras);
+    if(views.empty())
+    {
+        cout << "No cameras for " << p.params.scan.views_file << endl;
+        return false;
+    }
+    return true;
+}
+
+static bool carveStage(Pipeline& p, Volume& volume)
+{
+    PipelineStage& stage = p.stages[PIPELINE_CARVE];
+    string path = p.cache.path(p.carve, ".vol");
+
+    //A bad entry (which only a damaged disk leaves) is computed again
+    if(p.cache.has(p.carve, ".vol"))
+    {
+        double start = wallTime();
+        MetricTimer timer("pipeline/carve");
+        if(volume.load(path))
+        {
+            stage.status = PIPELINE_CACHED;
+            stage.seconds = wallTime() - start;
+            return true;
+        }
+    }
+
+    vector<View> views;
+    if(!viewsStage(p, views))
+        return false;
+
+    double start = wallTime();
+    {
+        MetricTimer timer("pipeline/carve");
+        const ScanParams& scan = p.params.scan;
+        PhotoHullParams photohull = scan.photohull;
+        photohull.threads = p.params.threads;
+        volume = stereoPhotoHull(views, scan.dims(), scan.low, scan.high, photohull);
+        views.clear();
+
+        string temp = p.cache.temp(p.carve, ".vol");
+        FILE* f = fopen(temp.c_str(), "wb");
+        bool saved = f && volume.save(f);
+        if(f)
+            saved = fclose(f) == 0 && saved;
+        if(!saved)
+        {
+            cout << "Could not write " << temp << endl;
+            remove(temp.c_str());
+            return false;
+        }
+        if(!p.cache.commit(p.carve, ".vol", temp))
+            return false;
+    }
+    stage.status = PIPELINE_COMPUTED;
+    stage.seconds = wallTime() - start;
+    return true;
+}
+
+static bool exportStage(Pipeline& p)
+{
+    PipelineStage& stage = p.stages[PIPELINE_EXPORT];
+    vector<string> ext = exportFiles(p.params);
+
+    bool cached = true;
+    for(size_t i=0; i<ext.size(); i++)
+        cached = cached && p.cache.has(p.exported, ext[i]);
+
+    double start;
+    if(cached)
+    {
+        start = wallTime();
+        stage.status = PIPELINE_CACHED;
+    }
+    else
+    {
+        Volume volume;
+        if(!carveStage(p, volume))
+            return false;
+
+        start = wallTime();
+        MetricTimer timer("pipeline/export");
+        for(size_t i=0; i<ext.size(); i++)
+        {
+            string temp = p.cache.temp(p.exported, ext[i]);
+            bool saved = ext[i] == ".ply" ?
+                saveVolumePLY(temp, volume) :
+                meshVolume(volume, p.params.threads).save(temp);
+            if(!saved)
+            {
+                remove(temp.c_str());
+                return false;
+            }
+            if(!p.cache.commit(p.exported, ext[i], temp))
+                return false;
+        }
+        stage.status = PIPELINE_COMPUTED;
+    }
+
+    //Outputs are copies, so editing them never changes the cache
+    for(size_t i=0; i<ext.size(); i++)
+        if(!copyFile(p.cache.path(p.exported, ext[i]), p.params.output + ext[i]))
+            return false;
+    stage.seconds = wallTime() - start;
+    return true;
+}
+
+bool runPipeline(const PipelineParams& params, vector<PipelineStage>* report)
+{
+    MetricTimer timer("pipeline");
+    ThreadCountScope threads(params.threads);
+
+    Pipeline p(params);
+    bool ok = stageKeys(p) && exportStage(p);
+
+    for(size_t i=0; i<p.stages.size(); i++)
+    {
+        const char* status[] = { "unused", "cached", "computed" };
+        cout << "Stage " << p.stages[i].name << " " << p.stages[i].key
+             << ": " << status[p.stages[i].status] << endl;
+    }
+    if(report)
+        *report = p.stages;
+    return ok;
+}
@@ -0,0 +1,70 @@
+//Reconstruction of one dataset with cached stage outputs
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <string>
+#include <vector>
+
+#include "params.h"
+
+//Pipeline parameters
+struct PipelineParams
+{
+    PipelineParams() :
+        cache("cache"),
+        bundler("RunBundler.sh"),
+        threads(0),
+        mesh(false) {}
+
+    //Dataset settings, views_file is a bundler directory or a camera file.
+    //A camera file, or a directory holding bundle/bundle.out, gives the
+    //cameras, otherwise bundler is run.
+    ScanParams scan;
+
+    //Cache directory, see StageCache
+    std::string cache;
+
+    //Bundler script
+    std::string bundler;
+
+    //Output files are output.ply (and output.mesh.ply)
+    std::string output;
+
+    //Cores, 0 uses all of them
+    int threads;
+
+    //Also write a surface mesh of the volume
+    bool mesh;
+};
+
+//What happened to a stage in a run
+enum PipelineStatus
+{
+    PIPELINE_UNUSED,    //Not needed, a later stage was cached
+    PIPELINE_CACHED,    //Output taken from the cache
+    PIPELINE_COMPUTED   //Output computed and stored
+};
+
+struct PipelineStage
+{
+    PipelineStage(const std::string& name_) :
+        name(name_), status(PIPELINE_UNUSED), seconds(0) {}
+
+    std::string     name;
+    std::string     key;        //Cache key, as hex digits
+    PipelineStatus  status;
+    double          seconds;
+};
+
+//Runs a dataset through structure from motion, carving and export.
+//  Each stage is keyed by a hash of its parameters and the keys of the
+//  stages it reads from, the first of which hashes the contents of the
+//  images.  Stages run backwards from the export: one whose output is
+//  cached ends the walk, so only the stages after the first changed input
+//  are computed, and the images are not even decoded if the carve is
+//  cached.  Stages are reported in pipeline order (sfm, carve, export).
+extern bool runPipeline(
+    const PipelineParams& params,
+    std::vector<PipelineStage>* report = NULL);
+
+#endif
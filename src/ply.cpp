@@ -0,0 +1,657 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <Eigen/Core>
+
+#include "ply.h"
+
+using namespace std;
+using namespace Eigen;
+
+//Size of the output buffers
+static const size_t PLY_BUFFER_SIZE = 4 << 20;
+
+//Width of the element counts in the header, patched in place at close
+static const int PLY_COUNT_WIDTH = 12;
+
+//Writes an element line with a blank count, returns the count's offset
+static long countLine(FILE* f, const char* element)
+{
+    fprintf(f, "element %s ", element);
+    long at = ftell(f);
+    fprintf(f, "%0*d\n", PLY_COUNT_WIDTH, 0);
+    return at;
+}
+
+PlyWriter::PlyWriter(const string& filename_, PlyFormat format_, bool faces) :
+    filename(filename_),
+    format(format_),
+    file(NULL),
+    spool(NULL),
+    buffer(PLY_BUFFER_SIZE),
+    pos(0),
+    spool_pos(0),
+    vertex_count_at(-1),
+    face_count_at(-1),
+    nvertices(0),
+    nfaces(0),
+    with_faces(faces),
+    good(true)
+{
+    file = fopen(filename.c_str(), "wb");
+    if(!file)
+    {
+        cout << "Could not open " << filename << endl;
+        good = false;
+        return;
+    }
+
+    fprintf(file, "ply\nformat %s 1.0\ncomment output from autoscanner\n",
+        format == PLY_BINARY ? "binary_little_endian" : "ascii");
+    vertex_count_at = countLine(file, "vertex");
+    fprintf(file,
+        "property float x\n"
+        "property float y\n"
+        "property float z\n"
+        "property uchar blue\n"
+        "property uchar green\n"
+        "property uchar red\n");
+    if(with_faces)
+    {
+        face_count_at = countLine(file, "face");
+        fprintf(file, "property list uchar int vertex_indices\n");
+
+        spool = tmpfile();
+        spool_buffer.resize(PLY_BUFFER_SIZE);
+        if(!spool)
+        {
+            cout << "Could not create a temporary file for " << filename << endl;
+            good = false;
+        }
+    }
+    fprintf(file, "end_header\n");
+}
+
+PlyWriter::~PlyWriter()
+{
+    close();
+}
+
+void PlyWriter::flush()
+{
+    if(file && pos > 0 && fwrite(&buffer[0], 1, pos, file) != pos)
+        good = false;
+    pos = 0;
+}
+
+void PlyWriter::slowVertex(float x, float y, float z, const Color& c)
+{
+    if(!file)
+        return;
+    if(pos + 64 > buffer.size())
+        flush();
+
+    if(format == PLY_BINARY)
+    {
+        encodeVertex(&buffer[pos], x, y, z, c);
+        pos += VERTEX_BYTES;
+    }
+    else
+        pos += snprintf((char*)&buffer[pos], 64, "%g %g %g %d %d %d\n",
+            x, y, z, (int)c.b, (int)c.g, (int)c.r);
+    nvertices++;
+}
+
+void PlyWriter::rawVertices(const void* data, size_t n)
+{
+    if(!file)
+        return;
+
+    //ASCII output has to be formatted one vertex at a time
+    const ubyte* v = (const ubyte*)data;
+    if(format != PLY_BINARY)
+    {
+        for(size_t i=0; i<n; i++, v+=VERTEX_BYTES)
+        {
+            float p[3];
+            for(int k=0; k<3; k++)
+            {
+                unsigned u = v[4*k] | (v[4*k+1] << 8) | (v[4*k+2] << 16) | ((unsigned)v[4*k+3] << 24);
+                memcpy(&p[k], &u, 4);
+            }
+            slowVertex(p[0], p[1], p[2], Color(v[14], v[13], v[12]));
+        }
+        return;
+    }
+
+    size_t bytes = n * VERTEX_BYTES;
+    if(bytes >= buffer.size())
+    {
+        flush();
+        if(fwrite(v, 1, bytes, file) != bytes)
+            good = false;
+    }
+    else
+    {
+        if(pos + bytes > buffer.size())
+            flush();
+        memcpy(&buffer[pos], v, bytes);
+        pos += bytes;
+    }
+    nvertices += n;
+}
+
+void PlyWriter::face(const int* indices, int n)
+{
+    if(!spool || n <= 0 || n > 255)
+    {
+        good = good && spool && n > 0 && n <= 255;
+        return;
+    }
+
+    if(spool_pos + 16 * (n + 1) > spool_buffer.size())
+    {
+        if(fwrite(&spool_buffer[0], 1, spool_pos, spool) != spool_pos)
+            good = false;
+        spool_pos = 0;
+    }
+
+    ubyte* out = &spool_buffer[spool_pos];
+    if(format == PLY_BINARY)
+    {
+        *out++ = (ubyte)n;
+        for(int i=0; i<n; i++)
+        {
+            unsigned u = (unsigned)indices[i];
+            *out++ = (ubyte)u;
+            *out++ = (ubyte)(u >> 8);
+            *out++ = (ubyte)(u >> 16);
+            *out++ = (ubyte)(u >> 24);
+        }
+        spool_pos = out - &spool_buffer[0];
+    }
+    else
+    {
+        spool_pos += sprintf((char*)out, "%d", n);
+        for(int i=0; i<n; i++)
+            spool_pos += sprintf((char*)&spool_buffer[spool_pos], " %d", indices[i]);
+        spool_buffer[spool_pos++] = '\n';
+    }
+    nfaces++;
+}
+
+bool PlyWriter::close()
+{
+    if(!file)
+        return good;
+    flush();
+
+    //Append the spooled faces
+    if(spool)
+    {
+        if(spool_pos > 0 && fwrite(&spool_buffer[0], 1, spool_pos, spool) != spool_pos)
+            good = false;
+        rewind(spool);
+        size_t n;
+        while((n = fread(&buffer[0], 1, buffer.size(), spool)) > 0)
+            if(fwrite(&buffer[0], 1, n, file) != n)
+                good = false;
+        fclose(spool);
+        spool = NULL;
+    }
+
+    //Patch the counts
+    char count[32];
+    snprintf(count, sizeof(count), "%0*lu", PLY_COUNT_WIDTH, (unsigned long)nvertices);
+    good = good && fseek(file, vertex_count_at, SEEK_SET) == 0 &&
+        fwrite(count, 1, PLY_COUNT_WIDTH, file) == (size_t)PLY_COUNT_WIDTH;
+    if(face_count_at >= 0)
+    {
+        snprintf(count, sizeof(count), "%0*lu", PLY_COUNT_WIDTH, (unsigned long)nfaces);
+        good = good && fseek(file, face_count_at, SEEK_SET) == 0 &&
+            fwrite(count, 1, PLY_COUNT_WIDTH, file) == (size_t)PLY_COUNT_WIDTH;
+    }
+
+    good = fclose(file) == 0 && good;
+    file = NULL;
+    if(!good)
+        cout << "Error writing " << filename << endl;
+    return good;
+}
+
+//Sizes and names of the PLY scalar types, in PlyReader::Type order
+static const int   PLY_TYPE_SIZE[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+static const char* PLY_TYPE_NAME[][2] =
+{
+    { "char",  "int8" },    { "uchar",  "uint8" },
+    { "short", "int16" },   { "ushort", "uint16" },
+    { "int",   "int32" },   { "uint",   "uint32" },
+    { "float", "float32" }, { "double", "float64" }
+};
+
+static PlyReader::Type plyType(const string& name)
+{
+    for(int t=0; t<PlyReader::NONE; t++)
+        if(name == PLY_TYPE_NAME[t][0] || name == PLY_TYPE_NAME[t][1])
+            return (PlyReader::Type)t;
+    return PlyReader::NONE;
+}
+
+static bool bigEndianHost()
+{
+    unsigned one = 1;
+    return *(const ubyte*)&one == 0;
+}
+
+PlyReader::PlyReader(const string& filename_) :
+    filename(filename_),
+    fd(-1),
+    map(NULL),
+    end(NULL),
+    body(NULL),
+    map_size(0),
+    ascii(false),
+    swap(false),
+    good(false),
+    nvertices(0),
+    vertex_data(NULL),
+    vertex_stride(0)
+{
+    for(int a=0; a<3; a++)
+        point_props[a] = color_props[a] = -1;
+
+    struct stat st;
+    fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        cout << "Could not open " << filename << endl;
+        return;
+    }
+    map_size = st.st_size;
+    void* m = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(m == MAP_FAILED)
+    {
+        cout << "Could not map " << filename << endl;
+        return;
+    }
+    map = (const ubyte*)m;
+    end = map + map_size;
+    madvise(m, map_size, MADV_SEQUENTIAL);
+
+    vector<Element> elements;
+    good = parseHeader(elements);
+    const ubyte* p = body;
+    for(size_t i=0; i<elements.size() && good; i++)
+        good = readElement(p, elements[i]);
+
+    for(size_t i=0; i<face_indices.size() && good; i++)
+        good = face_indices[i] >= 0 && (size_t)face_indices[i] < nvertices;
+    good = good && (nvertices == 0 || (point_props[0] >= 0 && point_props[1] >= 0 && point_props[2] >= 0));
+    if(!good)
+        cout << "Bad PLY file " << filename << endl;
+}
+
+PlyReader::~PlyReader()
+{
+    if(map)
+        munmap((void*)map, map_size);
+    if(fd >= 0)
+        ::close(fd);
+}
+
+bool PlyReader::parseHeader(vector<Element>& elements)
+{
+    //The header ends with the first end_header line
+    const char* text = (const char*)map;
+    const char* stop = NULL;
+    for(const char* q = text; q + 10 <= (const char*)end && !stop; q++)
+        if(memcmp(q, "end_header", 10) == 0 && (q == text || q[-1] == '\n'))
+            stop = q;
+    if(!stop || memcmp(text, "ply", 3) != 0)
+        return false;
+
+    body = (const ubyte*)stop + 10;
+    while(body < end && *body != '\n')
+        body++;
+    body = min(body + 1, end);
+
+    istringstream header(string(text, stop));
+    string line;
+    bool format = false;
+    while(getline(header, line))
+    {
+        istringstream in(line);
+        string key;
+        in >> key;
+        if(key == "format")
+        {
+            string encoding;
+            in >> encoding;
+            ascii  = encoding == "ascii";
+            swap   = !ascii && (encoding == "binary_big_endian") != bigEndianHost();
+            format = ascii || encoding == "binary_big_endian" || encoding == "binary_little_endian";
+        }
+        else if(key == "element")
+        {
+            Element e;
+            in >> e.name >> e.count;
+            if(!in)
+                return false;
+            e.size = 0;
+            elements.push_back(e);
+        }
+        else if(key == "property")
+        {
+            if(elements.empty())
+                return false;
+            Element& e = elements.back();
+            Property prop;
+            string type;
+            in >> type;
+            if(type == "list")
+            {
+                string count, item;
+                in >> count >> item >> prop.name;
+                prop.count_type = plyType(count);
+                prop.type       = plyType(item);
+                if(prop.count_type == NONE)
+                    return false;
+                e.size = -1;
+            }
+            else
+            {
+                in >> prop.name;
+                prop.type       = plyType(type);
+                prop.count_type = NONE;
+            }
+            if(!in || prop.type == NONE)
+                return false;
+
+            prop.offset = e.size;
+            if(e.size >= 0)
+                e.size += PLY_TYPE_SIZE[prop.type];
+            e.properties.push_back(prop);
+        }
+    }
+    return format;
+}
+
+//Reads one scalar from the file, binary or text
+bool PlyReader::value(const ubyte*& p, Type type, double& v) const
+{
+    if(!ascii)
+    {
+        if(end - p < PLY_TYPE_SIZE[type])
+            return false;
+        v = scalar(p, type);
+        return true;
+    }
+
+    while(p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+        p++;
+    char text[64];
+    int  n = 0;
+    while(p < end && n < 63 && !(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+        text[n++] = *p++;
+    text[n] = 0;
+    char* stop;
+    v = strtod(text, &stop);
+    return n > 0 && stop == text + n;
+}
+
+//Decodes a binary scalar
+double PlyReader::scalar(const ubyte*& p, Type type) const
+{
+    int   n = PLY_TYPE_SIZE[type];
+    ubyte b[8];
+    for(int i=0; i<n; i++)
+        b[i] = swap ? p[n - 1 - i] : p[i];
+    p += n;
+
+    switch(type)
+    {
+        case CHAR:   return (signed char)b[0];
+        case UCHAR:  return b[0];
+        case SHORT:  { short v;          memcpy(&v, b, 2); return v; }
+        case USHORT: { unsigned short v; memcpy(&v, b, 2); return v; }
+        case INT:    { int v;            memcpy(&v, b, 4); return v; }
+        case UINT:   { unsigned v;       memcpy(&v, b, 4); return v; }
+        case FLOAT:  { float v;          memcpy(&v, b, 4); return v; }
+        case DOUBLE: { double v;         memcpy(&v, b, 8); return v; }
+        default:     return 0;
+    }
+}
+
+//Color channel value of a property, floating point colors are in [0,1]
+static ubyte colorValue(double v, PlyReader::Type type)
+{
+    if(type == PlyReader::FLOAT || type == PlyReader::DOUBLE)
+        v *= 255.0;
+    return (ubyte)(v < 0 ? 0 : (v > 255 ? 255 : v + 0.5));
+}
+
+bool PlyReader::readElement(const ubyte*& p, const Element& element)
+{
+    bool vertex = element.name == "vertex";
+    if(vertex)
+    {
+        static const char* names[3][3] =
+        {
+            { "x", "y", "z" },
+            { "red", "green", "blue" },
+            { "diffuse_red", "diffuse_green", "diffuse_blue" }
+        };
+        nvertices    = element.count;
+        vertex_props = element.properties;
+        for(size_t k=0; k<vertex_props.size(); k++)
+        for(int a=0; a<3; a++)
+        {
+            const Property& prop = vertex_props[k];
+            if(prop.count_type != NONE)
+                continue;
+            if(prop.name == names[0][a])
+                point_props[a] = k;
+            if(prop.name == names[1][a] || prop.name == names[2][a])
+                color_props[a] = k;
+        }
+    }
+
+    //Fixed size binary records are used in place or skipped
+    if(!ascii && element.size >= 0)
+    {
+        if(element.count > 0 && (size_t)(end - p) / element.count < (size_t)element.size)
+            return false;
+        if(vertex)
+        {
+            vertex_data   = p;
+            vertex_stride = element.size;
+        }
+        p += element.count * element.size;
+        return true;
+    }
+
+    //Everything else is read a record at a time
+    bool face = element.name == "face";
+    if(vertex)
+    {
+        parsed_points.resize(3 * element.count);
+        if(hasColors())
+            parsed_colors.resize(element.count);
+    }
+    if(face)
+    {
+        face_offsets.reserve(element.count + 1);
+        face_offsets.push_back(0);
+    }
+
+    for(size_t i=0; i<element.count; i++)
+    {
+        for(size_t k=0; k<element.properties.size(); k++)
+        {
+            const Property& prop = element.properties[k];
+            double v;
+            if(prop.count_type == NONE)
+            {
+                if(!value(p, prop.type, v))
+                    return false;
+                for(int a=0; vertex && a<3; a++)
+                    if(point_props[a] == (int)k)
+                        parsed_points[3 * i + a] = (float)v;
+                if(vertex && hasColors())
+                {
+                    Color& c = parsed_colors[i];
+                    if(color_props[0] == (int)k) c.r = colorValue(v, prop.type);
+                    if(color_props[1] == (int)k) c.g = colorValue(v, prop.type);
+                    if(color_props[2] == (int)k) c.b = colorValue(v, prop.type);
+                }
+                continue;
+            }
+
+            double count;
+            if(!value(p, prop.count_type, count) || count < 0)
+                return false;
+            bool indices = face && (prop.name == "vertex_indices" || prop.name == "vertex_index");
+            for(int j=0; j<(int)count; j++)
+            {
+                if(!value(p, prop.type, v))
+                    return false;
+                if(indices)
+                    face_indices.push_back((int)v);
+            }
+        }
+        if(face)
+            face_offsets.push_back(face_indices.size());
+    }
+    return true;
+}
+
+Vector3d PlyReader::point(size_t i) const
+{
+    if(!vertex_data)
+        return Vector3d(parsed_points[3 * i], parsed_points[3 * i + 1], parsed_points[3 * i + 2]);
+
+    Vector3d result;
+    const ubyte* record = vertex_data + i * vertex_stride;
+    for(int a=0; a<3; a++)
+    {
+        const Property& prop = vertex_props[point_props[a]];
+        const ubyte* q = record + prop.offset;
+        if(prop.type == FLOAT && !swap)
+        {
+            float f;
+            memcpy(&f, q, 4);
+            result[a] = f;
+        }
+        else
+            result[a] = scalar(q, prop.type);
+    }
+    return result;
+}
+
+Color PlyReader::color(size_t i) const
+{
+    if(!hasColors())
+        return Color(255, 255, 255);
+    if(!vertex_data)
+        return parsed_colors[i];
+
+    ubyte c[3];
+    const ubyte* record = vertex_data + i * vertex_stride;
+    for(int a=0; a<3; a++)
+    {
+        const Property& prop = vertex_props[color_props[a]];
+        const ubyte* q = record + prop.offset;
+        c[a] = colorValue(scalar(q, prop.type), prop.type);
+    }
+    return Color(c[0], c[1], c[2]);
+}
+
+int PlyReader::vertexOffset(const string& property) const
+{
+    if(!vertex_data)
+        return -1;
+    for(size_t k=0; k<vertex_props.size(); k++)
+        if(vertex_props[k].name == property)
+            return vertex_props[k].offset;
+    return -1;
+}
+
+//Loads the vertices of a PLY file
+bool loadPLY(
+    const string& filename,
+    vector<Vector3d>& points,
+    vector<Color>& colors)
+{
+    vector<int> triangles;
+    return loadPLY(filename, points, colors, triangles);
+}
+
+//Loads a mesh, polygons are split into triangle fans
+bool loadPLY(
+    const string& filename,
+    vector<Vector3d>& points,
+    vector<Color>& colors,
+    vector<int>& triangles)
+{
+    PlyReader in(filename);
+    if(!in.ok())
+        return false;
+
+    points.resize(in.vertices());
+    colors.resize(in.vertices());
+    for(size_t i=0; i<in.vertices(); i++)
+    {
+        points[i] = in.point(i);
+        colors[i] = in.color(i);
+    }
+
+    triangles.clear();
+    for(size_t i=0; i<in.faces(); i++)
+    {
+        int n;
+        const int* f = in.face(i, n);
+        for(int j=2; j<n; j++)
+        {
+            triangles.push_back(f[0]);
+            triangles.push_back(f[j - 1]);
+            triangles.push_back(f[j]);
+        }
+    }
+    return true;
+}
+
+//Saves a collection of point/color pairs
+bool savePLY(
+    const string& filename,
+    const vector<Vector3d>& points,
+    const vector<Color>& colors,
+    PlyFormat format)
+{
+    return savePLY(filename, points, colors, vector<int>(), format);
+}
+
+//Saves a triangle mesh, three vertex indices per triangle
+bool savePLY(
+    const string& filename,
+    const vector<Vector3d>& points,
+    const vector<Color>& colors,
+    const vector<int>& triangles,
+    PlyFormat format)
+{
+    PlyWriter out(filename, format, !triangles.empty());
+    for(size_t i=0; i<points.size(); i++)
+        out.vertex(points[i], i < colors.size() ? colors[i] : Color(255, 255, 255));
+    for(size_t i=0; i+2<triangles.size(); i+=3)
+        out.face(&triangles[i], 3);
+    return out.close();
+}
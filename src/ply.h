@@ -0,0 +1,216 @@
+//PLY file input and output
+#ifndef PLY_H
+#define PLY_H
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "system.h"
+
+//PLY encodings
+enum PlyFormat
+{
+    PLY_ASCII,          //Text, slow but readable
+    PLY_BINARY          //binary_little_endian
+};
+
+//Streaming PLY writer for colored points and polygons.
+//  Vertices and faces are appended as they are produced, so nothing has to
+//  be held in memory.  The header is written with fixed width counts which
+//  are patched by close().  PLY puts all vertices before all faces, so faces
+//  are spooled to a temporary file and copied over at the end.  Output goes
+//  through large buffers, binary files are written without any formatting.
+struct PlyWriter
+{
+    PlyWriter(const std::string& filename, PlyFormat format = PLY_BINARY, bool faces = false);
+
+    //Closes the file if close() was not called
+    ~PlyWriter();
+
+    //Appends a vertex
+    void vertex(float x, float y, float z, const Color& c)
+    {
+        if(format == PLY_BINARY && pos + VERTEX_BYTES <= buffer.size())
+        {
+            encodeVertex(&buffer[pos], x, y, z, c);
+            pos += VERTEX_BYTES;
+            nvertices++;
+        }
+        else
+            slowVertex(x, y, z, c);
+    }
+    void vertex(const Eigen::Vector3d& p, const Color& c)
+    {
+        vertex((float)p.x(), (float)p.y(), (float)p.z(), c);
+    }
+
+    //Appends a polygon over vertices already written (or to be written),
+    //the writer must have been opened with faces
+    void face(const int* indices, int n);
+    void face(int a, int b, int c)
+    {
+        int f[3] = { a, b, c };
+        face(f, 3);
+    }
+
+    //Writes the counts and closes the file, returns false if anything failed
+    bool close();
+
+    //Appends raw vertex records, n vertices of VERTEX_BYTES each (float x,
+    //y, z, uchar b, g, r, little endian).  For writers which format
+    //vertices in parallel into their own buffers.
+    void rawVertices(const void* data, size_t n);
+
+    //Encodes a vertex record for rawVertices(), on any host byte order
+    static void encodeVertex(ubyte* out, float x, float y, float z, const Color& c)
+    {
+        float p[3] = { x, y, z };
+        for(int i=0; i<3; i++)
+        {
+            unsigned u;
+            memcpy(&u, &p[i], 4);
+            out[4*i]   = (ubyte)u;
+            out[4*i+1] = (ubyte)(u >> 8);
+            out[4*i+2] = (ubyte)(u >> 16);
+            out[4*i+3] = (ubyte)(u >> 24);
+        }
+        out[12] = c.b;
+        out[13] = c.g;
+        out[14] = c.r;
+    }
+
+    size_t vertices() const { return nvertices; }
+    size_t faces() const { return nfaces; }
+    bool ok() const { return good; }
+
+    enum { VERTEX_BYTES = 15 };
+
+private:
+    PlyWriter(const PlyWriter&);
+    void operator=(const PlyWriter&);
+
+    void slowVertex(float x, float y, float z, const Color& c);
+    void flush();
+
+    std::string         filename;
+    PlyFormat           format;
+    FILE                *file, *spool;
+    std::vector<ubyte>  buffer, spool_buffer;
+    size_t              pos, spool_pos;
+    long                vertex_count_at, face_count_at;
+    size_t              nvertices, nfaces;
+    bool                with_faces, good;
+};
+
+//Memory mapped PLY reader.
+//  Reads ASCII and binary (either byte order) files with any set of
+//  elements.  Vertex positions and colors are looked up straight in the
+//  mapped file for binary files, ASCII vertices are parsed once on open.
+//  Faces are indexed on open, other elements are skipped.
+struct PlyReader
+{
+    PlyReader(const std::string& filename);
+    ~PlyReader();
+
+    bool ok() const { return good; }
+
+    size_t vertices() const { return nvertices; }
+    size_t faces() const { return face_offsets.empty() ? 0 : face_offsets.size() - 1; }
+    bool hasColors() const { return color_props[0] >= 0 && color_props[1] >= 0 && color_props[2] >= 0; }
+
+    //Vertex i, files without colors give white
+    Eigen::Vector3d point(size_t i) const;
+    Color color(size_t i) const;
+
+    //Vertex indices of face i, n is set to their number
+    const int* face(size_t i, int& n) const
+    {
+        n = (int)(face_offsets[i + 1] - face_offsets[i]);
+        return &face_indices[face_offsets[i]];
+    }
+
+    //Raw vertex records of a binary file, NULL for ASCII files.  Records
+    //are vertexStride() bytes apart, vertexOffset() gives the byte offset
+    //of a property within them (-1 if there is no such property).
+    const ubyte* vertexData() const { return vertex_data; }
+    size_t vertexStride() const { return vertex_stride; }
+    int vertexOffset(const std::string& property) const;
+
+    //Scalar property types
+    enum Type { CHAR, UCHAR, SHORT, USHORT, INT, UINT, FLOAT, DOUBLE, NONE };
+
+private:
+    PlyReader(const PlyReader&);
+    void operator=(const PlyReader&);
+
+    struct Property
+    {
+        std::string name;
+        Type        type, count_type;       //count_type is NONE unless a list
+        int         offset;                 //In fixed size binary records
+    };
+    struct Element
+    {
+        std::string             name;
+        size_t                  count;
+        std::vector<Property>   properties;
+        int                     size;       //Binary record size, -1 if it has lists
+    };
+
+    bool parseHeader(std::vector<Element>& elements);
+    bool readElement(const ubyte*& p, const Element& element);
+    bool value(const ubyte*& p, Type type, double& v) const;
+    double scalar(const ubyte*& p, Type type) const;
+
+    std::string         filename;
+    int                 fd;
+    const ubyte         *map, *end, *body;
+    size_t              map_size;
+    bool                ascii, swap, good;
+
+    //Vertex element, binary records in place or parsed values
+    size_t              nvertices;
+    std::vector<Property> vertex_props;
+    int                 point_props[3], color_props[3];
+    const ubyte*        vertex_data;
+    size_t              vertex_stride;
+    std::vector<float>  parsed_points;
+    std::vector<Color>  parsed_colors;
+
+    std::vector<size_t> face_offsets;
+    std::vector<int>    face_indices;
+};
+
+//Loads the vertices of a PLY file, returns false on failure
+extern bool loadPLY(
+    const std::string& filename,
+    std::vector<Eigen::Vector3d>& points,
+    std::vector<Color>& colors);
+
+//Loads a mesh, polygons are split into triangle fans
+extern bool loadPLY(
+    const std::string& filename,
+    std::vector<Eigen::Vector3d>& points,
+    std::vector<Color>& colors,
+    std::vector<int>& triangles);
+
+//Saves colored points, returns false if writing failed
+extern bool savePLY(
+    const std::string& filename,
+    const std::vector<Eigen::Vector3d>& points,
+    const std::vector<Color>& colors,
+    PlyFormat format = PLY_BINARY);
+
+//Saves a colored triangle mesh, returns false if writing failed
+extern bool savePLY(
+    const std::string& filename,
+    const std::vector<Eigen::Vector3d>& points,
+    const std::vector<Color>& colors,
+    const std::vector<int>& triangles,
+    PlyFormat format = PLY_BINARY);
+
+#endif
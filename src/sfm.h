@@ -13,7 +13,35 @@ std::vector<View>  bundlerSfM(
     std::vector<Image> images, 
     const std::string& bundler_path);
     
+//Runs bundler and copies the camera file it writes (bundle.out) to filename
+bool bundlerCameraFile(
+    const std::vector<Image>& frames,
+    const std::string& bundler_path,
+    const std::string& filename);
+
+//Builds views from frames and a bundler camera file
+std::vector<View> loadBundlerViews(
+    const std::vector<Image>& frames,
+    const std::string& filename);
+
+//Image files of a bundler directory: the ones named in its list.txt, or
+//without a list every jpg, png or ppm image in it, sorted by name
+std::vector<std::string> bundlerImageList(const std::string& directory);
+
 //Parses intermediate data from bundler
 std::vector<View> parseBundlerTemps(const std::string& directory);
 
+//Camera files of calibrated datasets (the Middlebury multiview format): the
+//number of views, then per view an image name relative to the file, K and
+//R as 3x3 row major matrices and t, so that a point X projects to K (R X + t)
+std::vector<std::string> cameraFileImages(const std::string& filename);
+
+//Builds views from frames and a camera file, in the order of its lines
+std::vector<View> loadCameraViews(
+    const std::vector<Image>& frames,
+    const std::string& filename);
+
+//Views of a dataset, views_file is a bundler directory or a camera file
+std::vector<View> loadDatasetViews(const std::string& views_file);
+
 #endif
@@ -1,9 +1,14 @@
 //stdlib includes
+#include <algorithm>
+#include <cctype>
 #include <vector>
 #include <string>
 #include <iostream>
 #include <fstream>
 #include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
 
 //Eigen
 #include <Eigen/Core>
@@ -12,6 +17,7 @@
 //Project
 #include "image.h"
 #include "view.h"
+#include "metrics.h"
 #include "system.h"
 
 using namespace std;
@@ -129,7 +135,7 @@ vector<BundlerCamera*> readBundlerData(const string& filename)
             fin >> pi->camera >> pi->key >> pi->loc.x() >> pi->loc.y();
             p_images.push_back(pi);
         }
-        points.push_back(p);
+        points.push_back(p.cast<float>());
         point_images.push_back(p_images);
     }
     
@@ -137,9 +143,9 @@ vector<BundlerCamera*> readBundlerData(const string& filename)
     return result;
 }
 
-//Calls bundler script
-vector<BundlerCamera*> runBundler(
-    vector<Image> frames, 
+//Calls bundler script, returns the camera file it wrote
+string runBundlerTool(
+    const vector<Image>& frames,
     const string& bundler_path)
 {
     //Create temp directory
@@ -165,14 +171,18 @@ vector<BundlerCamera*> runBundler(
     string bundler_command = bundler_path + " " + temp_directory;
     system(bundler_command.c_str());
     
-    //Read in data from bundler
-    vector<BundlerCamera*> result = 
-        readBundlerData(temp_directory + "/bundle/bundle.out");
-    
     //Return to base directory
     chdir(cur_directory.c_str());
     
-    return result;
+    return temp_directory + "/bundle/bundle.out";
+}
+
+//Calls bundler script and reads in its cameras
+vector<BundlerCamera*> runBundler(
+    vector<Image> frames, 
+    const string& bundler_path)
+{
+    return readBundlerData(runBundlerTool(frames, bundler_path));
 }
 
 
@@ -264,15 +274,57 @@ vector<View>  bundlerSfM(
         runBundler(frames, bundler_path));
 }
 
-//Loads the intermediate bundler data from temporary storage
-//Used for debugging
-vector<View> parseBundlerTemps(const std::string& directory)
+//Runs bundler and keeps its camera file
+bool bundlerCameraFile(
+    const vector<Image>& frames,
+    const string& bundler_path,
+    const string& filename)
 {
+    ifstream fin(runBundlerTool(frames, bundler_path).c_str(), ios::binary);
+    ofstream fout(filename.c_str(), ios::binary);
+    if(!fin || !fout || !(fout << fin.rdbuf()))
+    {
+        cout << "Bundler did not produce cameras for " << filename << endl;
+        return false;
+    }
+    return true;
+}
+
+//Builds views from frames and a camera file written by bundler
+vector<View> loadBundlerViews(
+    const vector<Image>& frames,
+    const string& filename)
+{
+    return convertBundlerData(frames, readBundlerData(filename));
+}
+
+//Images of a bundler directory
+vector<string> bundlerImageList(const string& directory)
+{
+    vector<string> names;
+
     //Use image paths from bundler's list.txt file
     ifstream fin((string(directory) + "/list.txt").c_str());
-    vector<Image> frames;
-    
-    
+    if(!fin)
+    {
+        //No list, take every image in the directory
+        DIR* dir = opendir(directory.c_str());
+        for(dirent* e = dir ? readdir(dir) : NULL; e; e = readdir(dir))
+        {
+            string name = e->d_name;
+            size_t dot = name.rfind('.');
+            string ext = dot == string::npos ? "" : name.substr(dot + 1);
+            for(size_t i=0; i<ext.size(); i++)
+                ext[i] = tolower(ext[i]);
+            if(ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "ppm")
+                names.push_back(directory + "/" + name);
+        }
+        if(dir)
+            closedir(dir);
+        sort(names.begin(), names.end());
+        return names;
+    }
+
     char buffer[1024];
     while(true)
     {
@@ -293,13 +345,26 @@ vector<View> parseBundlerTemps(const std::string& directory)
             }
         }
         
-        string name = directory + "/" + str;
-        
-        cout << "Loading image " << name << endl;
-        
-        frames.push_back(Image(name));
+        names.push_back(directory + "/" + str);
     }
-    
+
+    return names;
+}
+
+//Loads the intermediate bundler data from temporary storage
+//Used for debugging
+vector<View> parseBundlerTemps(const std::string& directory)
+{
+    MetricTimer timer("sfm/bundler");
+
+    vector<Image> frames;
+    vector<string> names = bundlerImageList(directory);
+    for(size_t i=0; i<names.size(); i++)
+    {
+        cout << "Loading image " << names[i] << endl;
+        frames.push_back(Image(names[i]));
+    }
+
     //Convert data to internal format and return
     return convertBundlerData(frames, 
         readBundlerData(directory + "/bundle/bundle.out"));
@@ -0,0 +1,132 @@
+//stdlib includes
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+
+#include <sys/stat.h>
+
+//Eigen
+#include <Eigen/Core>
+
+//Project
+#include "image.h"
+#include "sfm.h"
+#include "view.h"
+#include "metrics.h"
+
+using namespace std;
+using namespace Eigen;
+
+//One line of a camera file
+struct CameraEntry
+{
+    string      name;
+    Matrix3d    K, R;
+    Vector3d    t;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+//Reads a camera file, empty if it is missing or malformed
+static vector<CameraEntry> readCameraFile(const string& filename)
+{
+    vector<CameraEntry> entries;
+    ifstream fin(filename.c_str());
+    int count = 0;
+    if(!(fin >> count) || count <= 0)
+    {
+        cout << "Could not read cameras from " << filename << endl;
+        return entries;
+    }
+
+    //Image names are relative to the camera file
+    size_t slash = filename.rfind('/');
+    string dir = slash == string::npos ? "" : filename.substr(0, slash + 1);
+
+    for(int n=0; n<count; n++)
+    {
+        CameraEntry e;
+        fin >> e.name;
+        for(int i=0; i<3; i++)
+        for(int j=0; j<3; j++)
+            fin >> e.K(i,j);
+        for(int i=0; i<3; i++)
+        for(int j=0; j<3; j++)
+            fin >> e.R(i,j);
+        fin >> e.t(0) >> e.t(1) >> e.t(2);
+        if(!fin)
+        {
+            cout << "Bad camera " << n << " in " << filename << endl;
+            return vector<CameraEntry>();
+        }
+        if(e.name[0] != '/')
+            e.name = dir + e.name;
+        entries.push_back(e);
+    }
+    return entries;
+}
+
+vector<string> cameraFileImages(const string& filename)
+{
+    vector<CameraEntry> entries = readCameraFile(filename);
+    vector<string> names;
+    for(size_t i=0; i<entries.size(); i++)
+        names.push_back(entries[i].name);
+    return names;
+}
+
+vector<View> loadCameraViews(
+    const vector<Image>& frames,
+    const string& filename)
+{
+    vector<CameraEntry> entries = readCameraFile(filename);
+    vector<View> views;
+    if(entries.size() != frames.size())
+    {
+        cout << filename << " has " << entries.size() << " cameras for "
+             << frames.size() << " images" << endl;
+        return views;
+    }
+
+    for(size_t n=0; n<entries.size(); n++)
+    {
+        //World -> camera
+        Matrix4d R = Matrix4d::Identity();
+        R.block(0,0,3,3) = entries[n].R;
+        R.block(0,3,3,1) = entries[n].t;
+
+        //Camera -> pixels, with the projective depth in the last row as
+        //convertBundlerData builds it
+        Matrix4d K = Matrix4d::Zero();
+        K.block(0,0,2,3) = entries[n].K.block(0,0,2,3);
+        K.block(3,0,1,3) = entries[n].K.block(2,0,1,3);
+        K(2,3) = 1.0;
+
+        views.push_back(View(frames[n], R, K));
+    }
+    return views;
+}
+
+vector<View> loadDatasetViews(const string& views_file)
+{
+    struct stat s;
+    if(stat(views_file.c_str(), &s) != 0)
+    {
+        cout << "No views file " << views_file << endl;
+        return vector<View>();
+    }
+    if(S_ISDIR(s.st_mode))
+        return parseBundlerTemps(views_file);
+
+    MetricTimer timer("sfm/cameras");
+
+    vector<Image> frames;
+    vector<string> names = cameraFileImages(views_file);
+    for(size_t i=0; i<names.size(); i++)
+    {
+        cout << "Loading image " << names[i] << endl;
+        frames.push_back(Image(names[i]));
+    }
+    return loadCameraViews(frames, views_file);
+}
@@ -1,13 +1,261 @@
 #ifndef HULL_H
 #define HULL_H
 
+#include <string>
 #include <vector>
 
+#include <boost/function.hpp>
+
 #include "volume.h"
 #include "view.h"
 
 #include <Eigen/Core>
 
+//Progress report passed to carving callbacks
+struct CarveProgress
+{
+    int     level;          //Resolution level (0 = finest)
+    int     pass;           //Pass number within the level
+    int     direction;      //Sweep direction (0-5), -1 for item buffer passes
+    int     plane, planes;  //Current plane / number of planes in the sweep
+                            //(voxels processed / queued for item buffers)
+    size_t  tested;         //Consistency tests run so far
+    size_t  removed;        //Voxels removed so far
+};
+
+typedef boost::function<void (const CarveProgress&)> CarveCallback;
+
+//Visual hull parameters
+struct VisualHullParams
+{
+    VisualHullParams() :
+        background(5),
+        tolerance(0),
+        threads(0) {}
+
+    //Pixels whose mean channel value is at most this are background
+    int background;
+
+    //Number of views which may see a voxel as background before it is carved
+    int tolerance;
+
+    //Number of worker threads, 0 uses all cores
+    int threads;
+};
+
+//Photo hull carving strategies
+enum CarveMode
+{
+    CARVE_SWEEP,        //Six direction plane sweeps with per-view consistency masks
+    CARVE_ITEM_BUFFER   //Generalized voxel coloring with per-view item buffers
+};
+
+//Photo hull parameters
+struct PhotoHullParams
+{
+    PhotoHullParams() :
+        threshold(3000, 3000, 3000),
+        threads(0),
+        levels(1),
+        margin(2),
+        max_passes(0),
+        mode(CARVE_SWEEP),
+        worklist(true),
+        visual_hull(false),
+        approx_pad(-1),
+        approx_threshold(5, 5, 5),
+        deterministic(false),
+        checkpoint_interval(1),
+        resume(true) {}
+
+    //Per channel color variance threshold (in 0-255 units)
+    Eigen::Vector3f threshold;
+
+    //Number of worker threads, 0 uses all cores
+    int threads;
+
+    //Coarse-to-fine levels, each level halves the resolution
+    int levels;
+
+    //Dilation margin (in voxels) of the boundary band refined at each level
+    int margin;
+
+    //Maximum number of passes per level, 0 runs until convergence
+    int max_passes;
+
+    //Carving strategy
+    CarveMode mode;
+
+    //Once sweep passes carve little, only re-test voxels next to or behind
+    //carved ones instead of the whole surface
+    bool worklist;
+
+    //Start carving from the visual hull instead of a solid block
+    bool visual_hull;
+    VisualHullParams hull;
+
+    //Footprint padding (in pixels) of the approximate consistency test used
+    //by the sweeps, negative only tests the center pixels
+    int approx_pad;
+
+    //Per channel variance threshold of the approximate test
+    Eigen::Vector3f approx_threshold;
+
+    //Make the result independent of the number of threads and their
+    //scheduling.  Sweeps test each plane against the volume as it was before
+    //the plane and commit removals in voxel order, which gives a different
+    //(but repeatable) result from the default mode.  Item buffer passes are
+    //always deterministic.
+    bool deterministic;
+
+    //File the carve state is snapshotted to between passes, empty disables
+    //checkpoints
+    std::string checkpoint;
+
+    //Number of passes between snapshots
+    int checkpoint_interval;
+
+    //Continue from the snapshot in the checkpoint file, if there is one made
+    //with the same parameters
+    bool resume;
+
+    //Called after each plane of a sweep (from the calling thread)
+    CarveCallback progress;
+};
+
+//Volumetric graph cut parameters
+struct GraphCutParams
+{
+    GraphCutParams() :
+        threshold(3000, 3000, 3000),
+        smoothness(1.0f),
+        balloon(0.1f),
+        depth(8),
+        max_angle(60),
+        threads(0) {}
+
+    //Per channel color variance at which a surface patch reaches full cost
+    Eigen::Vector3f threshold;
+
+    //Weight of the surface (photo-consistency) cost per voxel face
+    float smoothness;
+
+    //Reward per voxel kept inside, stops the cut from shrinking the surface
+    float balloon;
+
+    //Depth (in voxels, chessboard distance) below the visual hull through
+    //which the surface may move
+    int depth;
+
+    //Views further than this from a voxel's normal (in degrees) do not see it
+    double max_angle;
+
+    //Number of worker threads, 0 uses all cores
+    int threads;
+
+    //Outer bound of the reconstruction
+    VisualHullParams hull;
+};
+
+//Matching costs for depth map stereo
+enum DepthCost
+{
+    DEPTH_NCC,          //Normalized cross correlation, robust to exposure changes
+    DEPTH_SAD           //Sum of absolute differences, cheaper
+};
+
+//Plane sweep depth map parameters
+struct DepthMapParams
+{
+    DepthMapParams() :
+        neighbours(4),
+        planes(96),
+        window(2),
+        cost(DEPTH_NCC),
+        sgm(true),
+        p1(0.03f),
+        p2(0.3f),
+        max_cost(0.4f),
+        threads(0) {}
+
+    //Number of views matched against each reference view
+    int neighbours;
+
+    //Number of depth planes, spaced uniformly in inverse depth over the
+    //bounding box
+    int planes;
+
+    //Matching window radius in pixels
+    int window;
+
+    //Matching cost
+    DepthCost cost;
+
+    //Semi-global aggregation along 4 paths, otherwise winner-take-all
+    bool sgm;
+
+    //SGM penalties (in cost units, 0-1) for changing depth by one plane / more
+    float p1, p2;
+
+    //Pixels whose best cost is above this are left unknown
+    float max_cost;
+
+    //Number of worker threads, 0 uses all cores
+    int threads;
+};
+
+//Depth map of one view
+struct DepthMap
+{
+    DepthMap() : view(-1), width(0), height(0) {}
+
+    //Projective depth at pixel (x, y), 0 where unknown
+    float operator()(int x, int y) const { return depth[x + y * width]; }
+
+    //World position of the center of pixel (x, y) at projective depth w
+    Eigen::Vector3d point(int x, int y, double w) const
+    {
+        return inverse * (w * Eigen::Vector3d(x + 0.5, y + 0.5, 1) - offset);
+    }
+
+    //Index of the reference view
+    int view;
+
+    int width, height;
+
+    //Projective depth (w) and matching cost (0 best, 1 worst) per pixel
+    std::vector<float> depth, cost;
+
+    //Back projection, the inverse of the left 3x3 block of the camera matrix
+    //and its last column
+    Eigen::Matrix3d inverse;
+    Eigen::Vector3d offset;
+};
+
+//Depth map fusion parameters
+struct TsdfParams
+{
+    TsdfParams() :
+        truncation(3.0f),
+        max_weight(64.0f),
+        batch(0),
+        threads(0) {}
+
+    //Distance (in voxels) over which the signed distance is tracked, depth
+    //samples further behind a voxel do not update it
+    float truncation;
+
+    //Cap on the accumulated weight, older views are forgotten beyond this
+    float max_weight;
+
+    //Number of depth maps computed before they are fused and discarded,
+    //0 uses one per thread
+    int batch;
+
+    //Number of worker threads, 0 uses all cores
+    int threads;
+};
+
 //Computes a photohull from a set of views
 extern Volume stereoPhotoHull(
     std::vector<View> views, 
@@ -15,6 +263,57 @@ extern Volume stereoPhotoHull(
     Eigen::Vector3d low, 
     Eigen::Vector3d high);
 
+extern Volume stereoPhotoHull(
+    std::vector<View> views,
+    Eigen::Vector3i dim,
+    Eigen::Vector3d low,
+    Eigen::Vector3d high,
+    const PhotoHullParams& params);
+
+//Computes the visual hull of a set of views from their silhouettes
+extern Volume visualHull(
+    const std::vector<View>& views,
+    Eigen::Vector3i dim,
+    Eigen::Vector3d low,
+    Eigen::Vector3d high,
+    const VisualHullParams& params = VisualHullParams());
+
+//Reconstructs a surface as the minimum cut of a voxel graph inside the visual
+//hull, weighted by photo-consistency
+extern Volume stereoGraphCut(
+    const std::vector<View>& views,
+    Eigen::Vector3i dim,
+    Eigen::Vector3d low,
+    Eigen::Vector3d high,
+    const GraphCutParams& params = GraphCutParams());
+
+//Computes a depth map for every view by plane sweeping the bounding box
+//against its nearest views
+extern std::vector<DepthMap> stereoDepthMaps(
+    const std::vector<View>& views,
+    Eigen::Vector3d low,
+    Eigen::Vector3d high,
+    const DepthMapParams& params = DepthMapParams());
+
+//Computes the depth map of a single view, for streaming views one at a time
+extern DepthMap stereoDepthMap(
+    const std::vector<View>& views,
+    int view,
+    Eigen::Vector3d low,
+    Eigen::Vector3d high,
+    const DepthMapParams& params = DepthMapParams());
+
+//Computes depth maps and fuses them into a truncated signed distance field,
+//returns the voxels within the truncation band behind the surface.  Depth
+//maps are computed and fused a batch at a time, so memory does not grow with
+//the number of views.
+extern Volume stereoTsdf(
+    const std::vector<View>& views,
+    Eigen::Vector3i dim,
+    Eigen::Vector3d low,
+    Eigen::Vector3d high,
+    const DepthMapParams& depth = DepthMapParams(),
+    const TsdfParams& params = TsdfParams());
 
 //TODO: Add other stereo methods
 
@@ -0,0 +1,206 @@
+//STL
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+//Eigen
+#include <Eigen/Core>
+
+//Project files
+#include "image.h"
+#include "synthetic.h"
+#include "view.h"
+
+using namespace std;
+using namespace Eigen;
+
+Color syntheticTexture(const Vector3d& p)
+{
+    return Color(
+        (ubyte)(128 + 100 * sin(4 * p.x())),
+        (ubyte)(128 + 100 * sin(3 * p.y() + 1)),
+        (ubyte)(128 + 100 * sin(5 * p.z() + 2)));
+}
+
+bool syntheticInside(const SyntheticParams& params, const Vector3d& p)
+{
+    if(params.shape == SYNTHETIC_CUBE)
+        return fabs(p.x()) <= params.size && fabs(p.y()) <= params.size && fabs(p.z()) <= params.size;
+    return p.squaredNorm() <= params.size * params.size;
+}
+
+void syntheticBounds(const SyntheticParams& params, Vector3d& low, Vector3d& high)
+{
+    //Covers the cube corners too, plus a margin of a few voxels
+    double r = params.size * (params.shape == SYNTHETIC_CUBE ? 1.25 : 1.1);
+    low  = Vector3d::Constant(-r);
+    high = Vector3d::Constant(r);
+}
+
+//Distance along a ray to the shape, false if it misses
+static bool intersect(const SyntheticParams& params, const Vector3d& o, const Vector3d& d, double& t)
+{
+    if(params.shape == SYNTHETIC_CUBE)
+    {
+        double t0 = -1e30, t1 = 1e30;
+        for(int i=0; i<3; i++)
+        {
+            if(fabs(d[i]) < 1e-12)
+            {
+                if(fabs(o[i]) > params.size)
+                    return false;
+                continue;
+            }
+            double a = (-params.size - o[i]) / d[i],
+                   b = ( params.size - o[i]) / d[i];
+            t0 = max(t0, min(a, b));
+            t1 = min(t1, max(a, b));
+        }
+        t = t0;
+        return t0 <= t1 && t0 > 0;
+    }
+
+    //d is unit length
+    double b = o.dot(d), c = o.squaredNorm() - params.size * params.size;
+    double disc = b * b - c;
+    if(disc < 0)
+        return false;
+    t = -b - sqrt(disc);
+    return t > 0;
+}
+
+//Camera of view k, R maps world to camera coordinates
+static Matrix4d cameraPose(const SyntheticParams& params, int k)
+{
+    double a  = 2 * M_PI * k / params.views,
+           el = (k % 3 - 1) * 0.4;
+    Vector3d c = params.distance * Vector3d(cos(a) * cos(el), sin(el), sin(a) * cos(el));
+
+    //The camera looks down -z, so z points from the origin to the camera
+    Vector3d z = c.normalized(),
+             x = Vector3d(0, 1, 0).cross(z).normalized(),
+             y = z.cross(x);
+
+    Matrix4d R = Matrix4d::Identity();
+    for(int j=0; j<3; j++)
+    {
+        R(0,j) = x[j];
+        R(1,j) = y[j];
+        R(2,j) = z[j];
+    }
+    R.block(0,3,3,1) = -(R.block(0,0,3,3) * c);
+    return R;
+}
+
+//Intrinsics in the form convertBundlerData builds them
+static Matrix4d cameraIntrinsic(const SyntheticParams& params)
+{
+    Matrix4d
+        K = Matrix4d::Identity(),
+        P = Matrix4d::Zero();
+
+    K(1,1) = -1.0;
+    K(0,3) = params.width  / 2.0;
+    K(1,3) = params.height / 2.0;
+
+    P(0,0) = -params.focal;
+    P(1,1) = -params.focal;
+    P(2,3) = 1.0;
+    P(3,2) = 1.0;
+    return K * P;
+}
+
+vector<View> renderSyntheticScene(const SyntheticParams& params)
+{
+    vector<Image> images(params.views);
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int k=0; k<params.views; k++)
+    {
+        Matrix4d R = cameraPose(params, k);
+        Matrix3d rot = R.block(0,0,3,3);
+        Vector3d c = -(rot.transpose() * R.block(0,3,3,1));
+
+        //Per view generator, so the images do not depend on the thread count
+        unsigned long long state = (unsigned long long)params.seed * 0x9E3779B97F4A7C15ULL + k;
+
+        Image img(params.width, params.height);
+        ubyte* data = (ubyte*)img;
+        for(int y=0; y<params.height; y++)
+        {
+            ubyte* row = data + y * img.widthStep();
+            for(int x=0; x<params.width; x++)
+            {
+                Vector3d dir(
+                     (x + 0.5 - params.width  / 2.0) / params.focal,
+                    -(y + 0.5 - params.height / 2.0) / params.focal,
+                    -1);
+                dir = (rot.transpose() * dir).normalized();
+
+                Color col;
+                double t;
+                if(intersect(params, c, dir, t))
+                    col = syntheticTexture(c + t * dir);
+                else
+                {
+                    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                    col = Color((ubyte)(state >> 56), (ubyte)(state >> 48), (ubyte)(state >> 40));
+                }
+                row[3*x]   = col.b;
+                row[3*x+1] = col.g;
+                row[3*x+2] = col.r;
+            }
+        }
+
+        images[k] = img;
+    }
+
+    vector<View> views;
+    for(int k=0; k<params.views; k++)
+        views.push_back(View(images[k], cameraPose(params, k), cameraIntrinsic(params)));
+    return views;
+}
+
+bool saveSyntheticBundler(
+    const string& directory,
+    const SyntheticParams& params,
+    const vector<View>& views)
+{
+    mkdir(directory.c_str(), 0755);
+    mkdir((directory + "/bundle").c_str(), 0755);
+
+    ofstream list((directory + "/list.txt").c_str());
+    ofstream bundle((directory + "/bundle/bundle.out").c_str());
+    if(!list || !bundle)
+    {
+        cout << "Could not write synthetic scene to " << directory << endl;
+        return false;
+    }
+
+    bundle << "# Bundle file v0.3" << endl
+           << views.size() << " 0" << endl;
+    bundle.precision(17);
+
+    for(size_t k=0; k<views.size(); k++)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "frame%04d.png", (int)k);
+        views[k].image().save(directory + "/" + name);
+        list << name << endl;
+
+        Matrix4d R = views[k].world().matrix();
+        bundle << params.focal << " 0 0" << endl;
+        for(int i=0; i<3; i++)
+            bundle << R(i,0) << " " << R(i,1) << " " << R(i,2) << endl;
+        bundle << R(0,3) << " " << R(1,3) << " " << R(2,3) << endl;
+    }
+
+    return !list.fail() && !bundle.fail();
+}
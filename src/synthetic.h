@@ -0,0 +1,75 @@
+//Synthetic scenes: a textured shape of known geometry seen from known
+//cameras, for testing and benchmarking without real datasets
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "system.h"
+#include "view.h"
+
+//Shapes that can be rendered
+enum SyntheticShape
+{
+    SYNTHETIC_SPHERE,
+    SYNTHETIC_CUBE
+};
+
+//Scene parameters
+struct SyntheticParams
+{
+    SyntheticParams() :
+        shape(SYNTHETIC_SPHERE),
+        size(0.5),
+        views(16),
+        width(320),
+        height(240),
+        focal(400),
+        distance(3),
+        seed(1) {}
+
+    //Shape centered on the origin, size is the sphere radius or half the
+    //cube edge
+    SyntheticShape shape;
+    double size;
+
+    //Cameras are spread over a ring around the origin at the given
+    //distance, alternately above, level with and below the shape.  All of
+    //them look at the origin, y is up.
+    int views;
+    int width, height;
+    double focal;
+    double distance;
+
+    //Seed of the background noise, the same seed renders the same images
+    unsigned seed;
+};
+
+//Smooth color of the shape surface at a point
+extern Color syntheticTexture(const Eigen::Vector3d& p);
+
+//True if a point is inside the shape
+extern bool syntheticInside(const SyntheticParams& params, const Eigen::Vector3d& p);
+
+//Box holding the shape with some margin, for carving the scene
+extern void syntheticBounds(
+    const SyntheticParams& params,
+    Eigen::Vector3d& low,
+    Eigen::Vector3d& high);
+
+//Renders the views.  Pixels that miss the shape get random colors, so only
+//the shape is photo-consistent.
+extern std::vector<View> renderSyntheticScene(const SyntheticParams& params);
+
+//Writes views in the layout parseBundlerTemps reads: images named in
+//list.txt and the cameras in bundle/bundle.out.  The directory is created
+//if needed.
+extern bool saveSyntheticBundler(
+    const std::string& directory,
+    const SyntheticParams& params,
+    const std::vector<View>& views);
+
+#endif
@@ -2,8 +2,17 @@
 #include <string>
 #include <cstdlib>
 
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+
 #include "system.h"
 
+#ifdef _OPENMP
+#  include <omp.h>
+#endif
+
 using namespace std;
 
 //Locates the temp directory
@@ -18,6 +27,110 @@ string getTempDirectory()
     return "/tmp/";
 }
 
+//Physical memory size
+size_t physicalMemory()
+{
+    long pages = sysconf(_SC_PHYS_PAGES), size = sysconf(_SC_PAGESIZE);
+    if(pages <= 0 || size <= 0)
+        return 0;
+    return (size_t)pages * (size_t)size;
+}
+
+//High water mark of the resident set, which Linux reports in kilobytes
+size_t peakMemory()
+{
+    rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return (size_t)usage.ru_maxrss * 1024;
+}
+
+//Wall clock time
+double wallTime()
+{
+    timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec + 1e-6 * t.tv_usec;
+}
+
+//Sets the number of worker threads
+void setThreadCount(int n)
+{
+#ifdef _OPENMP
+    omp_set_num_threads(n > 0 ? n : omp_get_num_procs());
+#endif
+}
+
+//Number of worker threads used by parallel loops
+int threadCount()
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+//Index of the calling thread within a parallel region
+int threadIndex()
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+BackgroundThread::BackgroundThread() : handle(NULL), done(1) {}
+
+BackgroundThread::~BackgroundThread()
+{
+    wait();
+}
+
+void* BackgroundThread::run(void* self)
+{
+    BackgroundThread* t = (BackgroundThread*)self;
+    t->task();
+    __sync_lock_test_and_set(&t->done, 1);
+    return NULL;
+}
+
+bool BackgroundThread::start(const boost::function<void ()>& f)
+{
+    if(busy())
+        return false;
+    wait();
+
+    task = f;
+    done = 0;
+    pthread_t* t = new pthread_t;
+    if(pthread_create(t, NULL, &BackgroundThread::run, this) != 0)
+    {
+        //No thread, run it here instead
+        delete t;
+        run(this);
+        return true;
+    }
+    handle = t;
+    return true;
+}
+
+bool BackgroundThread::busy() const
+{
+    return __sync_fetch_and_add(const_cast<volatile int*>(&done), 0) == 0;
+}
+
+void BackgroundThread::wait()
+{
+    if(!handle)
+        return;
+    pthread_t* t = (pthread_t*)handle;
+    pthread_join(*t, NULL);
+    delete t;
+    handle = NULL;
+}
+
 //Pixel ostream
 ostream& operator<<(ostream& os, const Color & pix)
 {
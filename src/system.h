@@ -6,6 +6,8 @@
 #include <vector>
 #include <string>
 
+#include <boost/function.hpp>
+
 #include <Eigen/Core>
 
 //Alignment macro
@@ -22,6 +24,67 @@ template<typename T> T saturate(T a)            { return clamp(a, (T)0, (T)1); }
 //Retrieves temporary directory
 extern std::string getTempDirectory();
 
+//Bytes of physical memory, 0 if unknown
+extern size_t physicalMemory();
+
+//Peak resident memory of the process so far in bytes, 0 if unknown
+extern size_t peakMemory();
+
+//Wall clock time in seconds, for timing
+extern double wallTime();
+
+//Worker thread control (OpenMP), all of these work without OpenMP too
+//  setThreadCount(0) restores the default of one thread per core
+extern void setThreadCount(int n);
+extern int  threadCount();
+extern int  threadIndex();
+
+//Keeps the thread count of the calling code: sets n threads (when n > 0)
+//until the end of the scope, then restores the count it found
+struct ThreadCountScope
+{
+    explicit ThreadCountScope(int n) : previous(threadCount())
+    {
+        if(n > 0)
+            setThreadCount(n);
+    }
+    ~ThreadCountScope() { setThreadCount(previous); }
+
+private:
+    ThreadCountScope(const ThreadCountScope&);
+    void operator=(const ThreadCountScope&);
+
+    int previous;
+};
+
+//A background thread (pthreads) running one task at a time, for work such
+//as I/O which should not hold up the OpenMP workers
+struct BackgroundThread
+{
+    BackgroundThread();
+    ~BackgroundThread();
+
+    //Starts task, returns false (and does nothing) if the previous task is
+    //still running
+    bool start(const boost::function<void ()>& task);
+
+    //True while a task is running
+    bool busy() const;
+
+    //Waits for the current task
+    void wait();
+
+private:
+    BackgroundThread(const BackgroundThread&);
+    void operator=(const BackgroundThread&);
+
+    static void* run(void* self);
+
+    boost::function<void ()>    task;
+    void*                       handle;
+    volatile int                done;
+};
+
 //Color data type with interface to Eigen
 // Somewhat tedious, but necessary due to the fact that Eigen's internal memory layout is not
 // compatible with the Color format used by OpenCV.
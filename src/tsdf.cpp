@@ -0,0 +1,260 @@
+//Truncated signed distance fusion.
+//  Each depth map first allocates the bricks around its samples, then every
+//  allocated brick in the view frustum is updated in parallel.  Voxels store
+//  the running mean of the distance to the surface along the ray, for samples
+//  within the truncation band on either side.
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include "tsdf.h"
+#include "carve.h"
+#include "metrics.h"
+#include "system.h"
+
+using namespace std;
+using namespace Eigen;
+
+//Voxels further than this many bands in front of a sample are not updated.
+//Carving all of the free space along a ray lets a few bad depth samples
+//erase surfaces seen well by the other views.
+static const float FREE_SPACE = 1.0f;
+
+TsdfVolume::TsdfVolume(
+    Vector3i dim_,
+    Vector3d low,
+    Vector3d high,
+    const TsdfParams& params_) :
+        params(params_),
+        dim(dim_),
+        colors(dim_, low, high)
+{
+    colors.fill(Color(0,0,0));
+    bdim = colors.brickDims();
+    bricks.resize((size_t)bdim.x() * bdim.y() * bdim.z());
+}
+
+//Fuses one depth map
+void TsdfVolume::integrate(const View& view, const DepthMap& map)
+{
+    CarveView   cv(view, colors);
+    Matrix4d    X     = colors.xform().matrix();
+    float       trunc = params.truncation;
+
+    //Bricks within the band around some sample, listed per thread
+    vector< vector<size_t> > touched(threadCount());
+
+    #pragma omp parallel for schedule(dynamic, 8)
+    for(int y=0; y<map.height; y++)
+    {
+        vector<size_t>& out = touched[threadIndex()];
+        for(int x=0; x<map.width; x++)
+        {
+            float w = map(x, y);
+            if(w <= 0)
+                continue;
+            Vector3d q = X.block(0,0,3,3) * map.point(x, y, w) + X.block(0,3,3,1);
+
+            int lo[3], hi[3];
+            bool inside = true;
+            for(int a=0; a<3; a++)
+            {
+                lo[a] = max((int)floor(q[a] - trunc), 0);
+                hi[a] = min((int)floor(q[a] + trunc), dim[a] - 1);
+                inside = inside && lo[a] <= hi[a];
+                lo[a] >>= Volume::BRICK_BITS;
+                hi[a] >>= Volume::BRICK_BITS;
+            }
+            if(!inside)
+                continue;
+
+            for(int bz=lo[2]; bz<=hi[2]; bz++)
+            for(int by=lo[1]; by<=hi[1]; by++)
+            for(int bx=lo[0]; bx<=hi[0]; bx++)
+            {
+                size_t i = bx + bdim.x() * ((size_t)by + bdim.y() * bz);
+                if(out.empty() || out.back() != i)
+                    out.push_back(i);
+            }
+        }
+    }
+
+    //Allocate new bricks, empty space in front of the surface
+    for(size_t t=0; t<touched.size(); t++)
+    for(size_t k=0; k<touched[t].size(); k++)
+    {
+        BrickPtr& b = bricks[touched[t][k]];
+        if(b)
+            continue;
+        b = BrickPtr(new Brick);
+        std::fill(b->sdf, b->sdf + Volume::BRICK_VOXELS, 1.0f);
+        std::fill(b->weight, b->weight + Volume::BRICK_VOXELS, 0.0f);
+        std::fill(b->color_weight, b->color_weight + Volume::BRICK_VOXELS, 0.0f);
+    }
+    vector< vector<size_t> >().swap(touched);
+
+    //Frustum culling, keep the allocated bricks whose corners project into
+    //the image.  Bricks straddling the camera plane are kept.
+    vector<size_t> visible;
+    for(size_t i=0; i<bricks.size(); i++)
+    {
+        if(!bricks[i])
+            continue;
+
+        Vector3i b(i % bdim.x(), (i / bdim.x()) % bdim.y(), i / ((size_t)bdim.x() * bdim.y()));
+        Vector3i lo = b * (int)Volume::BRICK_SIZE;
+
+        double umin = 1e30, umax = -1e30, vmin = 1e30, vmax = -1e30;
+        int behind = 0;
+        for(int c=0; c<8; c++)
+        {
+            double u, v;
+            if(!cv.project(
+                lo.x() + (c & 1 ? Volume::BRICK_SIZE : 0),
+                lo.y() + ((c >> 1) & 1 ? Volume::BRICK_SIZE : 0),
+                lo.z() + (c >> 2 ? Volume::BRICK_SIZE : 0), u, v))
+            {
+                behind++;
+                continue;
+            }
+            umin = min(umin, u); umax = max(umax, u);
+            vmin = min(vmin, v); vmax = max(vmax, v);
+        }
+        if(behind == 8 || (behind == 0 &&
+            (umax < 0 || vmax < 0 || umin >= map.width || vmin >= map.height)))
+            continue;
+
+        visible.push_back(i);
+        colors.detach(lo, lo + Vector3i::Constant(Volume::BRICK_SIZE));
+    }
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int k=0; k<(int)visible.size(); k++)
+    {
+        size_t   i = visible[k];
+        Vector3i b(i % bdim.x(), (i / bdim.x()) % bdim.y(), i / ((size_t)bdim.x() * bdim.y()));
+        Brick&   brick = *bricks[i];
+        Color*   col   = colors.writableBrick(b);
+
+        for(int z=0; z<Volume::BRICK_SIZE; z++)
+        for(int y=0; y<Volume::BRICK_SIZE; y++)
+        for(int x=0; x<Volume::BRICK_SIZE; x++)
+        {
+            Vector3i p = b * (int)Volume::BRICK_SIZE + Vector3i(x, y, z);
+            if(p.x() >= dim.x() || p.y() >= dim.y() || p.z() >= dim.z())
+                continue;
+
+            Vector3d c(p.x() + 0.5, p.y() + 0.5, p.z() + 0.5);
+            double u, v, w;
+            if(!cv.project(c.x(), c.y(), c.z(), u, v, w) ||
+                u < 0 || v < 0 || u >= map.width || v >= map.height)
+                continue;
+            int px = (int)u, py = (int)v;
+            float d = map(px, py);
+            if(d <= 0)
+                continue;
+
+            //Points on a ray scale with their projective depth, so the
+            //surface lies at (d - w) / w times the distance to the camera
+            float dist = (float)((cv.center - c).norm() * (d - w) / w);
+            if(dist < -trunc || dist > FREE_SPACE * trunc)
+                continue;
+
+            int j = x + Volume::BRICK_SIZE * (y + Volume::BRICK_SIZE * z);
+            float W = brick.weight[j];
+            brick.sdf[j]    = (brick.sdf[j] * W + min(dist / trunc, 1.0f)) / (W + 1);
+            brick.weight[j] = min(W + 1, params.max_weight);
+
+            if(dist >= trunc)
+                continue;
+            float  C  = brick.color_weight[j];
+            const Color& s = cv.pixel(px, py);
+            Color& o  = col[j];
+            o.r = (ubyte)((o.r * C + s.r) / (C + 1) + 0.5f);
+            o.g = (ubyte)((o.g * C + s.g) / (C + 1) + 0.5f);
+            o.b = (ubyte)((o.b * C + s.b) / (C + 1) + 0.5f);
+            brick.color_weight[j] = min(C + 1, params.max_weight);
+        }
+    }
+}
+
+//Extracts the band behind the zero crossing as a colored volume
+Volume TsdfVolume::volume() const
+{
+    //Unallocated bricks are black in the colors already
+    Volume result = colors;
+    vector<size_t> live;
+    for(size_t i=0; i<bricks.size(); i++)
+    {
+        if(!bricks[i])
+            continue;
+        Vector3i b(i % bdim.x(), (i / bdim.x()) % bdim.y(), i / ((size_t)bdim.x() * bdim.y()));
+        Vector3i lo = b * (int)Volume::BRICK_SIZE;
+        result.detach(lo, lo + Vector3i::Constant(Volume::BRICK_SIZE));
+        live.push_back(i);
+    }
+
+    #pragma omp parallel for schedule(dynamic, 4)
+    for(int k=0; k<(int)live.size(); k++)
+    {
+        size_t       i = live[k];
+        Vector3i     b(i % bdim.x(), (i / bdim.x()) % bdim.y(), i / ((size_t)bdim.x() * bdim.y()));
+        const Brick& brick = *bricks[i];
+        Color*       col   = result.writableBrick(b);
+
+        for(int j=0; j<Volume::BRICK_VOXELS; j++)
+        {
+            if(brick.weight[j] <= 0 || brick.sdf[j] > 0)
+                col[j] = Color(0,0,0);
+            else if(col[j] == Color(0,0,0))
+                col[j] = Color(1,1,1);
+        }
+    }
+
+    return result;
+}
+
+size_t TsdfVolume::allocated() const
+{
+    size_t n = 0;
+    for(size_t i=0; i<bricks.size(); i++)
+        if(bricks[i])
+            n++;
+    return n;
+}
+
+//Depth map fusion, a batch of views at a time
+Volume stereoTsdf(
+    const vector<View>& views,
+    Vector3i dim,
+    Vector3d low,
+    Vector3d high,
+    const DepthMapParams& depth,
+    const TsdfParams& params)
+{
+    MetricTimer timer("tsdf");
+
+    ThreadCountScope threads(params.threads);
+
+    TsdfVolume tsdf(dim, low, high, params);
+    int nviews = (int)views.size();
+    int batch  = params.batch > 0 ? params.batch : threadCount();
+
+    for(int b0=0; b0<nviews; b0+=batch)
+    {
+        int b1 = min(b0 + batch, nviews);
+        vector<DepthMap> maps(b1 - b0);
+
+        #pragma omp parallel for schedule(dynamic, 1)
+        for(int i=b0; i<b1; i++)
+            maps[i - b0] = stereoDepthMap(views, i, low, high, depth);
+
+        for(int i=b0; i<b1; i++)
+            tsdf.integrate(views[i], maps[i - b0]);
+    }
+
+    return tsdf.volume();
+}
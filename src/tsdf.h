@@ -0,0 +1,93 @@
+//Truncated signed distance fusion of depth maps
+#ifndef TSDF_H
+#define TSDF_H
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <Eigen/Core>
+
+#include "stereo.h"
+#include "system.h"
+#include "view.h"
+#include "volume.h"
+
+//Sparse truncated signed distance field over a voxel grid.
+//  Distances are in units of the truncation band, positive in front of the
+//  surface.  Bricks are allocated only where some depth sample lands within
+//  the band, the rest of the grid costs one pointer per brick.  Colors are a
+//  running average kept in a Volume of the same size, whose untouched bricks
+//  all share one empty brick.
+struct TsdfVolume
+{
+    //Voxel data of one brick.  Colors only count samples within the band,
+    //so they have their own weight.
+    struct Brick
+    {
+        float sdf[Volume::BRICK_VOXELS];
+        float weight[Volume::BRICK_VOXELS];
+        float color_weight[Volume::BRICK_VOXELS];
+    };
+    typedef boost::shared_ptr<Brick> BrickPtr;
+
+    TsdfVolume(
+        Eigen::Vector3i dim,
+        Eigen::Vector3d low,
+        Eigen::Vector3d high,
+        const TsdfParams& params = TsdfParams());
+
+    //Fuses the depth map of a view, the map may be discarded afterwards
+    void integrate(const View& view, const DepthMap& map);
+
+    //Field access, voxels which were never observed are at +1 with weight 0
+    float sdf(const Eigen::Vector3i& p) const
+    {
+        const Brick* b = brick(p);
+        return b ? b->sdf[voxelIndex(p)] : 1.0f;
+    }
+    float weight(const Eigen::Vector3i& p) const
+    {
+        const Brick* b = brick(p);
+        return b ? b->weight[voxelIndex(p)] : 0.0f;
+    }
+    Color color(const Eigen::Vector3i& p) const { return colors(p); }
+
+    //Voxels behind the zero crossing (and within the band), with their colors
+    Volume volume() const;
+
+    Eigen::Vector3i size() const { return colors.size(); }
+
+    //World -> voxel transform
+    Eigen::Transform3d xform() const { return colors.xform(); }
+
+    //Number of allocated bricks
+    size_t allocated() const;
+
+    TsdfParams params;
+
+private:
+    const Brick* brick(const Eigen::Vector3i& p) const
+    {
+        if(p.x() < 0 || p.y() < 0 || p.z() < 0 ||
+            p.x() >= dim.x() || p.y() >= dim.y() || p.z() >= dim.z())
+            return 0;
+        return bricks[brickIndex(p)].get();
+    }
+    size_t brickIndex(const Eigen::Vector3i& p) const
+    {
+        return (p.x() >> Volume::BRICK_BITS) + bdim.x() *
+            ((size_t)(p.y() >> Volume::BRICK_BITS) + bdim.y() * (p.z() >> Volume::BRICK_BITS));
+    }
+    static int voxelIndex(const Eigen::Vector3i& p)
+    {
+        return (p.x() & Volume::BRICK_MASK) + Volume::BRICK_SIZE *
+            ((p.y() & Volume::BRICK_MASK) + Volume::BRICK_SIZE * (p.z() & Volume::BRICK_MASK));
+    }
+
+    Eigen::Vector3i                dim, bdim;
+    std::vector<BrickPtr>   bricks;
+    Volume                  colors;
+};
+
+#endif
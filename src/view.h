@@ -40,8 +40,9 @@ struct View
     }
     
     //Matrix accessors
-    Eigen::Vector3d center() const          { return R->block(0,3,3,1); }
-    Eigen::Matrix3d rotation() const        { return R->block(0,3,0,3); }
+    //  R maps world -> camera coordinates, so the center is -R^T t
+    Eigen::Vector3d center() const          { return -(rotation().transpose() * R->block(0,3,3,1)); }
+    Eigen::Matrix3d rotation() const        { return R->block(0,0,3,3); }
     Eigen::Transform3d intrinsic() const    { return Eigen::Transform3d(*K); }
     Eigen::Transform3d camera() const       { return Eigen::Transform3d((*K) * (*R)); }
     Eigen::Transform3d world() const        { return Eigen::Transform3d(*R); }
@@ -0,0 +1,211 @@
+//Silhouette based visual hull, carved hierarchically over an octree
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "stereo.h"
+#include "carve.h"
+#include "metrics.h"
+#include "system.h"
+
+using namespace std;
+using namespace Eigen;
+
+//Side length of the octree cells handed out to worker threads
+static const int VISUAL_HULL_TASK_SIZE = 32;
+
+//Classification of a cell against one silhouette
+enum CellClass
+{
+    CELL_OUT,       //Projects entirely onto background
+    CELL_IN,        //Projects entirely onto foreground
+    CELL_PARTIAL,   //Straddles the silhouette boundary or the image border
+    CELL_UNSEEN     //Projects entirely outside the image
+};
+
+//Silhouette of one view, stored as an integral image of foreground pixels
+struct Silhouette
+{
+    Silhouette(const View& v, const Volume& volume, int background) :
+        view(v, volume),
+        stride(view.width + 1),
+        sum((size_t)stride * (view.height + 1), 0)
+    {
+        //Pixels darker than background (mean over channels) are not part of the object
+        for(int y=0; y<view.height; y++)
+        {
+            unsigned row = 0;
+            for(int x=0; x<view.width; x++)
+            {
+                const Color& c = view.pixel(x, y);
+                row += 3 * background < (int)c.r + (int)c.g + (int)c.b;
+                sum[(y + 1) * stride + x + 1] = sum[y * stride + x + 1] + row;
+            }
+        }
+    }
+
+    //Number of foreground pixels in [x0,x1] x [y0,y1]
+    unsigned count(int x0, int y0, int x1, int y1) const
+    {
+        return
+            sum[(y1 + 1) * stride + x1 + 1] - sum[y0 * stride + x1 + 1] -
+            sum[(y1 + 1) * stride + x0]     + sum[y0 * stride + x0];
+    }
+
+    //Classifies the box [lo, hi) in voxel coordinates
+    CellClass classify(const Vector3i& lo, const Vector3i& hi) const
+    {
+        double umin = 1e30, umax = -1e30, vmin = 1e30, vmax = -1e30;
+        for(int i=0; i<8; i++)
+        {
+            double u, v;
+            if(!view.project(
+                    i & 1        ? hi.x() : lo.x(),
+                    (i >> 1) & 1 ? hi.y() : lo.y(),
+                    i >> 2       ? hi.z() : lo.z(), u, v))
+                return CELL_PARTIAL;
+            umin = min(umin, u); umax = max(umax, u);
+            vmin = min(vmin, v); vmax = max(vmax, v);
+        }
+
+        if(umax < 0 || vmax < 0 || umin >= view.width || vmin >= view.height)
+            return CELL_UNSEEN;
+        if(umin < 0 || vmin < 0 || umax >= view.width || vmax >= view.height)
+            return CELL_PARTIAL;
+
+        int x0 = (int)umin, y0 = (int)vmin, x1 = (int)umax, y1 = (int)vmax;
+        unsigned n = count(x0, y0, x1, y1);
+        if(n == 0)
+            return CELL_OUT;
+        if(n == (unsigned)((x1 - x0 + 1) * (y1 - y0 + 1)))
+            return CELL_IN;
+        return CELL_PARTIAL;
+    }
+
+    CarveView           view;
+    int                 stride;
+    vector<unsigned>    sum;
+};
+
+
+//Carves the cell [lo, hi), solid cells are written white
+static void carveCell(
+    const vector<Silhouette>&   sils,
+    const VisualHullParams&     params,
+    Volume&                     volume,
+    const Vector3i&             lo,
+    const Vector3i&             hi)
+{
+    //Single voxel, test its center pixel
+    if(hi - lo == Vector3i(1,1,1))
+    {
+        int seen = 0, background = 0;
+        for(size_t i=0; i<sils.size(); i++)
+        {
+            double u, v;
+            const CarveView& view = sils[i].view;
+            if(!view.project(lo.x() + 0.5, lo.y() + 0.5, lo.z() + 0.5, u, v) ||
+                u < 0 || v < 0 || u >= view.width || v >= view.height)
+                continue;
+            seen++;
+            if(sils[i].count((int)u, (int)v, (int)u, (int)v) == 0 && ++background > params.tolerance)
+                return;
+        }
+        if(seen > 0)
+            volume(lo) = Color(255, 255, 255);
+        return;
+    }
+
+    int in = 0, out = 0, partial = 0;
+    for(size_t i=0; i<sils.size(); i++)
+    {
+        switch(sils[i].classify(lo, hi))
+        {
+            case CELL_OUT:      out++;      break;
+            case CELL_IN:       in++;       break;
+            case CELL_PARTIAL:  partial++;  break;
+            case CELL_UNSEEN:               break;
+        }
+
+        //Empty for good
+        if(out > params.tolerance)
+            return;
+    }
+
+    //Not seen by any view
+    if(in + out + partial == 0)
+        return;
+
+    //Solid, every voxel is inside enough silhouettes
+    if(in > 0 && out + partial <= params.tolerance)
+    {
+        for(int z=lo.z(); z<hi.z(); z++)
+        for(int y=lo.y(); y<hi.y(); y++)
+        for(int x=lo.x(); x<hi.x(); x++)
+            volume(Vector3i(x, y, z)) = Color(255, 255, 255);
+        return;
+    }
+
+    //Split into octants, axes one voxel long only have an upper half
+    Vector3i mid = lo + (hi - lo) / 2;
+    for(int i=0; i<8; i++)
+    {
+        Vector3i clo, chi;
+        for(int k=0; k<3; k++)
+        {
+            clo[k] = (i >> k) & 1 ? mid[k] : lo[k];
+            chi[k] = (i >> k) & 1 ? hi[k]  : mid[k];
+        }
+        if(clo.x() < chi.x() && clo.y() < chi.y() && clo.z() < chi.z())
+            carveCell(sils, params, volume, clo, chi);
+    }
+}
+
+//Computes the visual hull of a set of views
+Volume visualHull(
+    const vector<View>& views,
+    Vector3i dim,
+    Vector3d low,
+    Vector3d high,
+    const VisualHullParams& params)
+{
+    MetricTimer timer("visualhull");
+
+    ThreadCountScope threads(params.threads);
+
+    Volume volume(dim, low, high);
+    volume.fill(Color(0,0,0));
+    volume.detach();
+
+    //Build silhouettes
+    vector<Silhouette> sils;
+    sils.reserve(views.size());
+    for(size_t i=0; i<views.size(); i++)
+        sils.push_back(Silhouette(views[i], volume, params.background));
+
+    //Top level cells are carved in parallel
+    const int T = VISUAL_HULL_TASK_SIZE;
+    Vector3i cells(
+        (dim.x() + T - 1) / T,
+        (dim.y() + T - 1) / T,
+        (dim.z() + T - 1) / T);
+    int ncells = cells.x() * cells.y() * cells.z();
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int c=0; c<ncells; c++)
+    {
+        Vector3i lo(
+            T * (c % cells.x()),
+            T * ((c / cells.x()) % cells.y()),
+            T * (c / (cells.x() * cells.y())));
+        Vector3i hi(
+            min(lo.x() + T, dim.x()),
+            min(lo.y() + T, dim.y()),
+            min(lo.z() + T, dim.z()));
+        carveCell(sils, params, volume, lo, hi);
+    }
+
+    return volume;
+}
@@ -0,0 +1,291 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include "volume.h"
+#include "debug.h"
+
+using namespace std;
+using namespace Eigen;
+
+//Volume file format (native byte order, little endian on x86):
+//
+//  char[4]     magic "AVOL"
+//  uint32      version
+//  uint32[3]   xRes, yRes, zRes
+//  double[16]  world -> volume transform, row major
+//  bricks...   one per brick, in brick table order
+//
+//Each brick starts with a varint k.  If k > 0 the brick is the same as the
+//brick k places before it (bricks shared in memory stay shared on reload).
+//Otherwise it is a list of runs covering BRICK_VOXELS voxels, each a varint
+//length followed by the 3 color bytes (b, g, r) of the run.  Carved volumes
+//are mostly uniform empty/interior bricks, so the file size is roughly
+//proportional to the number of surface voxels.
+
+static const char       VOLUME_MAGIC[4] = { 'A', 'V', 'O', 'L' };
+static const unsigned   VOLUME_VERSION  = 2;
+
+//Size of the I/O buffers used for volume serialization
+static const size_t     VOLUME_BUFFER_SIZE = 1 << 20;
+
+
+//Buffered binary writer, flushes in large blocks
+struct VolumeWriter
+{
+    VolumeWriter(FILE* f) : file(f), buffer(VOLUME_BUFFER_SIZE), pos(0), ok(true) {}
+    ~VolumeWriter() { flush(); }
+
+    void flush()
+    {
+        if(pos > 0 && fwrite(&buffer[0], 1, pos, file) != pos)
+            ok = false;
+        pos = 0;
+    }
+
+    void write(const void* data, size_t n)
+    {
+        if(pos + n > buffer.size())
+            flush();
+        memcpy(&buffer[pos], data, n);
+        pos += n;
+    }
+
+    void writeVarint(size_t v)
+    {
+        if(pos + 10 > buffer.size())
+            flush();
+        while(v >= 0x80)
+        {
+            buffer[pos++] = (ubyte)(v | 0x80);
+            v >>= 7;
+        }
+        buffer[pos++] = (ubyte)v;
+    }
+
+    FILE*               file;
+    vector<ubyte>       buffer;
+    size_t              pos;
+    bool                ok;
+};
+
+//Buffered binary reader
+struct VolumeReader
+{
+    VolumeReader(FILE* f) : file(f), buffer(VOLUME_BUFFER_SIZE), pos(0), len(0) {}
+
+    bool fill()
+    {
+        len = fread(&buffer[0], 1, buffer.size(), file);
+        pos = 0;
+        return len > 0;
+    }
+
+    bool read(void* data, size_t n)
+    {
+        ubyte* out = (ubyte*)data;
+        while(n > 0)
+        {
+            if(pos == len && !fill())
+                return false;
+            size_t k = min(n, len - pos);
+            memcpy(out, &buffer[pos], k);
+            pos += k;
+            out += k;
+            n   -= k;
+        }
+        return true;
+    }
+
+    //Returns the bytes read ahead to the file, so whatever follows can be
+    //read from it
+    void release()
+    {
+        if(pos < len)
+            fseek(file, -(long)(len - pos), SEEK_CUR);
+        pos = len = 0;
+    }
+
+    bool readVarint(size_t& v)
+    {
+        v = 0;
+        for(int shift=0; shift<64; shift+=7)
+        {
+            if(pos == len && !fill())
+                return false;
+            ubyte b = buffer[pos++];
+            v |= (size_t)(b & 0x7f) << shift;
+            if(!(b & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    FILE*               file;
+    vector<ubyte>       buffer;
+    size_t              pos, len;
+};
+
+
+//Saves the volume in run-length compressed binary form
+bool Volume::save(const string filename) const
+{
+    FILE* f = fopen(filename.c_str(), "wb");
+    if(!f)
+    {
+        cout << "Could not create volume " << filename << endl;
+        return false;
+    }
+
+    bool ok = save(f);
+    ok = fclose(f) == 0 && ok;
+    if(!ok)
+        cout << "Error writing volume " << filename << endl;
+    return ok;
+}
+
+bool Volume::save(FILE* f) const
+{
+    VolumeWriter out(f);
+
+    unsigned header[4] = { VOLUME_VERSION, (unsigned)xRes, (unsigned)yRes, (unsigned)zRes };
+    out.write(VOLUME_MAGIC, 4);
+    out.write(header, sizeof(header));
+
+    double m[16];
+    for(int i=0; i<4; i++)
+    for(int j=0; j<4; j++)
+        m[4*i+j] = mat ? mat->matrix()(i,j) : (i == j ? 1.0 : 0.0);
+    out.write(m, sizeof(m));
+
+    //Encode bricks, sharing is detected by brick address
+    map<const Color*, size_t> seen;
+    Vector3i bdim = brickDims();
+    size_t   index = 0;
+    
+    for(int z=0; z<bdim.z(); z++)
+    for(int y=0; y<bdim.y(); y++)
+    for(int x=0; x<bdim.x(); x++, index++)
+    {
+        const Color* b = brick(Vector3i(x, y, z));
+        
+        map<const Color*, size_t>::iterator it = seen.find(b);
+        if(it != seen.end())
+        {
+            out.writeVarint(index - it->second);
+            continue;
+        }
+        seen[b] = index;
+        out.writeVarint(0);
+        
+        for(size_t i=0; i<BRICK_VOXELS; )
+        {
+            Color c = b[i];
+            size_t j = i + 1;
+            while(j < BRICK_VOXELS && b[j] == c)
+                j++;
+            
+            out.writeVarint(j - i);
+            out.write(&c, 3);
+            i = j;
+        }
+    }
+
+    out.flush();
+    return out.ok;
+}
+
+//Restores a volume written by save(), returns false if the file is bad
+bool Volume::load(const string filename)
+{
+    FILE* f = fopen(filename.c_str(), "rb");
+    if(!f)
+    {
+        cout << "Could not open volume " << filename << endl;
+        return false;
+    }
+
+    bool ok = load(f);
+    if(!ok)
+        cout << "Bad volume data in " << filename << endl;
+    fclose(f);
+    return ok;
+}
+
+bool Volume::load(FILE* f)
+{
+    VolumeReader in(f);
+
+    char        magic[4];
+    unsigned    header[4];
+    double      m[16];
+
+    if( !in.read(magic, 4) || memcmp(magic, VOLUME_MAGIC, 4) != 0 ||
+        !in.read(header, sizeof(header)) || header[0] != VOLUME_VERSION ||
+        !in.read(m, sizeof(m)) )
+        return false;
+
+    Matrix4d xf;
+    for(int i=0; i<4; i++)
+    for(int j=0; j<4; j++)
+        xf(i,j) = m[4*i+j];
+
+    Volume result;
+    result.allocate(Vector3i(header[1], header[2], header[3]));
+    
+    //Decode bricks, uniform bricks of the same color are shared
+    BrickTable& table = *result.bricks;
+    map<Color, BrickPtr> uniform;
+    for(size_t index=0; index<table.size(); index++)
+    {
+        size_t ref;
+        if(!in.readVarint(ref) || ref > index)
+            return false;
+        
+        if(ref > 0)
+        {
+            table[index] = table[index - ref];
+            continue;
+        }
+        
+        BrickPtr b(new Brick(BRICK_VOXELS));
+        size_t   runs = 0;
+        for(size_t i=0; i<BRICK_VOXELS; runs++)
+        {
+            size_t  run;
+            Color   c;
+            if(!in.readVarint(run) || !in.read(&c, 3) || run == 0 || run > BRICK_VOXELS - i)
+                return false;
+            
+            std::fill(b->begin() + i, b->begin() + i + run, c);
+            i += run;
+        }
+        
+        if(runs == 1)
+        {
+            BrickPtr& u = uniform[(*b)[0]];
+            if(!u)
+                u = b;
+            b = u;
+        }
+        table[index] = b;
+    }
+
+    in.release();
+
+    result.mat = boost::shared_ptr<Eigen::Transform3d>(new Eigen::Transform3d(xf));
+    *this = result;
+    return true;
+}
+
+//Saves the surface voxels as a point cloud
+void Volume::savePLY(const string filename) const
+{
+    saveVolumePLY(filename, *this);
+}
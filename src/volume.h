@@ -3,9 +3,12 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstdio>
 #include <vector>
 #include <string>
 
+#include <pthread.h>
+
 #include <boost/shared_ptr.hpp>
 
 #include <Eigen/Core>
@@ -15,13 +18,31 @@
 #include "system.h"
 
 //Voxel data structure
+//  Voxels are stored in BRICK_SIZE^3 bricks.  Both the brick table and the
+//  bricks are shared copy-on-write between copies of a volume, so copying is
+//  O(1) and a write only duplicates the brick it lands in.  Like Image, this
+//  is not thread safe: detach() a region before writing it from many threads.
 struct Volume
 {
+    //Brick layout
+    enum
+    {
+        BRICK_BITS      = 4,
+        BRICK_SIZE      = 1 << BRICK_BITS,
+        BRICK_MASK      = BRICK_SIZE - 1,
+        BRICK_VOXELS    = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE
+    };
+    
+    typedef std::vector<Color>              Brick;
+    typedef boost::shared_ptr<Brick>        BrickPtr;
+    typedef std::vector<BrickPtr>           BrickTable;
+    
     //Default constructors
-    Volume() {}
+    Volume() : xRes(0), yRes(0), zRes(0), bxRes(0), byRes(0), bzRes(0) {}
     Volume(const Volume& other) :
         xRes(other.xRes), yRes(other.yRes), zRes(other.zRes),
-        colors(other.colors),
+        bxRes(other.bxRes), byRes(other.byRes), bzRes(other.bzRes),
+        bricks(other.bricks),
         mat(other.mat) {}
             
     //Constructs a matrix from preallocated memory
@@ -29,24 +50,30 @@ struct Volume
         const Eigen::Vector3i& dimensions,
         std::vector<Color> data,
         const Eigen::Transform3d& transform) :
-            xRes(dimensions.x()), yRes(dimensions.y()), zRes(dimensions.z()),
-            colors(data),
-            mat(new Eigen::Transform3d(transform)) {}
+            mat(new Eigen::Transform3d(transform))
+    {
+        allocate(dimensions);
+        
+        for(size_t z=0; z<zRes; z++)
+        for(size_t y=0; y<yRes; y++)
+        for(size_t x=0; x<xRes; x++)
+            (*this)(Eigen::Vector3i(x, y, z)) = data[x + xRes * (y + yRes * z)];
+    }
     
     //Default volume constructor
     Volume(Eigen::Vector3i dimensions,
             Eigen::Vector3d low_bound, 
-            Eigen::Vector3d high_bound) :
-        xRes(dimensions.x()), 
-        yRes(dimensions.y()), 
-        zRes(dimensions.z()),
-        colors(dimensions.x() * dimensions.y() * dimensions.z())
+            Eigen::Vector3d high_bound)
     {
-        //Construct transform matrix
+        allocate(dimensions);
+        
+        //Construct transform matrix, maps [low_bound, high_bound] to [0, dimensions]
         Eigen::Matrix4d m = Eigen::Matrix4d::Zero();
-        m.block(0,3,0,3) = (Eigen::Vector3d(dimensions).cwise() / 
-            (high_bound - low_bound)).asDiagonal();
-        m.block(0,3,3,1) = low_bound;
+        for(int i=0; i<3; i++)
+        {
+            m(i,i) = (double)dimensions[i] / (high_bound[i] - low_bound[i]);
+            m(i,3) = -low_bound[i] * m(i,i);
+        }
         m(3,3) = 1;
         mat = boost::shared_ptr<Eigen::Transform3d>(new Eigen::Transform3d(m));
         
@@ -59,19 +86,33 @@ struct Volume
         xRes = other.xRes;
         yRes = other.yRes;
         zRes = other.zRes;
-        colors = other.colors;
+        bxRes = other.bxRes;
+        byRes = other.byRes;
+        bzRes = other.bzRes;
+        bricks = other.bricks;
         mat = other.mat;
         return *this;
     }
     
     //Fills the volume with some arbitrary color
+    //  All bricks end up sharing a single uniform brick
     void fill(const Color& color)
     {
-        std::fill(colors.begin(), colors.end(), color);
+        BrickPtr b(new Brick(BRICK_VOXELS, color));
+        bricks = boost::shared_ptr<BrickTable>(new BrickTable(bxRes * byRes * bzRes, b));
     }    
     
-    //Saving for debugging
-    void save(const std::string filename) const;
+    //Binary serialization (run-length compressed, see volume.cpp), both
+    //return false (and say why) if the file can not be written or read
+    bool save(const std::string filename) const;
+    bool load(const std::string filename);
+    
+    //Same, at the current position of an open file, which is left just past
+    //the volume.  Both return false on I/O errors or bad data.
+    bool save(FILE* file) const;
+    bool load(FILE* file);
+    
+    //Saves surface voxels to a PLY file for debugging
     void savePLY(const std::string filename) const;
     
     //Retrieves size
@@ -81,15 +122,45 @@ struct Volume
     Color& operator()(const Eigen::Vector3i& v)
     {
         assert((size_t)v.x() < xRes && (size_t)v.y() < yRes && (size_t)v.z() < zRes);
-        return colors[v.x() + xRes * (v.y() + yRes * v.z())];
+        return (*writableBrick(brickIndex(v)))[voxelIndex(v)];
     }
     Color operator()(const Eigen::Vector3i& v) const
     {
         if((size_t)v.x() < xRes && (size_t)v.y() < yRes && (size_t)v.z() < zRes)
-            return colors[v.x() + xRes * (v.y() + yRes * v.z())];
+            return (*(*bricks)[brickIndex(v)])[voxelIndex(v)];
         return Color(0,0,0);
     }
     
+    //Brick access, b is in brick coordinates
+    //  Voxel (x,y,z) of a brick is at x + BRICK_SIZE * (y + BRICK_SIZE * z)
+    Eigen::Vector3i brickDims() const { return Eigen::Vector3i(bxRes, byRes, bzRes); }
+    const Color* brick(const Eigen::Vector3i& b) const
+    {
+        return &(*(*bricks)[b.x() + bxRes * (b.y() + byRes * b.z())])[0];
+    }
+    Color* writableBrick(const Eigen::Vector3i& b)
+    {
+        return &(*writableBrick(b.x() + bxRes * (b.y() + byRes * b.z())))[0];
+    }
+    
+    //True if brick b is stored in the same memory as in other
+    bool sharesBrick(const Volume& other, const Eigen::Vector3i& b) const
+    {
+        size_t i = b.x() + bxRes * (b.y() + byRes * b.z());
+        return (*bricks)[i] == (*other.bricks)[i];
+    }
+    
+    //Makes the bricks overlapping voxels [lo, hi) private to this volume, so
+    //they can be written concurrently without triggering a copy
+    void detach(const Eigen::Vector3i& lo, const Eigen::Vector3i& hi)
+    {
+        for(int z=lo.z() >> BRICK_BITS; z<=((hi.z() - 1) >> BRICK_BITS) && z<(int)bzRes; z++)
+        for(int y=lo.y() >> BRICK_BITS; y<=((hi.y() - 1) >> BRICK_BITS) && y<(int)byRes; y++)
+        for(int x=lo.x() >> BRICK_BITS; x<=((hi.x() - 1) >> BRICK_BITS) && x<(int)bxRes; x++)
+            writableBrick(x + bxRes * (y + byRes * z));
+    }
+    void detach() { detach(Eigen::Vector3i(0,0,0), size()); }
+    
     //Point membership classification
     bool interior(const Eigen::Vector3i& v) const
     {
@@ -121,13 +192,107 @@ struct Volume
     }
 
 private:
+    friend struct DetachOnWrite;
     
     //Voxel grid dimensions
     size_t xRes, yRes, zRes;
-    std::vector<Color> colors;
+    
+    //Brick grid dimensions and (shared) brick table
+    size_t bxRes, byRes, bzRes;
+    boost::shared_ptr<BrickTable> bricks;
 
     //World -> volume coordinate transform
     boost::shared_ptr< Eigen::Transform3d > mat;
+    
+    //Sets dimensions and allocates a table of empty bricks
+    void allocate(const Eigen::Vector3i& dimensions)
+    {
+        xRes  = dimensions.x();
+        yRes  = dimensions.y();
+        zRes  = dimensions.z();
+        bxRes = (xRes + BRICK_MASK) >> BRICK_BITS;
+        byRes = (yRes + BRICK_MASK) >> BRICK_BITS;
+        bzRes = (zRes + BRICK_MASK) >> BRICK_BITS;
+        fill(Color(0,0,0));
+    }
+    
+    //Index computation
+    size_t brickIndex(const Eigen::Vector3i& v) const
+    {
+        return (v.x() >> BRICK_BITS) + bxRes * ((v.y() >> BRICK_BITS) + byRes * (v.z() >> BRICK_BITS));
+    }
+    static size_t voxelIndex(const Eigen::Vector3i& v)
+    {
+        return (v.x() & BRICK_MASK) + BRICK_SIZE * ((v.y() & BRICK_MASK) + BRICK_SIZE * (v.z() & BRICK_MASK));
+    }
+    
+    //Copy-on-write check, returns a brick which is safe to modify
+    Brick* writableBrick(size_t i)
+    {
+        if(!bricks.unique())
+            bricks = boost::shared_ptr<BrickTable>(new BrickTable(*bricks));
+        BrickPtr& b = (*bricks)[i];
+        if(!b.unique())
+            b = BrickPtr(new Brick(*b));
+        return b.get();
+    }
+};
+
+//Writes to a volume from many threads while copies of it (a snapshot, say)
+//still share its bricks.  A brick is copied under a lock the first time a
+//voxel of it is written, bricks never written stay shared.  The bricks
+//replaced are kept alive until the writer goes away, so threads reading
+//the volume meanwhile never see one freed.  The volume must not be copied
+//or written any other way while the writer is in use.
+struct DetachOnWrite
+{
+    DetachOnWrite(Volume& volume_) : volume(volume_)
+    {
+        //The table itself is made private here, only bricks are copied later
+        if(!volume.bricks.unique())
+            volume.bricks = boost::shared_ptr<Volume::BrickTable>(new Volume::BrickTable(*volume.bricks));
+        shared.resize(volume.bricks->size());
+        for(size_t i=0; i<shared.size(); i++)
+            shared[i] = !(*volume.bricks)[i].unique();
+        pthread_mutex_init(&lock, NULL);
+    }
+    ~DetachOnWrite() { pthread_mutex_destroy(&lock); }
+
+    //Voxel v, for writing
+    Color& operator()(const Eigen::Vector3i& v)
+    {
+        assert((size_t)v.x() < volume.xRes && (size_t)v.y() < volume.yRes && (size_t)v.z() < volume.zRes);
+        size_t i = volume.brickIndex(v);
+        if(*(volatile ubyte*)&shared[i])
+            detach(i);
+        return (*(*volume.bricks)[i])[Volume::voxelIndex(v)];
+    }
+
+private:
+    DetachOnWrite(const DetachOnWrite&);
+    void operator=(const DetachOnWrite&);
+
+    void detach(size_t i)
+    {
+        pthread_mutex_lock(&lock);
+        if(shared[i])
+        {
+            Volume::BrickPtr& b = (*volume.bricks)[i];
+            if(!b.unique())
+            {
+                retired.push_back(b);
+                b = Volume::BrickPtr(new Volume::Brick(*b));
+            }
+            __sync_synchronize();
+            shared[i] = 0;
+        }
+        pthread_mutex_unlock(&lock);
+    }
+
+    Volume&                         volume;
+    std::vector<ubyte>              shared;     //Brick may still be shared
+    std::vector<Volume::BrickPtr>   retired;
+    pthread_mutex_t                 lock;
 };
 
 #endif